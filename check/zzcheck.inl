@@ -217,12 +217,12 @@ SUITE(zzt_assert)
 /******************************************************************************/
 
 int
-main()
+main(int argc, char **argv)
 {
     ADD_TEST_SUITE(zzt_passing);
     ADD_TEST_SUITE(zzt_failing);
     ADD_TEST_SUITE(zzt_skipping);
     ADD_TEST_SUITE(zzt_assert);
 
-    return RUN_TESTS();
+    return RUN_TESTS_ARGS(argc, argv);
 }
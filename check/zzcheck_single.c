@@ -0,0 +1,13 @@
+/*
+ * zztest - A test framework for crufty compilers.
+ * Copyright (c) 2024 Lexi Mayfield
+ *
+ * Distributed under the Boost Software License, Version 1.0. (See
+ * accompanying file LICENSE.txt or copy at
+ * http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#define ZZTEST_IMPLEMENTATION
+#include "zztest.h"
+
+#include "zzcheck.inl"
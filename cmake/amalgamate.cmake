@@ -0,0 +1,14 @@
+#
+# Paste src/zztest.c into include/zztest.h where single-header mode includes
+# it, giving one file that can be dropped into a project.
+#
+#   cmake -DSOURCE_DIR=<zztest> -DOUTPUT=<file> -P amalgamate.cmake
+#
+
+file(READ "${SOURCE_DIR}/include/zztest.h" header)
+file(READ "${SOURCE_DIR}/src/zztest.c" source)
+
+string(REPLACE "#include \"zztest.h\"\n" "" source "${source}")
+string(REPLACE "#include \"../src/zztest.c\"\n" "${source}" header "${header}")
+
+file(WRITE "${OUTPUT}" "${header}")
@@ -0,0 +1,24 @@
+#
+# Run a command and check its exit code, for tools whose exit code is the
+# answer.  Everything after the script is the command.
+#
+#   cmake -DEXPECT=<code> -P exitcode.cmake <program> [args...]
+#
+
+set(command)
+set(skip -1)
+math(EXPR last "${CMAKE_ARGC} - 1")
+foreach(i RANGE ${last})
+    if(skip EQUAL 0)
+        list(APPEND command "${CMAKE_ARGV${i}}")
+    elseif(skip GREATER 0)
+        math(EXPR skip "${skip} - 1")
+    elseif("${CMAKE_ARGV${i}}" STREQUAL "-P")
+        set(skip 1)
+    endif()
+endforeach()
+
+execute_process(COMMAND ${command} RESULT_VARIABLE result)
+if(NOT "${result}" STREQUAL "${EXPECT}")
+    message(FATAL_ERROR "Exited with ${result} instead of ${EXPECT}")
+endif()
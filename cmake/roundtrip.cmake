@@ -0,0 +1,40 @@
+#
+# Run PROGRAM through DECODE and then EXPAND, whichever are given, and check
+# that what comes out is byte for byte the output of PLAIN.  With STABLE,
+# also check that two runs of PROGRAM send exactly the same bytes.
+#
+#   cmake -DPLAIN=<exe> -DPROGRAM=<exe> [-DDECODE=<exe>] [-DEXPAND=<exe>]
+#         [-DSTABLE=ON] -DOUTPUT=<prefix> -P roundtrip.cmake
+#
+
+set(commands COMMAND "${PROGRAM}")
+if(DECODE)
+    list(APPEND commands COMMAND "${DECODE}")
+endif()
+if(EXPAND)
+    list(APPEND commands COMMAND "${EXPAND}")
+endif()
+
+execute_process(COMMAND "${PLAIN}" OUTPUT_FILE "${OUTPUT}.expected")
+execute_process(${commands} OUTPUT_FILE "${OUTPUT}.actual"
+    RESULT_VARIABLE result)
+if(NOT result EQUAL 0 AND (DECODE OR EXPAND))
+    message(FATAL_ERROR "Decoding ${PROGRAM} failed: ${result}")
+endif()
+
+execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files
+    "${OUTPUT}.expected" "${OUTPUT}.actual" RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR
+        "${OUTPUT}.actual differs from the output of ${PLAIN}")
+endif()
+
+if(STABLE)
+    execute_process(COMMAND "${PROGRAM}" OUTPUT_FILE "${OUTPUT}.first")
+    execute_process(COMMAND "${PROGRAM}" OUTPUT_FILE "${OUTPUT}.second")
+    execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files
+        "${OUTPUT}.first" "${OUTPUT}.second" RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Two runs of ${PROGRAM} sent different bytes")
+    endif()
+endif()
@@ -10,7 +10,25 @@
 #if !defined(INCLUDE_ZZTEST_H)
 #define INCLUDE_ZZTEST_H
 
+/*
+ * In single-header mode the implementation shares the includer's system
+ * headers, so its feature macros have to come first.  Include zztest.h
+ * before anything else in that file.
+ */
+#if defined(ZZTEST_IMPLEMENTATION) && defined(__linux__) && \
+    !defined(_GNU_SOURCE) && \
+    (defined(ZZTEST_CONFIG_PERF) || defined(ZZTEST_CONFIG_SELECT))
+#define _GNU_SOURCE /* syscall() and dladdr() under strict C modes */
+#endif
+#if defined(ZZTEST_IMPLEMENTATION) && \
+    (defined(__unix__) || defined(__APPLE__)) && \
+    defined(__STRICT_ANSI__) && !defined(_GNU_SOURCE) && \
+    !defined(_POSIX_C_SOURCE) && !defined(ZZTEST_CONFIG_NO_DEATH_TEST)
+#define _POSIX_C_SOURCE 1 /* kill() for death test timeouts */
+#endif
+
 #include <limits.h>
+#include <stdarg.h>
 #include <stddef.h>
 
 #ifdef __cplusplus
@@ -78,8 +96,122 @@ enum zzt_cmp_e {
 };
 
 struct zzt_test_state_s;
+struct zzt_prop_s;
+struct zzt_async_s;
+struct zzt_bench_s;
+
+/* Property test defaults. */
+#if !defined(ZZTEST_CONFIG_PROP_ARENA)
+#define ZZTEST_CONFIG_PROP_ARENA 4096
+#endif
+#if !defined(ZZTEST_CONFIG_PROP_RUNS)
+#define ZZTEST_CONFIG_PROP_RUNS 100
+#endif
+#if !defined(ZZTEST_CONFIG_PROP_SEED)
+#define ZZTEST_CONFIG_PROP_SEED 0x5EED
+#endif
+
+/* Functions one test can enter while recorded, must be a power of two. */
+#if !defined(ZZTEST_CONFIG_SELECT_FUNCS)
+#define ZZTEST_CONFIG_SELECT_FUNCS 4096
+#endif
+
+/* Fuzz test corpora live in <corpus>/<suite>.<test>/. */
+#if !defined(ZZTEST_CONFIG_FUZZ_CORPUS)
+#define ZZTEST_CONFIG_FUZZ_CORPUS "corpus"
+#endif
+
+/* Bytes of output queued for the transport, must be a power of two. */
+#if !defined(ZZTEST_CONFIG_TRANSPORT_RING)
+#define ZZTEST_CONFIG_TRANSPORT_RING 4096
+#endif
+
+/* Milliseconds a flush waits on a transport that takes nothing. */
+#if !defined(ZZTEST_CONFIG_TRANSPORT_TIMEOUT)
+#define ZZTEST_CONFIG_TRANSPORT_TIMEOUT 1000
+#endif
+
+/* Strings a ZZTEST_CONFIG_WIRE run can send once, must be a power of two. */
+#if !defined(ZZTEST_CONFIG_WIRE_STRINGS)
+#define ZZTEST_CONFIG_WIRE_STRINGS 1024
+#endif
+
+/* Async tests a ZZTEST_CONFIG_ASYNC run keeps in flight at once. */
+#if !defined(ZZTEST_CONFIG_ASYNC_SLOTS)
+#define ZZTEST_CONFIG_ASYNC_SLOTS 16
+#endif
+
+/* Milliseconds an async test waits for a descriptor before it fails. */
+#if !defined(ZZTEST_CONFIG_ASYNC_TIMEOUT)
+#define ZZTEST_CONFIG_ASYNC_TIMEOUT 10000
+#endif
+
+/* Milliseconds a benchmark is measured for, split into samples. */
+#if !defined(ZZTEST_CONFIG_BENCH_TIME)
+#define ZZTEST_CONFIG_BENCH_TIME 200
+#endif
+#if !defined(ZZTEST_CONFIG_BENCH_SAMPLES)
+#define ZZTEST_CONFIG_BENCH_SAMPLES 20
+#endif
+
+/* Most runs EXPECT_FASTER_THAN takes the median of. */
+#if !defined(ZZTEST_CONFIG_TIMED_RUNS)
+#define ZZTEST_CONFIG_TIMED_RUNS 101
+#endif
+
+/* Milliseconds a death test child may run before it is killed. */
+#if !defined(ZZTEST_CONFIG_DEATH_TIMEOUT)
+#define ZZTEST_CONFIG_DEATH_TIMEOUT 10000
+#endif
+
+/* Death tests need fork. */
+#if (defined(__unix__) || defined(__APPLE__)) && \
+    !defined(ZZTEST_CONFIG_NO_DEATH_TEST)
+#define ZZT_HAS_DEATH_TEST
+#endif
+
+#if defined(ZZT_HAS_DEATH_TEST)
+struct zzt_death_s {
+    int pid;
+    int errfd;
+    int statusfd;
+};
+#endif
 
 typedef void (*zzt_testfunc)(struct zzt_test_state_s *);
+typedef void (*zzt_propfunc)(struct zzt_test_state_s *, struct zzt_prop_s *);
+typedef void (*zzt_fuzzfunc)(
+    struct zzt_test_state_s *, const unsigned char *, unsigned long);
+typedef void (*zzt_asyncfunc)(struct zzt_test_state_s *, struct zzt_async_s *);
+typedef void (*zzt_benchfunc)(struct zzt_test_state_s *, struct zzt_bench_s *);
+
+/**
+ * @brief Continuation of an async test, called with the ZZT_ASYNC_* events
+ *        that are ready, or zero if the wait ran out of time.
+ */
+typedef void (*zzt_async_cb)(
+    struct zzt_test_state_s *, struct zzt_async_s *, void *user, int events);
+
+/* Events an async test can wait for. */
+#define ZZT_ASYNC_READ 0x1
+#define ZZT_ASYNC_WRITE 0x2
+
+/* Test flags. */
+#define ZZT_TEST_ASYNC 0x1  /* Finishes on the event loop. */
+#define ZZT_TEST_SERIAL 0x2 /* Runs with no other test in flight. */
+#define ZZT_TEST_BENCH 0x4  /* Measures itself, runs serially. */
+
+/*
+ * State of a running benchmark.  Only these fields are public, so
+ * BENCH_LOOP can count down without a call.
+ */
+struct zzt_bench_s {
+    unsigned long left;  /* Iterations left in the current batch. */
+    unsigned long size;  /* Input size of a BENCH_RANGE, see BENCH_SIZE. */
+    unsigned long bytes; /* Bytes per iteration, see BENCH_BYTES. */
+    unsigned long thread;  /* Index of this thread, see BENCH_THREAD. */
+    unsigned long threads; /* Threads running the body together. */
+};
 
 typedef struct zzt_test_s {
     zzt_testfunc func;
@@ -88,6 +220,9 @@ typedef struct zzt_test_s {
     struct zzt_test_s *next;
     struct zzt_test_s *next_skip;
     struct zzt_test_s *next_fail;
+    unsigned long flags; /* ZZT_TEST_* */
+    const char *lock;    /* Resource held while running, or NULL. */
+    unsigned long ms;    /* Duration in this run, or 0. */
 } zzt_test_s;
 
 struct zzt_test_suite_s {
@@ -95,9 +230,93 @@ struct zzt_test_suite_s {
     struct zzt_test_s *tail;
     const char *suite_name;
     unsigned long tests_count;
+    const char *lock; /* Resource held by every test, or NULL. */
     struct zzt_test_suite_s *next;
 };
 
+/* Status of a test in the results log. */
+enum zzt_status_e {
+    ZZT_STATUS_RUNNING = 1, /* Started, never finished. */
+    ZZT_STATUS_PASSED,
+    ZZT_STATUS_FAILED,
+    ZZT_STATUS_SKIPPED,
+    ZZT_STATUS_CACHED
+};
+
+#define ZZT_LOG_MAGIC "ZZTLOG1"
+
+/*
+ * The results log is a header followed by fixed size records, in native
+ * byte order and layout, so it must be read on the platform that wrote it.
+ */
+struct zzt_log_header_s {
+    char magic[8];             /* ZZT_LOG_MAGIC */
+    unsigned long record_size; /* sizeof(struct zzt_log_record_s) */
+    unsigned long capacity;    /* Records the file has room for. */
+    unsigned long count;       /* Records written so far. */
+};
+
+struct zzt_log_record_s {
+    unsigned long index;     /* Position of the test among all tests. */
+    unsigned long status;    /* enum zzt_status_e */
+    unsigned long ms;        /* Duration, in milliseconds. */
+    unsigned long passed;    /* Passed assertions. */
+    unsigned long failed;    /* Failed assertions. */
+    unsigned long skipped;   /* Skipped assertions. */
+    unsigned long fail_line; /* Line of the first failure. */
+    char fail_file[64];      /* Tail of the file of the first failure. */
+    char name[96];           /* Tail of the test name. */
+};
+
+/*
+ * With ZZTEST_CONFIG_TRANSPORT, each line of output is sent as a frame: a
+ * sync byte, a 16-bit little endian payload length, a sequence number, the
+ * payload, and a 16-bit little endian CRC of everything after the sync byte.
+ * The sync byte isn't escaped, so it can turn up anywhere else in a frame,
+ * and often does in ZZTEST_CONFIG_WIRE payloads.  A decoder resyncing after
+ * damage relies on the CRC to reject the false starts this causes.
+ *
+ * The CRC is CRC-16/CCITT-FALSE: polynomial 0x1021, starting at 0xFFFF,
+ * most significant bit first.
+ */
+#define ZZT_FRAME_SYNC 0x00
+#define ZZT_FRAME_OVERHEAD 6
+#define ZZT_FRAME_PAYLOAD_MAX 1024
+#define ZZT_FRAME_CRC_INIT 0xFFFFU
+#define ZZT_FRAME_CRC_POLY 0x1021U
+
+/*
+ * With ZZTEST_CONFIG_WIRE, output is ZZT_WIRE_MAGIC followed by events.
+ * Numbers are LEB128, and signed numbers are zigzag encoded first.  Text is
+ * a length followed by bytes.  Each distinct string is sent once, and gets
+ * the next ID, starting at zero.  A print event holds the ID of its format
+ * string, then the arguments of each conversion in order:
+ * - '*' widths and integers are numbers.
+ * - Pointers are unsigned numbers, and characters are a single byte.
+ * - Floating point values are text, formatted on the target.
+ * - Strings are the ID of their text.
+ */
+#define ZZT_WIRE_MAGIC "ZZTW1"
+#define ZZT_WIRE_STRING 'S' /* Text of the next string ID. */
+#define ZZT_WIRE_PRINT 'P'  /* Format string ID, then arguments. */
+#define ZZT_WIRE_TEXT 'T'   /* Text printed as-is. */
+
+/**
+ * @brief Output transport, which takes up to len bytes without blocking.
+ *
+ * @return Number of bytes taken, zero if the link is busy.
+ */
+typedef unsigned long (*zzt_transport_func)(
+    void *user, const unsigned char *data, unsigned long len);
+
+#if defined(ZZTEST_CONFIG_FUZZER)
+struct zzt_fuzz_target_s {
+    zzt_fuzzfunc func;
+    const char *name;
+    struct zzt_fuzz_target_s *next;
+};
+#endif
+
 /**
  * @brief Function name of a test suite.
  */
@@ -118,6 +337,42 @@ struct zzt_test_suite_s {
  */
 #define ZZT_TESTINFO(s, t) s##__##t##__TINFO
 
+/**
+ * @brief Function name of a property body.
+ */
+#define ZZT_PROPNAME(s, t) s##__##t##__PROP
+
+/**
+ * @brief Function name of a fuzz test body.
+ */
+#define ZZT_FUZZNAME(s, t) s##__##t##__FUZZ
+
+/**
+ * @brief Symbol name of fuzz target info.
+ */
+#define ZZT_FUZZINFO(s, t) s##__##t##__FZINFO
+
+/**
+ * @brief Function name of an async test body.
+ */
+#define ZZT_ASYNCNAME(s, t) s##__##t##__ASYNC
+
+/**
+ * @brief Function name of a C++ coroutine test body.
+ */
+#define ZZT_CORONAME(s, t) s##__##t##__CORO
+
+/**
+ * @brief Function name of a benchmark body.
+ */
+#define ZZT_BENCHNAME(s, t) s##__##t##__BENCH
+
+/**
+ * @brief Symbol name of a C++ scoped trace guard.
+ */
+#define ZZT_TRACENAME(l) ZZT_TRACENAME_(l)
+#define ZZT_TRACENAME_(l) zzt_trace__##l
+
 #define ZZT_EXPECT_BOOL(cmp, l, r) \
     zzt_cmp_uint(zzt_test_state, ZZT_FMT_BOOL, cmp, !!(l), !!(r), #l, #r, \
         __FILE__, __LINE__)
@@ -155,12 +410,291 @@ struct zzt_test_suite_s {
  * @param s Test suite.  Must be valid identifier.
  * @param t Test name.  Must be valid identifier.
  */
-#define TEST(s, t) \
+#define TEST(s, t) ZZT_TEST_(s, t, 0)
+
+#define ZZT_TEST_(s, t, flags) \
     void ZZT_TESTNAME(s, t)(struct zzt_test_state_s * zzt_test_state); \
     static struct zzt_test_s ZZT_TESTINFO(s, t) = { \
-        ZZT_TESTNAME(s, t), #s, #s "." #t, NULL, NULL, NULL}; \
+        ZZT_TESTNAME(s, t), #s, #s "." #t, NULL, NULL, NULL, flags, NULL, 0}; \
     void ZZT_TESTNAME(s, t)(struct zzt_test_state_s * zzt_test_state)
 
+/**
+ * @brief Define a property test.  Creates a function definition accepting
+ *        test state and a generator, which must be followed by a {} block
+ *        that draws inputs with GEN_* and checks them with expects.  The
+ *        body is run ZZTEST_CONFIG_PROP_RUNS times, and failing inputs are
+ *        shrunk before being reported.  Added to a suite with SUITE_TEST.
+ *
+ * @param s Test suite.  Must be valid identifier.
+ * @param t Test name.  Must be valid identifier.
+ */
+#define PROPERTY(s, t) \
+    static void ZZT_PROPNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_prop_s * zzt_prop); \
+    TEST(s, t) \
+    { \
+        static unsigned char arena[ZZTEST_CONFIG_PROP_ARENA]; \
+        zzt_prop_run(zzt_test_state, ZZT_PROPNAME(s, t), arena, \
+            sizeof(arena), ZZTEST_CONFIG_PROP_RUNS, ZZTEST_CONFIG_PROP_SEED); \
+    } \
+    static void ZZT_PROPNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_prop_s * zzt_prop)
+
+#if defined(ZZTEST_CONFIG_FUZZER)
+#define ZZT_FUZZ_REGISTER_(s, t) \
+    static struct zzt_fuzz_target_s ZZT_FUZZINFO(s, t) = { \
+        ZZT_FUZZNAME(s, t), #s "." #t, NULL}; \
+    static void __attribute__((constructor)) s##__##t##__FZREG(void) \
+    { \
+        zzt_fuzz_register(&ZZT_FUZZINFO(s, t)); \
+    }
+#else
+#define ZZT_FUZZ_REGISTER_(s, t)
+#endif
+
+/**
+ * @brief Define a fuzz test.  Creates a function definition accepting test
+ *        state and an input in data and size, which must be followed by a
+ *        {} block that checks the input with expects.  As a test, the body
+ *        replays every file in ZZTEST_CONFIG_FUZZ_CORPUS/<s>.<t>/.  Built
+ *        with ZZTEST_CONFIG_FUZZER, the body is also a libFuzzer target.
+ *
+ * @param s Test suite.  Must be valid identifier.
+ * @param t Test name.  Must be valid identifier.
+ */
+#define FUZZ_TEST(s, t) \
+    static void ZZT_FUZZNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        const unsigned char *data, unsigned long size); \
+    ZZT_FUZZ_REGISTER_(s, t) \
+    TEST(s, t) \
+    { \
+        zzt_fuzz_replay(zzt_test_state, ZZT_FUZZNAME(s, t), \
+            ZZTEST_CONFIG_FUZZ_CORPUS, #s "." #t); \
+    } \
+    static void ZZT_FUZZNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        const unsigned char *data, unsigned long size)
+
+#if defined(ZZTEST_CONFIG_ASYNC)
+
+/* Hidden parameters an async body or callback needn't use. */
+#if defined(__GNUC__) || defined(__clang__)
+#define ZZT_UNUSED_ __attribute__((unused))
+#else
+#define ZZT_UNUSED_
+#endif
+
+/**
+ * @brief Define an async test.  Creates a function definition accepting
+ *        test state and the test's async handle, which must be followed by
+ *        a {} block that starts some work and waits for it with ASYNC_WAIT
+ *        or ASYNC_SLEEP.  The test finishes once the body or a callback
+ *        returns without waiting again.  The runner keeps up to
+ *        ZZTEST_CONFIG_ASYNC_SLOTS async tests in flight on one event loop.
+ *        Added to a suite with SUITE_TEST.
+ *
+ * @param s Test suite.  Must be valid identifier.
+ * @param t Test name.  Must be valid identifier.
+ */
+#define ASYNC_TEST(s, t) \
+    static void ZZT_ASYNCNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_async_s * zzt_async); \
+    ZZT_TEST_(s, t, ZZT_TEST_ASYNC) \
+    { \
+        zzt_async_start(zzt_test_state, ZZT_ASYNCNAME(s, t)); \
+    } \
+    static void ZZT_ASYNCNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_async_s * zzt_async ZZT_UNUSED_)
+
+/**
+ * @brief Define a continuation for ASYNC_WAIT and ASYNC_SLEEP, which may use
+ *        expects and assertions.  user is the pointer given to the wait, and
+ *        events are the ZZT_ASYNC_* events that are ready, or zero if the
+ *        wait ran out of time.
+ */
+#define ASYNC_CALLBACK(name) \
+    static void name(struct zzt_test_state_s *zzt_test_state, \
+        struct zzt_async_s *zzt_async ZZT_UNUSED_, void *user ZZT_UNUSED_, \
+        int events ZZT_UNUSED_)
+
+/**
+ * @brief Call cb once fd is ready for any of events, or fail the test after
+ *        its timeout.  Only one wait can be pending per test at a time.
+ */
+#define ASYNC_WAIT(fd, events, cb, user) \
+    (zzt_async_wait(zzt_async, fd, events, cb, user, __FILE__, __LINE__))
+
+/**
+ * @brief Call cb with events of zero after ms milliseconds.
+ */
+#define ASYNC_SLEEP(ms, cb, user) \
+    (zzt_async_sleep(zzt_async, ms, cb, user, __FILE__, __LINE__))
+
+/**
+ * @brief Set the milliseconds later ASYNC_WAITs of this test may take.
+ */
+#define ASYNC_TIMEOUT(ms) (zzt_async_timeout(zzt_async, ms))
+
+#endif
+
+#if defined(ZZTEST_CONFIG_BENCH)
+
+/**
+ * @brief Define a benchmark.  Creates a function definition accepting test
+ *        state and the benchmark's state, which must be followed by a {}
+ *        block that sets up and then runs the code to measure in a
+ *        BENCH_LOOP.  The loop runs in batches grown until each takes
+ *        about ZZTEST_CONFIG_BENCH_TIME / ZZTEST_CONFIG_BENCH_SAMPLES ms,
+ *        and the time per iteration is printed.  Added to a suite with
+ *        SUITE_TEST.
+ *
+ * @param s Test suite.  Must be valid identifier.
+ * @param t Test name.  Must be valid identifier.
+ */
+#define BENCH(s, t) \
+    static void ZZT_BENCHNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_bench_s * zzt_bench); \
+    ZZT_TEST_(s, t, ZZT_TEST_BENCH) \
+    { \
+        zzt_bench_run(zzt_test_state, ZZT_BENCHNAME(s, t)); \
+    } \
+    static void ZZT_BENCHNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_bench_s * zzt_bench)
+
+/**
+ * @brief Define a benchmark run once for every input size from lo to hi,
+ *        doubling each time, as BENCH_SIZE.  The time per iteration is
+ *        printed for each size, along with the complexity that fits them
+ *        best.  Added to a suite with SUITE_TEST.
+ *
+ * @param s Test suite.  Must be valid identifier.
+ * @param t Test name.  Must be valid identifier.
+ * @param lo Smallest input size, at least 1.
+ * @param hi Largest input size.
+ */
+#define BENCH_RANGE(s, t, lo, hi) \
+    static void ZZT_BENCHNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_bench_s * zzt_bench); \
+    ZZT_TEST_(s, t, ZZT_TEST_BENCH) \
+    { \
+        zzt_bench_sweep(zzt_test_state, ZZT_BENCHNAME(s, t), lo, hi); \
+    } \
+    static void ZZT_BENCHNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_bench_s * zzt_bench)
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+/**
+ * @brief Define a benchmark run on 1, 2, 4 and so on up to max threads at
+ *        once, each running the body.  The threads go through every batch
+ *        of their BENCH_LOOPs together, and the time per iteration, the
+ *        total throughput and the scaling efficiency are printed for each
+ *        thread count.  BENCH_PAUSE has no effect.  Added to a suite with
+ *        SUITE_TEST.
+ *
+ * @param s Test suite.  Must be valid identifier.
+ * @param t Test name.  Must be valid identifier.
+ * @param max Most threads to run, or 0 for one per processor.
+ */
+#define BENCH_THREADS(s, t, max) \
+    static void ZZT_BENCHNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_bench_s * zzt_bench); \
+    ZZT_TEST_(s, t, ZZT_TEST_BENCH) \
+    { \
+        zzt_bench_scale(zzt_test_state, ZZT_BENCHNAME(s, t), max); \
+    } \
+    static void ZZT_BENCHNAME(s, t)(struct zzt_test_state_s * zzt_test_state, \
+        struct zzt_bench_s * zzt_bench)
+
+#endif
+
+/**
+ * @brief Index of the thread running the body in a BENCH_THREADS, from 0,
+ *        or 0 in other benchmarks.
+ */
+#define BENCH_THREAD() (zzt_bench->thread)
+
+/**
+ * @brief Number of threads running the body together, 1 outside a
+ *        BENCH_THREADS.
+ */
+#define BENCH_THREAD_COUNT() (zzt_bench->threads)
+
+/**
+ * @brief Input size of the current run of a BENCH_RANGE, or 0 in a BENCH.
+ */
+#define BENCH_SIZE() (zzt_bench->size)
+
+/**
+ * @brief Set the bytes each iteration processes, so throughput is printed
+ *        next to the time.
+ */
+#define BENCH_BYTES(n) (zzt_bench->bytes = (unsigned long)(n))
+
+/**
+ * @brief Condition of the loop a BENCH measures, as in
+ *        while (BENCH_LOOP()) { ... }.  Only the time spent inside the loop
+ *        is measured.
+ */
+#define BENCH_LOOP() \
+    (zzt_bench->left != 0 ? (--zzt_bench->left, 1) : zzt_bench_next(zzt_bench))
+
+/**
+ * @brief Stop the clock inside a BENCH_LOOP, for setup that shouldn't be
+ *        measured.  Reading the clock takes time of its own, so keep the
+ *        paused part longer than a few hundred nanoseconds.
+ */
+#define BENCH_PAUSE() (zzt_bench_pause(zzt_bench))
+
+/**
+ * @brief Start the clock again after BENCH_PAUSE.
+ */
+#define BENCH_RESUME() (zzt_bench_resume(zzt_bench))
+
+/**
+ * @brief Make the compiler assume x is read, so the code computing it isn't
+ *        optimized away.  Compilers other than GCC and Clang take its
+ *        address, so x must be an lvalue there.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define ZZT_DO_NOT_OPTIMIZE(x) __asm__ __volatile__("" : : "r,m"(x) : "memory")
+#else
+#define ZZT_DO_NOT_OPTIMIZE(x) (zzt_bench_escape(&(x)))
+#endif
+
+/**
+ * @brief Make the compiler assume all memory is read and written, so
+ *        stores before it are done.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define ZZT_CLOBBER_MEMORY() __asm__ __volatile__("" : : : "memory")
+#else
+#define ZZT_CLOBBER_MEMORY() (zzt_bench_escape(NULL))
+#endif
+
+#endif
+
+/**
+ * @brief Generate a signed integer in [lo, hi].  Shrinks toward zero.
+ */
+#define GEN_INT(lo, hi) (zzt_gen_int(zzt_prop, lo, hi))
+
+/**
+ * @brief Generate an unsigned integer in [lo, hi].  Shrinks toward lo.
+ */
+#define GEN_UINT(lo, hi) (zzt_gen_uint(zzt_prop, lo, hi))
+
+/**
+ * @brief Generate a byte buffer of minlen to maxlen bytes, storing the
+ *        length in *len.  Shrinks toward short buffers of zeroes.
+ */
+#define GEN_BYTES(minlen, maxlen, len) \
+    (zzt_gen_bytes(zzt_prop, minlen, maxlen, len))
+
+/**
+ * @brief Generate a printable ASCII string of minlen to maxlen chars.
+ */
+#define GEN_STR(minlen, maxlen) (zzt_gen_str(zzt_prop, minlen, maxlen))
+
 /**
  * @brief Add a test to a test suite.  Must be placed inside SUITE block.
  */
@@ -179,6 +713,33 @@ struct zzt_test_suite_s {
         } \
     } while (0)
 
+/**
+ * @brief Name a resource every test of a suite holds while running, such
+ *        as a global simulator.  With --jobs, tests holding the same
+ *        resource never run at the same time, in this or any other suite.
+ *        Must be placed inside SUITE block.
+ */
+#define SUITE_LOCK(s, name) (ZZT_SUITEINFO(s).lock = (name))
+
+/**
+ * @brief Run the tests of a suite one at a time with --jobs, alongside
+ *        tests of other suites.  Shorthand for a lock named after the
+ *        suite.  Must be placed inside SUITE block.
+ */
+#define SUITE_SERIAL(s) SUITE_LOCK(s, #s)
+
+/**
+ * @brief Name a resource a test holds while running, as SUITE_LOCK does
+ *        for a whole suite.  Must be placed inside SUITE block.
+ */
+#define TEST_LOCK(s, t, name) (ZZT_TESTINFO(s, t).lock = (name))
+
+/**
+ * @brief Run a test with no other test in flight when run with --jobs.
+ *        Must be placed inside SUITE block.
+ */
+#define TEST_SERIAL(s, t) (ZZT_TESTINFO(s, t).flags |= ZZT_TEST_SERIAL)
+
 /**
  * Expect expression t evaluates to non-zero or true value.
  */
@@ -744,6 +1305,174 @@ struct zzt_test_suite_s {
         } \
     } while (0)
 
+/**
+ * @brief Expect statement s performs no heap allocations.  Requires
+ *        ZZTEST_CONFIG_ALLOC.  With ZZTEST_CONFIG_THREADS, only those
+ *        made on the calling thread count.
+ */
+#define EXPECT_NO_ALLOCATIONS(s) \
+    do { \
+        unsigned long zzt_allocs_ = zzt_alloc_count(); \
+        s; \
+        zzt_cmp_uint(zzt_test_state, ZZT_FMT_UINT, ZZT_CMP_EQ, \
+            zzt_alloc_count() - zzt_allocs_, 0, "allocations by " #s, "0", \
+            __FILE__, __LINE__); \
+    } while (0)
+
+/**
+ * @brief Assert statement s performs no heap allocations, exit early if
+ *        failed.  Requires ZZTEST_CONFIG_ALLOC.
+ */
+#define ASSERT_NO_ALLOCATIONS(s) \
+    do { \
+        unsigned long zzt_allocs_ = zzt_alloc_count(); \
+        s; \
+        if (!zzt_cmp_uint(zzt_test_state, ZZT_FMT_UINT, ZZT_CMP_EQ, \
+                zzt_alloc_count() - zzt_allocs_, 0, "allocations by " #s, \
+                "0", __FILE__, __LINE__)) { \
+            return; \
+        } \
+    } while (0)
+
+/**
+ * @brief Expect statement s frees everything it allocates.  Requires
+ *        ZZTEST_CONFIG_ALLOC.  With ZZTEST_CONFIG_THREADS, only the
+ *        calling thread's allocations and frees count.
+ */
+#define EXPECT_NO_LEAKS(s) \
+    do { \
+        long zzt_bytes_ = zzt_alloc_bytes(); \
+        s; \
+        zzt_cmp_int(zzt_test_state, ZZT_FMT_INT, ZZT_CMP_LE, \
+            zzt_alloc_bytes() - zzt_bytes_, 0, "bytes leaked by " #s, "0", \
+            __FILE__, __LINE__); \
+    } while (0)
+
+/**
+ * @brief Assert statement s frees everything it allocates, exit early if
+ *        failed.  Requires ZZTEST_CONFIG_ALLOC.
+ */
+#define ASSERT_NO_LEAKS(s) \
+    do { \
+        long zzt_bytes_ = zzt_alloc_bytes(); \
+        s; \
+        if (!zzt_cmp_int(zzt_test_state, ZZT_FMT_INT, ZZT_CMP_LE, \
+                zzt_alloc_bytes() - zzt_bytes_, 0, "bytes leaked by " #s, \
+                "0", __FILE__, __LINE__)) { \
+            return; \
+        } \
+    } while (0)
+
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
+
+/* Runs of a statement timed by EXPECT_FASTER_THAN. */
+struct zzt_timed_s {
+    unsigned long runs;  /* Runs to time. */
+    unsigned long count; /* Runs timed so far. */
+    ZZT_UINTMAX start;   /* Clock at the start of the current run. */
+    ZZT_UINTMAX ns[ZZTEST_CONFIG_TIMED_RUNS];
+};
+
+/**
+ * @brief Expect statement s to take at most us microseconds, as the median
+ *        of running it runs times, up to ZZTEST_CONFIG_TIMED_RUNS.  The
+ *        budget is multiplied by --time-scale or ZZTEST_TIME_SCALE.
+ */
+#define EXPECT_FASTER_THAN(s, us, runs) \
+    do { \
+        struct zzt_timed_s zzt_timed_; \
+        zzt_timed_init(&zzt_timed_, runs); \
+        while (zzt_timed_next(&zzt_timed_)) { \
+            s; \
+        } \
+        zzt_expect_faster(zzt_test_state, &zzt_timed_, us, #s, __FILE__, \
+            __LINE__); \
+    } while (0)
+
+/**
+ * @brief Assert statement s takes at most us microseconds, as the median of
+ *        runs runs, exit early if failed.
+ */
+#define ASSERT_FASTER_THAN(s, us, runs) \
+    do { \
+        struct zzt_timed_s zzt_timed_; \
+        zzt_timed_init(&zzt_timed_, runs); \
+        while (zzt_timed_next(&zzt_timed_)) { \
+            s; \
+        } \
+        if (!zzt_expect_faster(zzt_test_state, &zzt_timed_, us, #s, \
+                __FILE__, __LINE__)) { \
+            return; \
+        } \
+    } while (0)
+
+#endif
+
+#if defined(ZZT_HAS_DEATH_TEST)
+
+/**
+ * @brief Exit predicate, child exited normally with the given code.
+ */
+#define ZZT_EXITED_WITH(code) ((int)((code) & 0xFF))
+
+/**
+ * @brief Exit predicate, child was killed by the given signal.
+ */
+#define ZZT_KILLED_BY(sig) (-(int)(sig))
+
+/**
+ * @brief Exit predicate, child exited with a non-zero code or was killed.
+ */
+#define ZZT_DIED (INT_MIN)
+
+#define ZZT_DEATH_(stmt, pred, pattern, onfail) \
+    do { \
+        struct zzt_death_s zzt_death_; \
+        if (zzt_death_fork(&zzt_death_)) { \
+            stmt; \
+            zzt_death_returned(&zzt_death_); \
+        } \
+        if (!zzt_death_check(zzt_test_state, &zzt_death_, pred, pattern, \
+                #stmt, __FILE__, __LINE__)) { \
+            onfail; \
+        } \
+    } while (0)
+
+/**
+ * @brief Expect statement stmt to kill the process, either with a signal
+ *        or a non-zero exit code.  The statement is run in a forked child.
+ *
+ * @param stmt Statement to run.
+ * @param pattern Extended regex the child's stderr must match, or NULL.
+ */
+#define EXPECT_DEATH(stmt, pattern) \
+    ZZT_DEATH_(stmt, ZZT_DIED, pattern, (void)0)
+
+/**
+ * @brief Assert statement stmt kills the process, exit early if failed.
+ */
+#define ASSERT_DEATH(stmt, pattern) ZZT_DEATH_(stmt, ZZT_DIED, pattern, return)
+
+/**
+ * @brief Expect statement stmt to end the process in the way described by
+ *        pred, which is ZZT_EXITED_WITH, ZZT_KILLED_BY or ZZT_DIED.  The
+ *        statement is run in a forked child.
+ *
+ * @param stmt Statement to run.
+ * @param pred Exit predicate.
+ * @param pattern Extended regex the child's stderr must match, or NULL.
+ */
+#define EXPECT_EXIT(stmt, pred, pattern) \
+    ZZT_DEATH_(stmt, pred, pattern, (void)0)
+
+/**
+ * @brief Assert statement stmt ends the process in the way described by
+ *        pred, exit early if failed.
+ */
+#define ASSERT_EXIT(stmt, pred, pattern) ZZT_DEATH_(stmt, pred, pattern, return)
+
+#endif /* defined(ZZT_HAS_DEATH_TEST) */
+
 /**
  * @brief Add a failure, without a return.
  */
@@ -771,9 +1500,19 @@ struct zzt_test_suite_s {
     } while (0)
 
 /**
- * @brief Keep track of context to be shown if a test fails.
+ * @brief Keep track of context to be shown if a test fails.  The message is
+ *        only formatted if a failure is printed.
+ *
+ * @details In C, each call replaces the trace of the current scope, and
+ *          zzt_trace_push/zzt_trace_pop open and close nested scopes.  In
+ *          C++, each SCOPED_TRACE opens its own scope which is closed at
+ *          the end of the enclosing block.
  */
+#if defined(__cplusplus)
+#define SCOPED_TRACE zzt_scoped_trace_s ZZT_TRACENAME(__LINE__)
+#else
 #define SCOPED_TRACE zzt_scoped_trace
+#endif
 
 /**
  * @brief Add suite of tests to be run when RUN_TESTS is called.
@@ -789,6 +1528,12 @@ struct zzt_test_suite_s {
  */
 #define RUN_TESTS() (zzt_run_all())
 
+/**
+ * @brief Run all tests with command line options and return code which can
+ *        be returned from main().  Pass --help for a list of options.
+ */
+#define RUN_TESTS_ARGS(argc, argv) (zzt_run_args(argc, argv))
+
 void
 zzt_pass(struct zzt_test_state_s *state);
 
@@ -799,6 +1544,14 @@ void
 zzt_fail(struct zzt_test_state_s *state, const char *file, unsigned long line,
     const char *msgstr);
 
+/**
+ * @brief Fold what every thread counted for a test into its state, as the
+ *        runner does once a test finishes.  Call this after calling a test
+ *        function yourself.  Does nothing without ZZTEST_CONFIG_THREADS.
+ */
+void
+zzt_collect(struct zzt_test_state_s *state);
+
 ZZT_BOOL
 zzt_cmp_int(struct zzt_test_state_s *state, enum zzt_fmt_e fmt,
     enum zzt_cmp_e cmp, ZZT_INTMAX l, ZZT_INTMAX r, const char *ls,
@@ -817,14 +1570,385 @@ zzt_cmp_str(struct zzt_test_state_s *state, enum zzt_fmt_e fmt,
 void
 zzt_add_test_suite(struct zzt_test_suite_s *suite);
 
+/**
+ * @brief Run a property, shrinking and reporting the smallest failing input
+ *        if one is found.
+ *
+ * @param state Test state.
+ * @param func Property body.
+ * @param arena Scratch memory for choices and generated buffers.
+ * @param arenalen Length of arena.
+ * @param runs Number of random inputs to try.
+ * @param seed Random seed, overridden by the ZZTEST_PROP_SEED environment
+ *             variable if it is set.
+ */
+void
+zzt_prop_run(struct zzt_test_state_s *state, zzt_propfunc func, void *arena,
+    unsigned long arenalen, unsigned long runs, unsigned long seed);
+
+/**
+ * @brief Run a fuzz test body against the empty input and every file in a
+ *        corpus directory.
+ *
+ * @param state Test state.
+ * @param func Fuzz test body.
+ * @param corpus Corpus root, overridden by the ZZTEST_FUZZ_CORPUS
+ *               environment variable if it is set.
+ * @param name Name of the directory under corpus holding inputs.
+ */
+void
+zzt_fuzz_replay(struct zzt_test_state_s *state, zzt_fuzzfunc func,
+    const char *corpus, const char *name);
+
+#if defined(ZZTEST_CONFIG_ASYNC)
+
+/**
+ * @brief Run an async test body.  Under the runner the test is left in
+ *        flight if it waits, otherwise the event loop is run until it is
+ *        done.
+ */
+void
+zzt_async_start(struct zzt_test_state_s *state, zzt_asyncfunc func);
+
+/**
+ * @brief Wait for fd to be ready for any of events, see ASYNC_WAIT.
+ */
+void
+zzt_async_wait(struct zzt_async_s *async, int fd, int events, zzt_async_cb cb,
+    void *user, const char *file, unsigned long line);
+
+/**
+ * @brief Wait for ms milliseconds, see ASYNC_SLEEP.
+ */
+void
+zzt_async_sleep(struct zzt_async_s *async, unsigned long ms, zzt_async_cb cb,
+    void *user, const char *file, unsigned long line);
+
+/**
+ * @brief Set the timeout of later waits, see ASYNC_TIMEOUT.
+ */
+void
+zzt_async_timeout(struct zzt_async_s *async, unsigned long ms);
+
+#endif
+
+#if defined(ZZTEST_CONFIG_BENCH)
+
+/**
+ * @brief Run a benchmark body and print its time per iteration.
+ */
+void
+zzt_bench_run(struct zzt_test_state_s *state, zzt_benchfunc func);
+
+/**
+ * @brief Run a benchmark body for each size from lo to hi, doubling, and
+ *        print a table of times and the complexity that fits them.
+ */
+void
+zzt_bench_sweep(struct zzt_test_state_s *state, zzt_benchfunc func,
+    unsigned long lo, unsigned long hi);
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+/**
+ * @brief Run a benchmark body on growing numbers of threads at once, up to
+ *        maxThreads or one per processor if 0, and print how it scales.
+ */
+void
+zzt_bench_scale(struct zzt_test_state_s *state, zzt_benchfunc func,
+    unsigned long maxThreads);
+
+#endif
+
+/**
+ * @brief Finish a batch of a BENCH_LOOP and start the next one.
+ *
+ * @return False once the benchmark is measured.
+ */
+int
+zzt_bench_next(struct zzt_bench_s *bench);
+
+void
+zzt_bench_pause(struct zzt_bench_s *bench);
+
+void
+zzt_bench_resume(struct zzt_bench_s *bench);
+
+/**
+ * @brief Hide ptr from the optimizer on compilers without inline asm.
+ */
+void
+zzt_bench_escape(const volatile void *ptr);
+
+#endif
+
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+
+/**
+ * @brief Send output through func.  Queued output is kept, and goes to the
+ *        new transport on the next poll.
+ */
+void
+zzt_transport_set(zzt_transport_func func, void *user);
+
+/**
+ * @brief Hand queued output to the transport until it's busy.  The runner
+ *        polls between tests, and targets may also poll when idle.
+ *
+ * @return Number of bytes still queued.
+ */
+unsigned long
+zzt_transport_poll(void);
+
+#endif
+
+#if defined(ZZTEST_CONFIG_FUZZER)
+
+/**
+ * @brief Make a fuzz test available to LLVMFuzzerTestOneInput.
+ */
+void
+zzt_fuzz_register(struct zzt_fuzz_target_s *target);
+
+#endif
+
+ZZT_INTMAX
+zzt_gen_int(struct zzt_prop_s *prop, ZZT_INTMAX lo, ZZT_INTMAX hi);
+
+ZZT_UINTMAX
+zzt_gen_uint(struct zzt_prop_s *prop, ZZT_UINTMAX lo, ZZT_UINTMAX hi);
+
+unsigned char *
+zzt_gen_bytes(struct zzt_prop_s *prop, unsigned long minlen,
+    unsigned long maxlen, unsigned long *len);
+
+char *
+zzt_gen_str(struct zzt_prop_s *prop, unsigned long minlen, unsigned long maxlen);
+
+#if defined(ZZT_HAS_DEATH_TEST)
+
+/**
+ * @brief Fork a death test child.
+ *
+ * @return True in the child, false in the parent.
+ */
+ZZT_BOOL
+zzt_death_fork(struct zzt_death_s *death);
+
+/**
+ * @brief Called in the child if the death test statement returned.
+ */
+void
+zzt_death_returned(struct zzt_death_s *death);
+
+ZZT_BOOL
+zzt_death_check(struct zzt_test_state_s *state, struct zzt_death_s *death,
+    int pred, const char *pattern, const char *stmt, const char *file,
+    unsigned long line);
+
+#endif
+
 void
 zzt_scoped_trace(const char *fmt, ...);
 
+void
+zzt_vscoped_trace(const char *fmt, va_list va);
+
+/**
+ * @brief Open a nested trace scope.  Traces set until the matching
+ *        zzt_trace_pop are shown in addition to those of outer scopes.
+ */
+void
+zzt_trace_push(void);
+
+/**
+ * @brief Close the innermost trace scope, discarding its trace.
+ */
+void
+zzt_trace_pop(void);
+
+/**
+ * @brief Record an allocation of size bytes.  Call this from a custom
+ *        allocator on platforms where malloc cannot be interposed.
+ */
+void
+zzt_track_alloc(size_t size);
+
+/**
+ * @brief Record a free of size bytes.
+ */
+void
+zzt_track_free(size_t size);
+
+/**
+ * @brief Return the number of allocations tracked since program start, or
+ *        with ZZTEST_CONFIG_THREADS, those made by the calling thread.
+ */
+unsigned long
+zzt_alloc_count(void);
+
+/**
+ * @brief Return the bytes allocated and not yet freed, or with
+ *        ZZTEST_CONFIG_THREADS, the bytes the calling thread allocated less
+ *        those it freed.
+ */
+long
+zzt_alloc_bytes(void);
+
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
+
+/**
+ * @brief Start timing up to runs runs of EXPECT_FASTER_THAN.
+ */
+void
+zzt_timed_init(struct zzt_timed_s *timed, unsigned long runs);
+
+/**
+ * @brief Finish timing a run of EXPECT_FASTER_THAN and start the next.
+ *
+ * @return False once every run is timed.
+ */
+int
+zzt_timed_next(struct zzt_timed_s *timed);
+
+/**
+ * @brief Check the median of the timed runs against a budget of us
+ *        microseconds, scaled by --time-scale.
+ *
+ * @return True if the statement was fast enough.
+ */
+ZZT_BOOL
+zzt_expect_faster(struct zzt_test_state_s *state,
+    struct zzt_timed_s *timed, unsigned long us, const char *expr,
+    const char *file, unsigned long line);
+
+#endif
+
 int
 zzt_run_all(void);
 
+int
+zzt_run_args(int argc, char **argv);
+
 #ifdef __cplusplus
 }
+
+/**
+ * @brief Guard object behind SCOPED_TRACE in C++.
+ */
+struct zzt_scoped_trace_s {
+    zzt_scoped_trace_s(const char *fmt, ...)
+    {
+        va_list va;
+        zzt_trace_push();
+        va_start(va, fmt);
+        zzt_vscoped_trace(fmt, va);
+        va_end(va);
+    }
+    ~zzt_scoped_trace_s() { zzt_trace_pop(); }
+};
+
+#if defined(ZZTEST_CONFIG_ASYNC) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+
+/**
+ * @brief Return type of a CO_TEST body.  The body runs eagerly up to its
+ *        first co_await, and its frame is freed when it returns.
+ */
+struct zzt_co_task_s {
+    struct promise_type {
+        zzt_co_task_s get_return_object() { return zzt_co_task_s(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/**
+ * @brief Awaitable behind CO_WAIT and CO_SLEEP.  Resumes with the ready
+ *        events, or zero if the wait ran out of time.
+ */
+struct zzt_co_wait_s {
+    zzt_async_s *async;
+    int fd; /* Or -1 to sleep. */
+    int events;
+    unsigned long ms;
+    const char *file;
+    unsigned long line;
+    int ready;
+    std::coroutine_handle<> handle;
+
+    zzt_co_wait_s(zzt_async_s *async_, int fd_, int events_,
+        unsigned long ms_, const char *file_, unsigned long line_)
+        : async(async_), fd(fd_), events(events_), ms(ms_), file(file_),
+          line(line_), ready(0)
+    {
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        handle = h;
+        if (fd < 0) {
+            zzt_async_sleep(async, ms, resume, this, file, line);
+        } else {
+            zzt_async_wait(async, fd, events, resume, this, file, line);
+        }
+    }
+
+    int await_resume() const noexcept { return ready; }
+
+    static void resume(
+        zzt_test_state_s *, zzt_async_s *, void *user, int events)
+    {
+        zzt_co_wait_s *self = static_cast<zzt_co_wait_s *>(user);
+        self->ready = events;
+        self->handle.resume();
+    }
+};
+
+/**
+ * @brief Define an async test as a C++20 coroutine, which waits with
+ *        co_await CO_WAIT or CO_SLEEP.  Coroutines can't return, so use
+ *        expects rather than assertions, and co_return to stop early.
+ *
+ * @param s Test suite.  Must be valid identifier.
+ * @param t Test name.  Must be valid identifier.
+ */
+#define CO_TEST(s, t) \
+    static zzt_co_task_s ZZT_CORONAME(s, t)( \
+        zzt_test_state_s * zzt_test_state, zzt_async_s * zzt_async); \
+    ASYNC_TEST(s, t) \
+    { \
+        ZZT_CORONAME(s, t)(zzt_test_state, zzt_async); \
+    } \
+    static zzt_co_task_s ZZT_CORONAME(s, t)( \
+        zzt_test_state_s * zzt_test_state, zzt_async_s * zzt_async ZZT_UNUSED_)
+
+/**
+ * @brief Awaitable for fd being ready for any of events, see ASYNC_WAIT.
+ */
+#define CO_WAIT(fd, events) \
+    (zzt_co_wait_s(zzt_async, fd, events, 0, __FILE__, __LINE__))
+
+/**
+ * @brief Awaitable for ms milliseconds passing.
+ */
+#define CO_SLEEP(ms) (zzt_co_wait_s(zzt_async, -1, 0, ms, __FILE__, __LINE__))
+
+#endif
+#endif
+
+/*
+ * Single-header mode: define ZZTEST_IMPLEMENTATION in exactly one file before
+ * including zztest.h, and that file builds the whole framework.
+ */
+#if defined(ZZTEST_IMPLEMENTATION) && !defined(ZZT_IMPLEMENTATION_)
+#define ZZT_IMPLEMENTATION_
+#include "../src/zztest.c"
 #endif
 
 #endif /* !defined(INCLUDE_ZZTEST_H) */
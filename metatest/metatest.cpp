@@ -14,13 +14,38 @@
 
 #include "catch2/catch_all.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 /******************************************************************************/
 
+static std::string g_output;
+
+extern "C" int
+metatest_printf(const char *fmt, ...);
+
 struct zzt_test_state_s {
     struct zzt_test_s *test;
     int passed;
     int failed;
     int skipped;
+    const char *fail_file;
+    unsigned long fail_line;
 };
 
 static zzt_test_state_s
@@ -28,6 +53,7 @@ RunTest(const zzt_test_s &test)
 {
     zzt_test_state_s state = {0};
     test.func(&state);
+    zzt_collect(&state);
     return state;
 }
 
@@ -37,6 +63,70 @@ struct test_s {
     zzt_test_s *test = nullptr;
 };
 
+#if defined(__unix__) || defined(__APPLE__)
+
+struct run_s {
+    int status = -1;
+    std::string output;
+};
+
+/* Run the runner with args in a child, so the suites add registers and the
+ * options it parses don't leak into other test cases.  after can print
+ * whatever the parent should see. */
+static run_s
+RunArgs(std::vector<const char *> args, void (*add)(),
+    void (*after)() = nullptr)
+{
+    run_s run;
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return run;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::vector<char *> argv;
+        argv.push_back(const_cast<char *>("metatest"));
+        for (const char *arg : args) {
+            argv.push_back(const_cast<char *>(arg));
+        }
+
+        close(fds[0]);
+        g_output.clear();
+        add();
+        int status = zzt_run_args((int)argv.size(), argv.data());
+        if (after != nullptr) {
+            after();
+        }
+        for (size_t at = 0; at < g_output.size();) {
+            ssize_t len = write(fds[1], g_output.data() + at,
+                g_output.size() - at);
+            if (len <= 0) {
+                break;
+            }
+            at += (size_t)len;
+        }
+        _exit(status);
+    }
+
+    close(fds[1]);
+    char buf[4096];
+    ssize_t len;
+    while ((len = read(fds[0], buf, sizeof(buf))) > 0) {
+        run.output.append(buf, (size_t)len);
+    }
+    close(fds[0]);
+
+    int status = 0;
+    if (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status)) {
+        run.status = WEXITSTATUS(status);
+    }
+    return run;
+}
+
+#endif
+
 /******************************************************************************/
 
 TEST(metatest, testtrue)
@@ -70,6 +160,27 @@ TEST_CASE("TRUE/FALSE")
 
 /******************************************************************************/
 
+static unsigned long g_failLine;
+
+TEST(metatest, fail_location)
+{
+    EXPECT_TRUE(true);
+    g_failLine = __LINE__ + 1;
+    EXPECT_TRUE(false);
+    EXPECT_TRUE(false);
+}
+
+TEST_CASE("Failure location")
+{
+    auto state = RunTest(ZZT_TESTINFO(metatest, fail_location));
+    REQUIRE(state.failed == 2);
+    REQUIRE(state.fail_file != nullptr);
+    REQUIRE(strstr(state.fail_file, "metatest.cpp") != nullptr);
+    REQUIRE(state.fail_line == g_failLine);
+}
+
+/******************************************************************************/
+
 TEST(metatest, booleq)
 {
     EXPECT_BOOLEQ(true, true);
@@ -440,8 +551,1111 @@ TEST_CASE("STR")
     REQUIRE(state.failed == test.failed);
 }
 
+/******************************************************************************/
+
+TEST(metatest, no_allocations)
+{
+    EXPECT_NO_ALLOCATIONS((void)0);
+    ASSERT_NO_ALLOCATIONS((void)0);
+    EXPECT_NO_ALLOCATIONS(zzt_track_alloc(16));
+    ASSERT_NO_ALLOCATIONS(zzt_track_alloc(16));
+    EXPECT_NO_ALLOCATIONS(zzt_track_alloc(16));
+}
+
+TEST_CASE("NO_ALLOCATIONS")
+{
+    auto test = GENERATE( //
+        test_s{2, 2, &ZZT_TESTINFO(metatest, no_allocations)});
+
+    auto state = RunTest(*test.test);
+    REQUIRE(state.passed == test.passed);
+    REQUIRE(state.failed == test.failed);
+
+    zzt_track_free(16);
+    zzt_track_free(16);
+}
+
+/******************************************************************************/
+
+static void *g_leaked;
+
+TEST(leaks, leak)
+{
+    EXPECT_NO_LEAKS(g_leaked = malloc(64));
+}
+
+TEST(leaks, balanced)
+{
+    EXPECT_NO_LEAKS(free(malloc(64)));
+    ASSERT_NO_LEAKS(free(malloc(64)));
+}
+
+TEST(leaks, once)
+{
+    /* Kept for good, like the state of libc's first localtime(). */
+    static void *s_cache;
+    if (s_cache == nullptr) {
+        s_cache = malloc(72);
+    }
+}
+
+SUITE(leaks)
+{
+    SUITE_TEST(leaks, leak);
+    SUITE_TEST(leaks, once);
+}
+
+TEST_CASE("Leaks")
+{
+    auto state = RunTest(ZZT_TESTINFO(leaks, leak));
+    REQUIRE(state.failed == 1);
+    free(g_leaked);
+
+    state = RunTest(ZZT_TESTINFO(leaks, balanced));
+    REQUIRE(state.passed == 2);
+    REQUIRE(state.failed == 0);
+
+#if defined(__unix__) || defined(__APPLE__)
+    auto run = RunArgs({}, [] { ADD_TEST_SUITE(leaks); });
+    REQUIRE(run.status == 1);
+    REQUIRE(run.output.find("leaks.once: warning: Leaked 72 bytes in 1 "
+                            "allocations") != std::string::npos);
+    REQUIRE(run.output.find("[  FAILED  ] leaks.leak\n") != std::string::npos);
+    REQUIRE(run.output.find("[  FAILED  ] leaks.once\n") == std::string::npos);
+#endif
+}
+
+/******************************************************************************/
+
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
+
+static volatile unsigned long g_spin;
+
+TEST(metatest, faster_than)
+{
+    EXPECT_FASTER_THAN((void)0, 1000000, 5);
+    ASSERT_FASTER_THAN((void)0, 1000000, 5);
+    EXPECT_FASTER_THAN(for (int i = 0; i < 10000; i++) g_spin += 1, 0, 3);
+    ASSERT_FASTER_THAN(for (int i = 0; i < 10000; i++) g_spin += 1, 0, 3);
+    EXPECT_TRUE(false);
+}
+
+TEST_CASE("FASTER_THAN")
+{
+    auto test = GENERATE( //
+        test_s{2, 2, &ZZT_TESTINFO(metatest, faster_than)});
+
+    auto state = RunTest(*test.test);
+    REQUIRE(state.passed == test.passed);
+    REQUIRE(state.failed == test.failed);
+}
+
+#endif
+
+/******************************************************************************/
+
+TEST(metatest, scoped_trace)
+{
+    SCOPED_TRACE("outer %d", 1);
+    {
+        SCOPED_TRACE("inner %s %d", "x", 2);
+        ADD_FAILURE();
+    }
+    ADD_FAILURE();
+}
+
+TEST(metatest, scoped_trace_c)
+{
+    char buf[8] = "before";
+
+    zzt_trace_push();
+    zzt_scoped_trace("%s %5.2f %*d%%", buf, 1.5, 4, 7);
+    strcpy(buf, "after");
+    ADD_FAILURE();
+    zzt_scoped_trace("%lu", 42ul);
+    ADD_FAILURE();
+    zzt_trace_pop();
+}
+
+TEST(metatest, scoped_trace_long)
+{
+    std::string a(199, 'a');
+
+    if (a.empty())
+        SCOPED_TRACE("unused");
+    SCOPED_TRACE("%s %s %d", a.c_str(), "x", 3);
+    ADD_FAILURE();
+}
+
+static void
+NestTrace(zzt_test_state_s *zzt_test_state, int depth)
+{
+    SCOPED_TRACE("depth %d", depth);
+    if (depth < 10) {
+        NestTrace(zzt_test_state, depth + 1);
+    } else {
+        ADD_FAILURE();
+    }
+    if (depth == 7) {
+        ADD_FAILURE();
+    }
+}
+
+TEST(metatest, scoped_trace_deep)
+{
+    NestTrace(zzt_test_state, 1);
+}
+
+TEST_CASE("SCOPED_TRACE")
+{
+    g_output.clear();
+    auto state = RunTest(ZZT_TESTINFO(metatest, scoped_trace));
+    REQUIRE(state.failed == 2);
+
+    auto inner = g_output.find(
+        "error: Failure\nScoped trace: inner x 2\nScoped trace: outer 1\n\n");
+    REQUIRE(inner != std::string::npos);
+    auto outer = g_output.find("error: Failure\nScoped trace: outer 1\n\n");
+    REQUIRE(outer != std::string::npos);
+    REQUIRE(outer > inner);
+
+    g_output.clear();
+    state = RunTest(ZZT_TESTINFO(metatest, scoped_trace_c));
+    REQUIRE(state.failed == 2);
+    REQUIRE(g_output.find("Scoped trace: before  1.50    7%\n") !=
+            std::string::npos);
+    REQUIRE(g_output.find("Scoped trace: 42\n") != std::string::npos);
+
+    g_output.clear();
+    state = RunTest(ZZT_TESTINFO(metatest, scoped_trace_long));
+    REQUIRE(state.failed == 1);
+    REQUIRE(g_output.find("Scoped trace: " + std::string(127, 'a') +
+                          "  3\n") != std::string::npos);
+
+    /* Frames past the depth limit are counted, and the last one is kept. */
+    g_output.clear();
+    state = RunTest(ZZT_TESTINFO(metatest, scoped_trace_deep));
+    REQUIRE(state.failed == 2);
+    auto deepest = g_output.find("Failure\nScoped trace: depth 7\n");
+    REQUIRE(deepest != std::string::npos);
+    REQUIRE(g_output.find("Failure\nScoped trace: depth 7\n", deepest + 1) !=
+            std::string::npos);
+    REQUIRE(g_output.find("depth 8") == std::string::npos);
+
+    g_output.clear();
+    state = RunTest(ZZT_TESTINFO(metatest, testtrue));
+    REQUIRE(g_output.find("Scoped trace") == std::string::npos);
+}
+
+/******************************************************************************/
+
+/* Conversions zztest formats itself with ZZTEST_CONFIG_BUILTIN_FORMAT. */
+#define FORMAT_CASES(X) \
+    X("%d|%i|%u|%d", -7, 123, 4000000000u, 0) \
+    X("[%5d|%-5d|%05d|%.3d|%8.3d]", 42, -42, 42, 7, -7) \
+    X("%x|%X|%#x|%#X|%o|%08x", 0xbeefu, 0xbeefu, 255u, 255u, 8u, 0xabu) \
+    X("%ld|%lu|%lld|%llu", -123456789L, 4000000000UL, -9000000000000LL, \
+        18000000000000000000ULL) \
+    X("%zu|%hd|%hhu|%*d|%-*d|", (size_t)99, -5, 200, 6, 33, 4, 9) \
+    X("%c|%3c|%-3c|", 'a', 'b', 'c') \
+    X("%s|%.2s|%6s|%-6s|%.*s|", "abc", "abc", "abc", "abc", 1, "xyz") \
+    X("%f|%.2f|%.0f|%8.3f|%-8.1f|%.1f", 1.5, -0.125, 2.5, 3.14159, 0.25, \
+        2.25) \
+    X("%%|%5s%%|%p", "x", (void *)0x1234)
+
+#define FORMAT_TRACE(...) \
+    { \
+        SCOPED_TRACE(__VA_ARGS__); \
+        ADD_FAILURE(); \
+    }
+
+TEST(metatest, format)
+{
+    FORMAT_CASES(FORMAT_TRACE)
+}
+
+TEST_CASE("Format")
+{
+    char buf[256];
+    g_output.clear();
+    auto state = RunTest(ZZT_TESTINFO(metatest, format));
+    REQUIRE(state.failed == 9);
+
+#define FORMAT_EXPECT(...) \
+    snprintf(buf, sizeof(buf), __VA_ARGS__); \
+    REQUIRE(g_output.find("Scoped trace: " + std::string(buf) + "\n") != \
+            std::string::npos);
+
+    FORMAT_CASES(FORMAT_EXPECT)
+#undef FORMAT_EXPECT
+}
+
+/******************************************************************************/
+
+PROPERTY(metatest, prop_pass)
+{
+    ZZT_INTMAX a = GEN_INT(-1000, 1000);
+    ZZT_INTMAX b = GEN_INT(-1000, 1000);
+    EXPECT_INTEQ(a + b, b + a);
+}
+
+PROPERTY(metatest, prop_int)
+{
+    EXPECT_INTLT(GEN_INT(-100000, 100000), 101);
+}
+
+PROPERTY(metatest, prop_str)
+{
+    EXPECT_UINTLT(strlen(GEN_STR(0, 32)), 3);
+}
+
+PROPERTY(metatest, prop_flaky)
+{
+    static int s_calls;
+    (void)GEN_INT(-1000, 1000);
+    EXPECT_INTNE(++s_calls, 1);
+}
+
+TEST_CASE("PROPERTY")
+{
+    g_output.clear();
+    auto state = RunTest(ZZT_TESTINFO(metatest, prop_pass));
+    REQUIRE(state.passed == 1);
+    REQUIRE(state.failed == 0);
+    REQUIRE(g_output.empty());
+
+    state = RunTest(ZZT_TESTINFO(metatest, prop_int));
+    REQUIRE(state.failed == 1);
+    REQUIRE(g_output.find("Property falsified") != std::string::npos);
+    REQUIRE(g_output.find("  #0 = 101\n") != std::string::npos);
+
+    g_output.clear();
+    state = RunTest(ZZT_TESTINFO(metatest, prop_str));
+    REQUIRE(state.failed == 1);
+    REQUIRE(g_output.find("  #0 = \"   \"\n") != std::string::npos);
+
+    g_output.clear();
+    state = RunTest(ZZT_TESTINFO(metatest, prop_flaky));
+    REQUIRE(state.failed == 1);
+    REQUIRE(g_output.find("property is nondeterministic") != std::string::npos);
+}
+
+/******************************************************************************/
+
+FUZZ_TEST(metatest, fuzz)
+{
+    EXPECT_UINTLT(size, 4);
+    if (size > 0) {
+        EXPECT_CHARNE(data[0], '!');
+    }
+}
+
+TEST_CASE("FUZZ_TEST")
+{
+    auto state = RunTest(ZZT_TESTINFO(metatest, fuzz));
+    REQUIRE(state.passed == 1);
+    REQUIRE(state.failed == 0);
+
+#if defined(__unix__) || defined(__APPLE__)
+    char root[] = "/tmp/zztestXXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+    std::string dir = std::string(root) + "/metatest.fuzz";
+    REQUIRE(mkdir(dir.c_str(), 0700) == 0);
+
+    const char *inputs[] = {"ok", "toolong", "!"};
+    for (const char *input : inputs) {
+        FILE *file = fopen((dir + "/" + input).c_str(), "wb");
+        REQUIRE(file != nullptr);
+        fputs(input, file);
+        fclose(file);
+    }
+
+    g_output.clear();
+    setenv("ZZTEST_FUZZ_CORPUS", root, 1);
+    state = RunTest(ZZT_TESTINFO(metatest, fuzz));
+    REQUIRE(state.passed == 5);
+    REQUIRE(state.failed == 2);
+    REQUIRE(g_output.find("Scoped trace: Corpus input: " + dir + "/toolong") !=
+            std::string::npos);
+
+    for (const char *input : inputs) {
+        remove((dir + "/" + input).c_str());
+    }
+    rmdir(dir.c_str());
+    rmdir(root);
+    unsetenv("ZZTEST_FUZZ_CORPUS");
+#endif
+}
+
+/******************************************************************************/
+
+#if defined(ZZT_HAS_DEATH_TEST)
+
+static void
+Die(const char *msg)
+{
+    fputs(msg, stderr);
+    abort();
+}
+
+TEST(metatest, death)
+{
+    EXPECT_DEATH(Die("invariant violated"), "invariant");
+    EXPECT_DEATH(Die("invariant violated"), "^nope$");
+    EXPECT_DEATH((void)0, NULL);
+    EXPECT_EXIT(_exit(3), ZZT_EXITED_WITH(3), NULL);
+    EXPECT_EXIT(_exit(3), ZZT_EXITED_WITH(4), NULL);
+    EXPECT_EXIT(raise(SIGTERM), ZZT_KILLED_BY(SIGTERM), NULL);
+    ASSERT_EXIT(_exit(0), ZZT_EXITED_WITH(0), NULL);
+    ASSERT_DEATH((void)0, NULL);
+    EXPECT_DEATH(Die("unreachable"), NULL);
+}
+
+TEST(metatest, death_timeout)
+{
+    EXPECT_DEATH(for (;;) pause(), NULL);
+}
+
+TEST_CASE("DEATH")
+{
+    auto test = GENERATE( //
+        test_s{4, 4, &ZZT_TESTINFO(metatest, death)},
+        test_s{0, 1, &ZZT_TESTINFO(metatest, death_timeout)});
+
+    g_output.clear();
+    auto state = RunTest(*test.test);
+    REQUIRE(state.passed == test.passed);
+    REQUIRE(state.failed == test.failed);
+    if (test.test == &ZZT_TESTINFO(metatest, death_timeout)) {
+        REQUIRE(g_output.find("killed") != std::string::npos);
+    }
+}
+
+#endif
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_ASYNC)
+
+static int g_asyncPipe[2];
+
+ASYNC_CALLBACK(AsyncRead)
+{
+    char buf[8] = {0};
+    EXPECT_INTEQ(events, ZZT_ASYNC_READ);
+    EXPECT_INTEQ(read(g_asyncPipe[0], buf, sizeof(buf)), 5);
+    EXPECT_STREQ(buf, "ping");
+    close(g_asyncPipe[0]);
+    close(g_asyncPipe[1]);
+    (void)user;
+}
+
+ASYNC_CALLBACK(AsyncWrite)
+{
+    EXPECT_INTEQ(events, 0);
+    EXPECT_INTEQ(write(g_asyncPipe[1], "ping", 5), 5);
+    ASYNC_WAIT(g_asyncPipe[0], ZZT_ASYNC_READ, AsyncRead, user);
+}
+
+ASYNC_TEST(metatest, async)
+{
+    ASSERT_INTEQ(pipe(g_asyncPipe), 0);
+    ASYNC_SLEEP(10, AsyncWrite, NULL);
+}
+
+ASYNC_CALLBACK(AsyncTimedOut)
+{
+    EXPECT_INTEQ(events, 0);
+    close(g_asyncPipe[0]);
+    close(g_asyncPipe[1]);
+    (void)user;
+}
+
+ASYNC_TEST(metatest, async_timeout)
+{
+    ASSERT_INTEQ(pipe(g_asyncPipe), 0);
+    ASYNC_TIMEOUT(10);
+    ASYNC_WAIT(g_asyncPipe[0], ZZT_ASYNC_READ, AsyncTimedOut, NULL);
+}
+
+TEST_CASE("ASYNC_TEST")
+{
+    auto test = GENERATE( //
+        test_s{6, 0, &ZZT_TESTINFO(metatest, async)},
+        test_s{2, 1, &ZZT_TESTINFO(metatest, async_timeout)});
+
+    auto state = RunTest(*test.test);
+    REQUIRE(state.passed == test.passed);
+    REQUIRE(state.failed == test.failed);
+}
+
+#endif
+
+/******************************************************************************/
+
+#if defined(__unix__) || defined(__APPLE__)
+
+TEST(cache, pass)
+{
+    EXPECT_TRUE(true);
+}
+
+TEST(cache, fail)
+{
+    EXPECT_TRUE(false);
+}
+
+SUITE(cache)
+{
+    SUITE_TEST(cache, pass);
+    SUITE_TEST(cache, fail);
+}
+
+TEST_CASE("--cache")
+{
+    char root[] = "/tmp/zztestXXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+    std::string path = std::string(root) + "/cache";
+    std::string arg = "--cache=" + path;
+
+    auto run = RunArgs({arg.c_str()}, [] { ADD_TEST_SUITE(cache); });
+    REQUIRE(run.status == 1);
+    REQUIRE(run.output.find("[ RUN      ] cache.pass\n") != std::string::npos);
+    REQUIRE(run.output.find("CACHED") == std::string::npos);
+
+    /* Only the test that passed is skipped the second time. */
+    run = RunArgs({arg.c_str()}, [] { ADD_TEST_SUITE(cache); });
+    REQUIRE(run.status == 1);
+    REQUIRE(run.output.find("[   CACHED ] cache.pass\n") != std::string::npos);
+    REQUIRE(run.output.find("[ RUN      ] cache.pass\n") == std::string::npos);
+    REQUIRE(run.output.find("[ RUN      ] cache.fail\n") != std::string::npos);
+    REQUIRE(run.output.find(
+                "[   CACHED ] 1 tests passed in an earlier run.\n") !=
+            std::string::npos);
+
+    remove(path.c_str());
+    rmdir(root);
+}
+
+TEST(log, first)
+{
+    EXPECT_TRUE(true);
+}
+
+TEST(log, second)
+{
+    EXPECT_TRUE(true);
+}
+
+TEST(log, third)
+{
+    EXPECT_TRUE(true);
+}
+
+SUITE(log)
+{
+    SUITE_TEST(log, first);
+    SUITE_TEST(log, second);
+    SUITE_TEST(log, third);
+}
+
+TEST_CASE("--log")
+{
+    char root[] = "/tmp/zztestXXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+    std::string path = std::string(root) + "/log";
+    std::string arg = "--log=" + path;
+
+    auto run = RunArgs({arg.c_str()}, [] { ADD_TEST_SUITE(log); });
+    REQUIRE(run.status == 0);
+
+    zzt_log_header_s header;
+    zzt_log_record_s records[3];
+    FILE *file = fopen(path.c_str(), "rb");
+    REQUIRE(file != nullptr);
+    REQUIRE(fread(&header, sizeof(header), 1, file) == 1);
+    REQUIRE(fread(records, sizeof(records[0]), 3, file) == 3);
+    fclose(file);
+    REQUIRE(memcmp(header.magic, ZZT_LOG_MAGIC, sizeof(ZZT_LOG_MAGIC)) == 0);
+    REQUIRE(header.capacity == 3);
+    REQUIRE(header.count == 3);
+    REQUIRE(records[0].status == ZZT_STATUS_PASSED);
+    REQUIRE(records[0].passed == 1);
+    REQUIRE(std::string(records[0].name) == "log.first");
+    REQUIRE(std::string(records[2].name) == "log.third");
+
+    /* A count far past the records in the file must not be trusted. */
+    header.count = header.capacity = (unsigned long)-1;
+    file = fopen(path.c_str(), "wb");
+    REQUIRE(file != nullptr);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(records, sizeof(records[0]), 1, file);
+    fclose(file);
+
+    run = RunArgs({"--resume", arg.c_str()}, [] { ADD_TEST_SUITE(log); });
+    REQUIRE(run.status == 0);
+    REQUIRE(run.output.find("[       OK ] log.first (earlier run)\n") !=
+            std::string::npos);
+    REQUIRE(run.output.find("[ RUN      ] log.second\n") != std::string::npos);
+    REQUIRE(run.output.find("[ RUN      ] log.third\n") != std::string::npos);
+
+    remove(path.c_str());
+    rmdir(root);
+}
+
+TEST_CASE("--resume")
+{
+    char root[] = "/tmp/zztestXXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+    std::string path = std::string(root) + "/log";
+    std::string arg = "--log=" + path;
+
+    auto run = RunArgs({arg.c_str()}, [] { ADD_TEST_SUITE(log); });
+    REQUIRE(run.status == 0);
+
+    /* Leave the log as if the runner died in log.second. */
+    zzt_log_header_s header;
+    zzt_log_record_s records[3];
+    FILE *file = fopen(path.c_str(), "r+b");
+    REQUIRE(file != nullptr);
+    REQUIRE(fread(&header, sizeof(header), 1, file) == 1);
+    REQUIRE(fread(records, sizeof(records[0]), 3, file) == 3);
+    header.count = 2;
+    records[1].status = ZZT_STATUS_RUNNING;
+    memset(&records[2], 0, sizeof(records[2]));
+    rewind(file);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(records, sizeof(records[0]), 3, file);
+    fclose(file);
+
+    run = RunArgs({"--resume", arg.c_str()}, [] { ADD_TEST_SUITE(log); });
+    REQUIRE(run.status == 1);
+    REQUIRE(run.output.find("[       OK ] log.first (earlier run)\n") !=
+            std::string::npos);
+    REQUIRE(run.output.find("log.second: error: Crashed in an earlier run\n") !=
+            std::string::npos);
+    REQUIRE(run.output.find("[  FAILED  ] log.second (earlier run)\n") !=
+            std::string::npos);
+    REQUIRE(run.output.find("[ RUN      ] log.first\n") == std::string::npos);
+    REQUIRE(run.output.find("[ RUN      ] log.second\n") == std::string::npos);
+    REQUIRE(run.output.find("[ RUN      ] log.third\n") != std::string::npos);
+    REQUIRE(run.output.find(" 2 tests finished in an earlier run.\n") !=
+            std::string::npos);
+
+    /* The resumed run finished, so resuming again starts over. */
+    run = RunArgs({"--resume", arg.c_str()}, [] { ADD_TEST_SUITE(log); });
+    REQUIRE(run.status == 0);
+    REQUIRE(run.output.find("(earlier run)") == std::string::npos);
+
+    remove(path.c_str());
+    rmdir(root);
+}
+
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
+
+TEST(timing, quick)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
+
+TEST(timing, medium)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+TEST(timing, slow)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+}
+
+SUITE(timing)
+{
+    SUITE_TEST(timing, quick);
+    SUITE_TEST(timing, medium);
+    SUITE_TEST(timing, slow);
+}
+
+TEST_CASE("--slowest")
+{
+    auto run = RunArgs({"--slowest=2"}, [] { ADD_TEST_SUITE(timing); });
+    REQUIRE(run.status == 0);
+    REQUIRE(run.output.find("[     SLOW ] 2 slowest tests, of ") !=
+            std::string::npos);
+    auto slow = run.output.find("%  timing.slow\n");
+    auto medium = run.output.find("%  timing.medium\n");
+    REQUIRE(slow != std::string::npos);
+    REQUIRE(medium != std::string::npos);
+    REQUIRE(slow < medium);
+    REQUIRE(run.output.find("%  timing.quick\n") == std::string::npos);
+    REQUIRE(run.output.find("[     SLOW ] Time by suite:\n") !=
+            std::string::npos);
+
+    /* Asking for more than there are lists them all. */
+    run = RunArgs({"--slowest=1000000"}, [] { ADD_TEST_SUITE(timing); });
+    REQUIRE(run.status == 0);
+    REQUIRE(run.output.find("[     SLOW ] 3 slowest tests, of ") !=
+            std::string::npos);
+    REQUIRE(run.output.find("%  timing.quick\n") != std::string::npos);
+}
+
+TEST_CASE("--warn-ms and --fail-ms")
+{
+    auto run = RunArgs({"--warn-ms=30", "--fail-ms=100"},
+        [] { ADD_TEST_SUITE(timing); });
+    REQUIRE(run.status == 1);
+    REQUIRE(run.output.find("timing.quick: ") == std::string::npos);
+    REQUIRE(run.output.find("timing.medium: warning: Took ") !=
+            std::string::npos);
+    REQUIRE(run.output.find("[       OK ] timing.medium") != std::string::npos);
+    REQUIRE(run.output.find("timing.slow: error: Took ") != std::string::npos);
+    REQUIRE(run.output.find(" ms, over the budget of 100 ms\n") !=
+            std::string::npos);
+    REQUIRE(run.output.find("[  FAILED  ] timing.slow") != std::string::npos);
+}
+
+TEST(timing_budget, sleep)
+{
+    EXPECT_FASTER_THAN(
+        std::this_thread::sleep_for(std::chrono::milliseconds(20)), 10000, 1);
+}
+
+SUITE(timing_budget)
+{
+    SUITE_TEST(timing_budget, sleep);
+}
+
+TEST_CASE("--time-scale")
+{
+    auto run = RunArgs({}, [] { ADD_TEST_SUITE(timing_budget); });
+    REQUIRE(run.status == 1);
+    REQUIRE(run.output.find("to take at most 10000 us, the median") !=
+            std::string::npos);
+
+    run = RunArgs({"--time-scale=1.5"}, [] { ADD_TEST_SUITE(timing_budget); });
+    REQUIRE(run.status == 1);
+    REQUIRE(run.output.find("to take at most 15000 us (10000 us scaled by "
+                            "1.500), the median") != std::string::npos);
+
+    run = RunArgs({"--time-scale=10"}, [] { ADD_TEST_SUITE(timing_budget); });
+    REQUIRE(run.status == 0);
+
+    /* The environment applies without the option, and scales --warn-ms. */
+    run = RunArgs({"--warn-ms=40"}, [] {
+        setenv("ZZTEST_TIME_SCALE", "2.5", 1);
+        ADD_TEST_SUITE(timing);
+    });
+    REQUIRE(run.status == 0);
+    REQUIRE(run.output.find("timing.medium: warning: Took ") ==
+            std::string::npos);
+    REQUIRE(
+        run.output.find("timing.slow: warning: Took ") != std::string::npos);
+    REQUIRE(run.output.find(" ms, over the budget of 100 ms\n") !=
+            std::string::npos);
+}
+
+#endif
+
+#endif
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_SELECT)
+
+/* Code under test, exported so the runner can name it. */
 extern "C" int
-metatest_printf(...)
+SelectAdd(int l, int r)
+{
+    return l + r;
+}
+
+extern "C" int
+SelectMul(int l, int r)
+{
+    return l * r;
+}
+
+TEST(select, add)
 {
-    return 0;
+    EXPECT_INTEQ(SelectAdd(2, 3), 5);
+}
+
+TEST(select, mul)
+{
+    EXPECT_INTEQ(SelectMul(2, 3), 6);
+}
+
+TEST(select_new, fresh)
+{
+    EXPECT_TRUE(true);
+}
+
+SUITE(select)
+{
+    SUITE_TEST(select, add);
+    SUITE_TEST(select, mul);
+}
+
+SUITE(select_new)
+{
+    SUITE_TEST(select_new, fresh);
+}
+
+TEST_CASE("--changed")
+{
+    char root[] = "/tmp/zztestXXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+    std::string map = std::string("--map=") + root + "/map";
+    std::string changed = std::string(root) + "/changed.txt";
+
+    auto run =
+        RunArgs({"--record", map.c_str()}, [] { ADD_TEST_SUITE(select); });
+    REQUIRE(run.status == 0);
+
+    FILE *file = fopen(changed.c_str(), "w");
+    REQUIRE(file != nullptr);
+    fputs("SelectAdd\n", file);
+    fclose(file);
+
+    /* select.mul didn't enter SelectAdd, and select_new.fresh is new. */
+    std::string arg = "--changed=" + changed;
+    run = RunArgs({arg.c_str(), map.c_str()}, [] {
+        ADD_TEST_SUITE(select);
+        ADD_TEST_SUITE(select_new);
+    });
+    REQUIRE(run.status == 0);
+    REQUIRE(run.output.find("Selected 2 of 3 tests") != std::string::npos);
+    REQUIRE(run.output.find("[ RUN      ] select.add\n") != std::string::npos);
+    REQUIRE(run.output.find("[ RUN      ] select_new.fresh\n") !=
+            std::string::npos);
+    REQUIRE(run.output.find("select.mul") == std::string::npos);
+
+    remove(changed.c_str());
+    remove((std::string(root) + "/map").c_str());
+    rmdir(root);
+}
+
+#endif
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_PERF) && defined(__linux__)
+
+TEST(perf, counted)
+{
+    EXPECT_TRUE(true);
+}
+
+SUITE(perf)
+{
+    SUITE_TEST(perf, counted);
+}
+
+TEST_CASE("Performance counters unavailable")
+{
+    auto run = RunArgs({}, [] {
+        /* Use up every descriptor, so perf_event_open fails. */
+        int fd = dup(0);
+        struct rlimit limit;
+        getrlimit(RLIMIT_NOFILE, &limit);
+        limit.rlim_cur = fd > 0 ? (rlim_t)fd : 0;
+        close(fd);
+        setrlimit(RLIMIT_NOFILE, &limit);
+        ADD_TEST_SUITE(perf);
+    });
+    REQUIRE(run.status == 0);
+    REQUIRE(run.output.find("[     PERF ] Hardware counters are "
+                            "unavailable.\n") != std::string::npos);
+    REQUIRE(run.output.find("[     PERF ] perf.counted") == std::string::npos);
+    REQUIRE(run.output.find("[       OK ] perf.counted") != std::string::npos);
+}
+
+#endif
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+static std::atomic<int> g_jobsRunning, g_jobsMost, g_jobsDb;
+
+static void
+JobsBusy(int ms)
+{
+    int running = ++g_jobsRunning;
+    int most = g_jobsMost;
+    while (running > most && !g_jobsMost.compare_exchange_weak(most, running))
+        ;
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    --g_jobsRunning;
+}
+
+TEST(jobs, slow)
+{
+    JobsBusy(100);
+}
+
+#define JOBS_QUICK(t) \
+    TEST(jobs, t) \
+    { \
+        for (int i = 0; i < 10; i++) { \
+            JobsBusy(2); \
+        } \
+    }
+
+JOBS_QUICK(quick_1)
+JOBS_QUICK(quick_2)
+JOBS_QUICK(quick_3)
+JOBS_QUICK(quick_4)
+JOBS_QUICK(quick_5)
+JOBS_QUICK(quick_6)
+
+TEST(jobs, locked_a)
+{
+    EXPECT_INTEQ(++g_jobsDb, 1);
+    JobsBusy(20);
+    --g_jobsDb;
+}
+
+TEST(jobs, locked_b)
+{
+    EXPECT_INTEQ(++g_jobsDb, 1);
+    JobsBusy(20);
+    --g_jobsDb;
+}
+
+TEST(jobs, serial)
+{
+    EXPECT_INTEQ(g_jobsRunning, 0);
+}
+
+TEST(jobs, allocate)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+    while (std::chrono::steady_clock::now() < end) {
+        free(malloc(64));
+    }
+}
+
+TEST(jobs, no_allocations)
+{
+    static volatile unsigned long s_spin;
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+    while (std::chrono::steady_clock::now() < end) {
+        ASSERT_NO_ALLOCATIONS(for (int i = 0; i < 1000; i++) s_spin += 1);
+    }
+}
+
+#if defined(ZZT_HAS_DEATH_TEST)
+
+TEST(jobs, death)
+{
+    /* Each child fails, taking locks the other workers use. */
+    for (int i = 0; i < 20; i++) {
+        ASSERT_DEATH(
+            {
+                ADD_FAILURE();
+                abort();
+            },
+            NULL);
+    }
+}
+
+#endif
+
+SUITE(jobs)
+{
+    SUITE_TEST(jobs, slow);
+    SUITE_TEST(jobs, quick_1);
+    SUITE_TEST(jobs, quick_2);
+    SUITE_TEST(jobs, quick_3);
+    SUITE_TEST(jobs, quick_4);
+    SUITE_TEST(jobs, quick_5);
+    SUITE_TEST(jobs, quick_6);
+    SUITE_TEST(jobs, locked_a);
+    SUITE_TEST(jobs, locked_b);
+    TEST_LOCK(jobs, locked_a, "db");
+    TEST_LOCK(jobs, locked_b, "db");
+    SUITE_TEST(jobs, serial);
+    TEST_SERIAL(jobs, serial);
+    SUITE_TEST(jobs, allocate);
+    SUITE_TEST(jobs, no_allocations);
+#if defined(ZZT_HAS_DEATH_TEST)
+    SUITE_TEST(jobs, death);
+#endif
+}
+
+TEST_CASE("--jobs")
+{
+    auto run = RunArgs({"--jobs=4", "--pin-cpus"}, [] { ADD_TEST_SUITE(jobs); },
+        [] {
+            metatest_printf("%s, %d still running\n",
+                g_jobsMost >= 2 ? "Overlapped" : "Serial",
+                g_jobsRunning.load());
+        });
+    REQUIRE(run.status == 0);
+    REQUIRE(run.output.find("Overlapped, 0 still running\n") !=
+            std::string::npos);
+    REQUIRE(run.output.find("on 4 workers") != std::string::npos);
+
+    /* Worker 0 is dealt the slow test, and the others take its rest. */
+    bool stolen = false;
+    for (auto at = run.output.find(" stolen"); at != std::string::npos;
+         at = run.output.find(" stolen", at + 1)) {
+        stolen |= run.output.compare(at - 2, 2, " 0") != 0;
+    }
+    REQUIRE(stolen);
+    REQUIRE((run.output.find("Worker 0 on CPU") != std::string::npos ||
+             run.output.find("not pinning") != std::string::npos));
+}
+
+#endif
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_BENCH)
+
+BENCH(metatest, bench)
+{
+    unsigned long iters = 0, x = 0;
+    while (BENCH_LOOP()) {
+        iters += 1;
+        x += 3;
+        ZZT_DO_NOT_OPTIMIZE(x);
+    }
+    ZZT_CLOBBER_MEMORY();
+    EXPECT_UINTEQ(x, iters * 3);
+    EXPECT_FALSE(BENCH_LOOP());
+}
+
+BENCH(metatest, bench_fail)
+{
+    while (BENCH_LOOP()) {
+        ASSERT_TRUE(false);
+    }
+}
+
+BENCH_RANGE(metatest, bench_range, 1, 5)
+{
+    EXPECT_TRUE(BENCH_SIZE() == 1 || BENCH_SIZE() == 2 ||
+                BENCH_SIZE() == 4 || BENCH_SIZE() == 5);
+    BENCH_BYTES(BENCH_SIZE());
+    while (BENCH_LOOP()) {
+    }
+}
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+BENCH_THREADS(metatest, bench_threads_leave, 4)
+{
+    unsigned long iters = 0;
+    while (BENCH_LOOP()) {
+        /* The others are still in the batch thread 1 leaves. */
+        if (BENCH_THREAD() != 1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        iters += 1;
+        ASSERT_TRUE(BENCH_THREAD() != 1 || iters < 5);
+    }
+}
+
+#endif
+
+TEST_CASE("BENCH")
+{
+    auto test = GENERATE( //
+        test_s{2, 0, &ZZT_TESTINFO(metatest, bench)},
+        test_s{0, 1, &ZZT_TESTINFO(metatest, bench_fail)},
+        test_s{4, 0, &ZZT_TESTINFO(metatest, bench_range)});
+
+    auto state = RunTest(*test.test);
+    REQUIRE(state.passed == test.passed);
+    REQUIRE(state.failed == test.failed);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+BENCH(bench, loop)
+{
+    while (BENCH_LOOP()) {
+    }
+}
+
+BENCH_RANGE(bench, sizes, 1, 5)
+{
+    BENCH_BYTES(BENCH_SIZE());
+    while (BENCH_LOOP()) {
+    }
+}
+
+SUITE(bench)
+{
+    SUITE_TEST(bench, loop);
+    SUITE_TEST(bench, sizes);
+}
+
+TEST_CASE("--bench-out")
+{
+    char root[] = "/tmp/zztestXXXXXX";
+    REQUIRE(mkdtemp(root) != nullptr);
+    std::string path = std::string(root) + "/bench.json";
+    std::string arg = "--bench-out=" + path;
+
+    auto run = RunArgs({arg.c_str()}, [] { ADD_TEST_SUITE(bench); });
+    REQUIRE(run.status == 0);
+
+    /* zztbench reads one object per line, without a JSON parser. */
+    std::vector<std::string> lines;
+    char line[4096];
+    FILE *file = fopen(path.c_str(), "r");
+    REQUIRE(file != nullptr);
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (strstr(line, "{\"name\": ") != nullptr) {
+            lines.push_back(line);
+        }
+    }
+    fclose(file);
+
+    REQUIRE(lines.size() == 5);
+    REQUIRE(lines[0].find("{\"name\": \"bench.loop\", \"size\": 0,") !=
+            std::string::npos);
+    REQUIRE(lines[3].find("{\"name\": \"bench.sizes\", \"size\": 4,") !=
+            std::string::npos);
+    for (const auto &object : lines) {
+        REQUIRE(object.find("\"mean_ns\": ") != std::string::npos);
+        REQUIRE(object.find("\"stddev_ns\": ") != std::string::npos);
+        REQUIRE(object.find("\"samples\": ") != std::string::npos);
+        REQUIRE(object.find("\"samples\": 0,") == std::string::npos);
+        REQUIRE(object.back() == '\n');
+    }
+
+    remove(path.c_str());
+    rmdir(root);
+}
+
+#endif
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+TEST_CASE("BENCH_THREADS")
+{
+    g_output.clear();
+    auto state = RunTest(ZZT_TESTINFO(metatest, bench_threads_leave));
+    REQUIRE(state.failed == 1);
+    REQUIRE(g_output.find("threads") != std::string::npos);
+}
+
+#endif
+
+#endif
+
+extern "C" int
+metatest_printf(const char *fmt, ...)
+{
+    char buf[1024];
+    va_list va;
+
+    va_start(va, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, va);
+    va_end(va);
+
+    g_output += buf;
+    return len;
 }
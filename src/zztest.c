@@ -7,29 +7,177 @@
  * http://www.boost.org/LICENSE_1_0.txt)
  */
 
+/*
+ * syscall() for performance counters, dladdr() for test selection and
+ * sched_setaffinity() for --pin-cpus, unless it would widen ZZT_INTMAX past
+ * what strict C89 code including zztest.h sees.  syscall() and dladdr()
+ * are declared below in that case.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE) && \
+    (defined(ZZTEST_CONFIG_PERF) || defined(ZZTEST_CONFIG_SELECT) || \
+        defined(ZZTEST_CONFIG_THREADS)) && \
+    (!defined(__STRICT_ANSI__) || defined(__STDC_VERSION__))
+#define _GNU_SOURCE
+#endif
+
+/* kill() to time out death tests under strict C modes. */
+#if (defined(__unix__) || defined(__APPLE__)) && \
+    defined(__STRICT_ANSI__) && !defined(_GNU_SOURCE) && \
+    !defined(_POSIX_C_SOURCE) && !defined(ZZTEST_CONFIG_NO_DEATH_TEST)
+#define _POSIX_C_SOURCE 1
+#endif
+
 #include "zztest.h"
 
 #if defined(_MSC_VER)
 #define _CRT_SECURE_NO_WARNINGS /* Say the line, Bart! */
 #endif
 
+#if defined(ZZTEST_CONFIG_PRINTF) && \
+    (defined(ZZTEST_CONFIG_WIRE) || defined(ZZTEST_CONFIG_TRANSPORT))
+#error "ZZTEST_CONFIG_PRINTF replaces the output of wire and transport builds"
+#endif
+
+#if defined(ZZTEST_CONFIG_ASYNC) && \
+    (defined(ZZTEST_CONFIG_NO_TIMING) || \
+        !(defined(__unix__) || defined(__APPLE__)))
+#error "ZZTEST_CONFIG_ASYNC needs poll() and a millisecond timer"
+#endif
+
+#if defined(ZZTEST_CONFIG_BENCH) && defined(ZZTEST_CONFIG_NO_TIMING)
+#error "ZZTEST_CONFIG_BENCH needs the timer"
+#endif
+
 #if defined(ZZTEST_CONFIG_PRINTF)
 #define ZZT_PRINTF ZZTEST_CONFIG_PRINTF
+#elif defined(ZZTEST_CONFIG_WIRE)
+#define ZZT_PRINTF zzt_wire_printf
+static int
+zzt_wire_printf(const char *fmt, ...);
+static void
+zzt_wire_flush(void);
+#elif defined(ZZTEST_CONFIG_TRANSPORT)
+#define ZZT_PRINTF zzt_transport_printf
+#elif defined(ZZTEST_CONFIG_BUILTIN_FORMAT)
+#define ZZT_PRINTF zzt_printf
 #else
 #define ZZT_PRINTF printf
 #endif
 
 #if defined(_WIN32)
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
 #pragma comment(lib, "WinMM.Lib") /* Timer functions */
+#endif
 #include <Windows.h>
-#elif defined(__unix__)
+#if defined(ZZTEST_CONFIG_WIRE)
+#include <fcntl.h> /* Binary stdout */
+#include <io.h>
+#endif
+#elif (defined(__unix__) || defined(__APPLE__)) && \
+    !defined(ZZTEST_CONFIG_NO_TIMING)
 #include <sys/time.h> /* Timer functions. */
 static struct timeval g_cTimeStart;
 #endif
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h> /* clock_gettime, benchmark results date */
+
+#if defined(ZZTEST_CONFIG_ALLOC) && defined(__GLIBC__) && \
+    !defined(ZZTEST_CONFIG_ALLOC_NO_INTERPOSE)
+#define ZZT_ALLOC_INTERPOSE_
+#include <malloc.h> /* malloc_usable_size */
+#endif
+
+#if defined(ZZTEST_CONFIG_THREADS)
+#if defined(_WIN32)
+typedef SRWLOCK zzt_mutex_t;
+#define ZZT_MUTEX_INIT_ SRWLOCK_INIT
+#define ZZT_LOCK_(m) AcquireSRWLockExclusive(m)
+#define ZZT_UNLOCK_(m) ReleaseSRWLockExclusive(m)
+#define ZZT_MUTEX_CREATE_(m) InitializeSRWLock(m)
+#define ZZT_MUTEX_DESTROY_(m) ((void)0)
+#define ZZT_ATOMIC_ADD_(p, v) \
+    (InterlockedExchangeAdd((volatile LONG *)(p), (LONG)(v)) + (LONG)(v))
+#define ZZT_ATOMIC_CAS_(p, o, n) \
+    InterlockedCompareExchange((volatile LONG *)(p), (LONG)(n), (LONG)(o))
+#else
+#include <pthread.h>
+#include <sched.h> /* sched_yield, worker pinning */
+typedef pthread_mutex_t zzt_mutex_t;
+#define ZZT_MUTEX_INIT_ PTHREAD_MUTEX_INITIALIZER
+#define ZZT_LOCK_(m) pthread_mutex_lock(m)
+#define ZZT_UNLOCK_(m) pthread_mutex_unlock(m)
+#define ZZT_MUTEX_CREATE_(m) pthread_mutex_init(m, NULL)
+#define ZZT_MUTEX_DESTROY_(m) pthread_mutex_destroy(m)
+#define ZZT_ATOMIC_ADD_(p, v) __sync_add_and_fetch((p), (v))
+#define ZZT_ATOMIC_CAS_(p, o, n) __sync_val_compare_and_swap((p), (o), (n))
+#endif
+#if defined(_MSC_VER)
+#define ZZT_TLS_ __declspec(thread)
+#else
+#define ZZT_TLS_ __thread
+#endif
+#else
+#define ZZT_LOCK_(m) ((void)0)
+#define ZZT_UNLOCK_(m) ((void)0)
+#define ZZT_ATOMIC_ADD_(p, v) (*(p) += (v))
+#define ZZT_TLS_
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ZZT_DIRENT_
+#include <dirent.h> /* Fuzz corpus replay */
+#include <sys/stat.h>
+#define ZZT_MMAP_
+#include <fcntl.h> /* Results log */
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(ZZTEST_CONFIG_TRANSPORT) || defined(ZZTEST_CONFIG_ASYNC)
+#include <poll.h> /* Stand-in transport, async tests */
+#endif
+#if defined(ZZTEST_CONFIG_ASYNC) && defined(__linux__)
+#define ZZT_EPOLL_
+#include <sys/epoll.h>
+#endif
+#endif
+
+#if defined(ZZTEST_CONFIG_SELECT)
+#include <dlfcn.h> /* dladdr */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+typedef struct {
+    const char *dli_fname;
+    void *dli_fbase;
+    const char *dli_sname;
+    void *dli_saddr;
+} Dl_info;
+extern int
+dladdr(const void *addr, Dl_info *info);
+#endif
+#endif
+
+#if defined(ZZT_HAS_DEATH_TEST)
+#include <poll.h> /* Death test timeout */
+#include <regex.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if defined(ZZTEST_CONFIG_PERF) && defined(__linux__)
+#define ZZT_PERF_
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if !defined(_GNU_SOURCE)
+extern long
+syscall(long number, ...);
+#endif
+#endif
 
 #define ZZTLOG_H1 "[==========]"
 #define ZZTLOG_H2 "[----------]"
@@ -38,6 +186,10 @@ static struct timeval g_cTimeStart;
 #define ZZTLOG_SKIPPED "[  SKIPPED ]"
 #define ZZTLOG_FAILED "[  FAILED  ]"
 #define ZZTLOG_PASSED "[  PASSED  ]"
+#define ZZTLOG_PERF "[     PERF ]"
+#define ZZTLOG_CACHED "[   CACHED ]"
+#define ZZTLOG_BENCH "[    BENCH ]"
+#define ZZTLOG_SLOW "[     SLOW ]"
 
 /******************************************************************************/
 
@@ -46,9 +198,57 @@ struct zzt_test_state_s {
     int passed;
     int failed;
     int skipped;
+    const char *fail_file; /* Location of the first failure. */
+    unsigned long fail_line;
+};
+
+/* Argument types of printf conversions. */
+enum zzt_targ_e {
+    ZZT_TARG_BAD,
+    ZZT_TARG_NONE,
+    ZZT_TARG_INT,
+    ZZT_TARG_LONG,
+    ZZT_TARG_MAX,
+    ZZT_TARG_SIZE,
+    ZZT_TARG_UINT,
+    ZZT_TARG_ULONG,
+    ZZT_TARG_UMAX,
+    ZZT_TARG_USIZE,
+    ZZT_TARG_DOUBLE,
+    ZZT_TARG_LDOUBLE,
+    ZZT_TARG_STR,
+    ZZT_TARG_PTR
+};
+
+#if !defined(ZZTEST_CONFIG_NO_TRACE)
+
+#define ZZT_TRACE_DEPTH_ 8
+#define ZZT_TRACE_ARGS_ 8
+
+union zzt_trace_arg_u {
+    ZZT_INTMAX i;
+    ZZT_UINTMAX u;
+    double d;
+    const void *p;
+};
+
+/*
+ * A trace keeps its format string and a copy of its arguments, and is only
+ * formatted when a failure is printed.  Strings are copied into text, and
+ * formats we can't capture are formatted into text right away instead.
+ */
+struct zzt_trace_frame_s {
+    const char *fmt;
+    ZZT_BOOL eager;
+    union zzt_trace_arg_u args[ZZT_TRACE_ARGS_];
+    char text[128];
 };
 
-static char g_scopedTrace[128];
+static ZZT_TLS_ struct zzt_trace_frame_s g_traceFrames[ZZT_TRACE_DEPTH_];
+static ZZT_TLS_ int g_traceDepth;
+static ZZT_TLS_ int g_traceOverflow;
+
+#endif
 static const char *g_cmpStrings[] = {"==", "!=", "<", "<=", ">", ">="};
 static unsigned long g_testsCount;
 static struct zzt_test_suite_s *g_suitesHead;
@@ -56,8 +256,223 @@ static struct zzt_test_suite_s *g_suitesTail;
 static unsigned long g_suitesCount;
 static struct zzt_test_s *g_testFailHead;
 static struct zzt_test_s *g_testFailTail;
+#if !defined(ZZTEST_CONFIG_NO_SKIP_LIST)
 static struct zzt_test_s *g_testSkipHead;
 static struct zzt_test_s *g_testSkipTail;
+#endif
+
+#if defined(ZZTEST_CONFIG_THREADS)
+/* Placement of --jobs workers. */
+enum zzt_pin_e {
+    ZZT_PIN_NONE, /* Wherever the OS schedules them. */
+    ZZT_PIN_CPU,  /* One processor each. */
+    ZZT_PIN_NODE  /* The processors of one NUMA node each. */
+};
+#endif
+
+/* Command line options, see zzt_run_args. */
+struct zzt_options_s {
+    const char *argv0;
+    const char *cache; /* Result cache, <argv0>.zztcache by default. */
+    const char *log;   /* Results log, <argv0>.zztlog by default. */
+    ZZT_BOOL resume;   /* Continue from the results log. */
+#if defined(ZZTEST_CONFIG_THREADS)
+    unsigned long jobs; /* Worker threads, or 0 to run on this thread. */
+    enum zzt_pin_e pin; /* Processors each worker is kept on. */
+#endif
+#if defined(ZZTEST_CONFIG_SELECT)
+    ZZT_BOOL record;     /* Record the functions each test enters. */
+    const char *changed; /* File listing changed symbols. */
+    const char *map;     /* Test map, <argv0>.zztmap by default. */
+#endif
+#if defined(ZZTEST_CONFIG_BENCH)
+    const char *benchOut; /* Benchmark results, <argv0>.bench.json. */
+#endif
+    unsigned long slowest;   /* Slowest tests listed in the summary. */
+    unsigned long warnMs;    /* Test time that prints a warning, or 0. */
+    unsigned long failMs;    /* Test time that fails the test, or 0. */
+    unsigned long timeScale; /* Budgets are multiplied by this / 1000. */
+};
+
+static struct zzt_options_s g_options;
+
+/* Set of strings, an open addressed hash table of borrowed pointers. */
+struct zzt_names_s {
+    const char **slots;
+    unsigned long cap;
+    unsigned long count;
+};
+
+/* Results log, mapped when possible and written through stdio otherwise. */
+struct zzt_log_s {
+    struct zzt_log_header_s *header;
+    struct zzt_log_record_s *records;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#elif defined(ZZT_MMAP_)
+    int fd;
+#endif
+    FILE *stream;
+    struct zzt_log_header_s streamHeader;
+};
+
+static struct zzt_log_s g_log;
+
+/* Records from the results log of an earlier run being resumed. */
+static struct zzt_log_record_s *g_resumeRecords;
+static unsigned long *g_resumeSlots; /* Record + 1 by test index, or 0. */
+static unsigned long g_resumeRunning; /* Tests running when it crashed. */
+
+/* Tests that passed in an earlier run of this binary, and in this run. */
+static struct zzt_names_s g_cached;
+static struct zzt_names_s g_cachePassed;
+static char *g_cacheText;
+static char g_cacheKey[32];
+
+#if defined(ZZTEST_CONFIG_SELECT)
+/*
+ * The map from tests to the functions they enter.  Names point into the
+ * loaded map text, at test info, or at the dynamic linker's string tables.
+ */
+struct zzt_map_test_s {
+    const char *name;
+    unsigned long *syms;
+    unsigned long count;
+    struct zzt_map_test_s *next;
+};
+
+static char *g_mapText;
+static const char **g_mapSyms;
+static unsigned long g_mapSymsCount;
+static unsigned long *g_mapHash; /* Symbol number + 1, or 0 if empty. */
+static unsigned long g_mapHashCap;
+static unsigned char *g_mapChanged;
+static unsigned long g_mapChangedCount;
+static struct zzt_map_test_s *g_mapTests;
+
+/* Functions entered by the current test, filled by instrumentation. */
+static void *g_selectFns[ZZTEST_CONFIG_SELECT_FUNCS];
+static volatile int g_selectRecording;
+static int g_selectOverflow;
+#endif
+
+#if defined(ZZTEST_CONFIG_ALLOC)
+struct zzt_alloc_stats_s {
+    unsigned long count; /* Allocations made since program start. */
+    long blocks;         /* Allocations currently live. */
+    long bytes;          /* Bytes currently live. */
+    long peak;           /* High-water mark of live bytes. */
+};
+
+static struct zzt_alloc_stats_s g_alloc;
+#if defined(ZZTEST_CONFIG_THREADS)
+/* Allocations made by this thread, see EXPECT_NO_ALLOCATIONS. */
+static ZZT_TLS_ unsigned long g_allocThreadCount;
+/* Bytes allocated less bytes freed by this thread, see EXPECT_NO_LEAKS. */
+static ZZT_TLS_ long g_allocThreadBytes;
+#endif
+#endif
+
+#if defined(ZZT_HAS_DEATH_TEST)
+static int g_deathChildFd = -1;
+#endif
+
+/*
+ * Property tests record every random choice a property makes.  Shrinking
+ * edits the recorded choices and replays them, so every generator shrinks
+ * the same way without needing a shrinker of its own.
+ */
+struct zzt_prop_s {
+    unsigned long rng[4];
+    ZZT_UINTMAX *choices;     /* Choices made by the current run. */
+    ZZT_UINTMAX *best;        /* Smallest failing choices found. */
+    unsigned long maxChoices; /* Capacity of choices and best. */
+    unsigned long numChoices; /* Choices drawn by the current run. */
+    unsigned long replayLen;  /* Choices available to replay. */
+    unsigned char *data;      /* Scratch for generated buffers. */
+    unsigned long dataLen;
+    unsigned long dataUsed;
+    unsigned long numGens; /* Values generated by the current run. */
+    ZZT_BOOL replay;       /* Read choices instead of generating them. */
+    ZZT_BOOL report;       /* Print generated values. */
+    ZZT_BOOL overrun;      /* Ran out of arena. */
+};
+
+/* While non-zero, failures are counted but not printed. */
+static ZZT_TLS_ int g_quiet;
+
+#if defined(ZZTEST_CONFIG_FUZZER)
+static struct zzt_fuzz_target_s *g_fuzzTargets;
+static struct zzt_fuzz_target_s *g_fuzzTarget;
+static int g_fuzzing;
+#define ZZT_FUZZ_CRASH_() (g_fuzzing ? (fflush(stdout), abort()) : (void)0)
+#else
+#define ZZT_FUZZ_CRASH_() ((void)0)
+#endif
+
+#if defined(ZZTEST_CONFIG_THREADS)
+/*
+ * Each thread that touches a test's state counts into its own block, so
+ * passing assertions never contend.  Blocks live on a list so the runner
+ * can fold them into the test state once the test returns, and a thread
+ * exit hook folds the block of a thread that ends mid-test.
+ */
+struct zzt_thread_counts_s {
+    struct zzt_test_state_s *state;
+    int passed;
+    int failed;
+    int skipped;
+    const char *fail_file; /* Location of this thread's first failure. */
+    unsigned long fail_line;
+    ZZT_BOOL registered;
+    struct zzt_thread_counts_s *next;
+};
+
+static ZZT_TLS_ struct zzt_thread_counts_s g_threadCounts;
+static struct zzt_thread_counts_s *g_threadCountsHead;
+static zzt_mutex_t g_threadLock = ZZT_MUTEX_INIT_;
+static zzt_mutex_t g_printLock = ZZT_MUTEX_INIT_;
+static zzt_mutex_t g_jobsLock = ZZT_MUTEX_INIT_; /* Totals and results log. */
+#if defined(ZZTEST_CONFIG_ASYNC)
+static zzt_mutex_t g_asyncLock = ZZT_MUTEX_INIT_;
+#endif
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+static zzt_mutex_t g_transportLock = ZZT_MUTEX_INIT_;
+#endif
+#if defined(ZZTEST_CONFIG_WIRE)
+static zzt_mutex_t g_wireLock = ZZT_MUTEX_INIT_;
+#endif
+static ZZT_BOOL g_threadKeyValid;
+#if defined(_WIN32)
+static DWORD g_threadKey;
+#else
+static pthread_key_t g_threadKey;
+#endif
+
+#define ZZT_COUNT_(state, field) (zzt_thread_counts(state)->field += 1)
+#else
+#define ZZT_COUNT_(state, field) ((state)->field += 1)
+#endif
+
+#if defined(ZZT_PERF_)
+enum zzt_perf_e {
+    ZZT_PERF_CYCLES,
+    ZZT_PERF_INSTRUCTIONS,
+    ZZT_PERF_CACHE_MISSES,
+    ZZT_PERF_BRANCH_MISSES,
+    ZZT_PERF_MAX
+};
+
+static const unsigned long g_perfConfigs[] = {PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES};
+static const char *g_perfNames[] = {
+    "cycles", "instructions", "cache-misses", "branch-misses"};
+/* Counters, or -1 if not open, which includes before the run starts. */
+static int g_perfFds[ZZT_PERF_MAX] = {-1, -1, -1, -1};
+#endif
 
 /**
  * @brief Return time point with ms resolution.
@@ -68,9 +483,11 @@ static struct zzt_test_s *g_testSkipTail;
 static unsigned long
 zzt_ms(void)
 {
-#if defined(_WIN32)
+#if defined(ZZTEST_CONFIG_NO_TIMING)
+    return 0; /* Results print without times when this is zero. */
+#elif defined(_WIN32)
     return timeGetTime();
-#elif defined(__unix__)
+#elif defined(__unix__) || defined(__APPLE__)
     unsigned long ms;
     struct timeval now;
     gettimeofday(&now, NULL);
@@ -82,7 +499,433 @@ zzt_ms(void)
 #endif
 }
 
-#if defined(__GNUC__)
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
+
+/**
+ * @brief Return a time point with ns units, and the best resolution the
+ *        platform offers.  Differences are right across a wrap.
+ */
+static ZZT_UINTMAX
+zzt_ns(void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (ZZT_UINTMAX)(now.QuadPart / freq.QuadPart) * 1000000000 +
+           (ZZT_UINTMAX)(now.QuadPart % freq.QuadPart) * 1000000000 /
+               (ZZT_UINTMAX)freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (ZZT_UINTMAX)now.tv_sec * 1000000000 + (ZZT_UINTMAX)now.tv_nsec;
+#elif defined(__unix__) || defined(__APPLE__)
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (ZZT_UINTMAX)now.tv_sec * 1000000000 +
+           (ZZT_UINTMAX)now.tv_usec * 1000;
+#else
+    /* Whole seconds wrap like the other clocks, the rest fits any width. */
+    ZZT_UINTMAX ticks = (ZZT_UINTMAX)clock();
+    ZZT_UINTMAX perSec = (ZZT_UINTMAX)CLOCKS_PER_SEC;
+    return ticks / perSec * 1000000000 +
+           (ZZT_UINTMAX)((double)(ticks % perSec) * 1e9 / (double)perSec);
+#endif
+}
+
+#endif
+
+/**
+ * @brief Parse a time scale such as "2.5" into thousandths.
+ *
+ * @return Scale, or 0 if str is NULL or not a positive number.
+ */
+static unsigned long
+zzt_scale_parse(const char *str)
+{
+    double scale = str != NULL ? strtod(str, NULL) * 1000 + 0.5 : 0;
+    if (scale >= (double)ULONG_MAX) {
+        return ULONG_MAX;
+    }
+    return scale > 0.5 ? (unsigned long)scale : 0;
+}
+
+/**
+ * @brief Factor time budgets are multiplied by on slow machines, in
+ *        thousandths, from --time-scale or else ZZTEST_TIME_SCALE.
+ */
+static unsigned long
+zzt_time_scale(void)
+{
+    unsigned long scale = g_options.timeScale;
+    if (scale == 0) {
+        scale = zzt_scale_parse(getenv("ZZTEST_TIME_SCALE"));
+    }
+    return scale != 0 ? scale : 1000;
+}
+
+/**
+ * @brief Multiply a time budget by the time scale.
+ */
+static unsigned long
+zzt_scale_budget(unsigned long budget)
+{
+    double scaled = (double)budget * zzt_time_scale() / 1000 + 0.5;
+    return scaled < (double)ULONG_MAX ? (unsigned long)scaled : ULONG_MAX;
+}
+
+/* Longest line ZZT_PRINTF prints when it formats into a buffer. */
+#define ZZT_PRINT_BUFFER_ 512
+
+#if defined(ZZTEST_CONFIG_BUILTIN_FORMAT)
+
+/* Output of zzt_format, which keeps counting once the buffer is full. */
+struct zzt_format_out_s {
+    char *w;
+    char *end;
+    unsigned long len;
+};
+
+/**
+ * @brief Write a character, or count it if the buffer is full.
+ */
+static void
+zzt_format_putc(struct zzt_format_out_s *out, char c)
+{
+    if (out->w < out->end) {
+        *out->w++ = c;
+    }
+    out->len += 1;
+}
+
+/**
+ * @brief Write a character count times.
+ */
+static void
+zzt_format_pad(struct zzt_format_out_s *out, char c, long count)
+{
+    for (; count > 0; count--) {
+        zzt_format_putc(out, c);
+    }
+}
+
+/**
+ * @brief Minimal vsnprintf covering the conversions zztest and typical
+ *        scoped traces use, so printf can be left out of the binary.
+ *
+ * @details Handles %c, %s, %d, %i, %u, %o, %x, %X, %p and %% with the
+ *          '-', '0' and '#' flags, width, precision and every length modifier
+ *          up to ZZT_INTMAX.  %f is rounded to at most 9 decimals, and
+ *          other floating point conversions consume their argument and
+ *          print the conversion itself.  An unknown conversion ends
+ *          formatting, as its argument can't be skipped.
+ *
+ * @param buf Buffer to write to.
+ * @param buflen Length of buffer.
+ * @param fmt Format string.
+ * @param va Format parameters.
+ * @return Length of the full output, which was truncated if it's not less
+ *         than buflen.
+ */
+static unsigned long
+zzt_format(char *buf, unsigned long buflen, const char *fmt, va_list va)
+{
+    struct zzt_format_out_s out;
+
+    out.w = buf;
+    out.end = buflen != 0 ? buf + buflen - 1 : buf;
+    out.len = 0;
+
+    while (*fmt != '\0') {
+        char digits[24]; /* 64-bit octal is 22 digits */
+        const char *str = digits;
+        const char *start = fmt;
+        const char *prefix = "";
+        ZZT_BOOL left = ZZT_FALSE, zero = ZZT_FALSE, alt = ZZT_FALSE;
+        long width = 0, prec = -1, len = 0, fill = 0;
+        int length = 0; /* 1 = h, 2 = l, 3 = ll/j/I64, 4 = z/t, 5 = L, 6 = hh */
+        int point = -1, count = 0; /* Fraction digits of %f */
+        unsigned base = 10;
+        ZZT_UINTMAX u = 0;
+
+        if (*fmt != '%') {
+            zzt_format_putc(&out, *fmt++);
+            continue;
+        }
+
+        for (fmt += 1; *fmt != '\0' && strchr("-+ #0'", *fmt) != NULL; fmt++) {
+            left |= *fmt == '-';
+            zero |= *fmt == '0';
+            alt |= *fmt == '#';
+        }
+
+        if (*fmt == '*') {
+            width = va_arg(va, int);
+            if (width < 0) {
+                left = ZZT_TRUE;
+                width = -width;
+            }
+            fmt += 1;
+        }
+        for (; *fmt >= '0' && *fmt <= '9'; fmt++) {
+            width = width * 10 + (*fmt - '0');
+        }
+
+        if (*fmt == '.') {
+            fmt += 1;
+            prec = 0;
+            if (*fmt == '*') {
+                prec = va_arg(va, int);
+                fmt += 1;
+            }
+            for (; *fmt >= '0' && *fmt <= '9'; fmt++) {
+                prec = prec * 10 + (*fmt - '0');
+            }
+        }
+
+        if (fmt[0] == 'h') {
+            length = fmt[1] == 'h' ? 6 : 1;
+            fmt += fmt[1] == 'h' ? 2 : 1;
+        } else if (fmt[0] == 'l' && fmt[1] == 'l') {
+            length = 3;
+            fmt += 2;
+        } else if (fmt[0] == 'l') {
+            length = 2;
+            fmt += 1;
+        } else if (fmt[0] == 'j' || fmt[0] == 'q') {
+            length = 3;
+            fmt += 1;
+        } else if (fmt[0] == 'I' && fmt[1] == '6' && fmt[2] == '4') {
+            length = 3;
+            fmt += 3;
+        } else if (fmt[0] == 'z' || fmt[0] == 't') {
+            length = 4;
+            fmt += 1;
+        } else if (fmt[0] == 'L') {
+            length = 5;
+            fmt += 1;
+        }
+
+        switch (*fmt) {
+        case '%': zzt_format_putc(&out, '%'); fmt += 1; continue;
+        case 'c':
+            digits[0] = (char)va_arg(va, int);
+            len = 1;
+            prec = -1;
+            zero = ZZT_FALSE;
+            break;
+        case 's':
+            str = va_arg(va, const char *);
+            if (str == NULL) {
+                str = "(null)";
+            }
+            for (len = 0; str[len] != '\0' && len != prec; len++) {
+            }
+            prec = -1;
+            zero = ZZT_FALSE;
+            break;
+        case 'd':
+        case 'i': {
+            ZZT_INTMAX v = 0;
+            switch (length) {
+            case 1: v = (short)va_arg(va, int); break;
+            case 2: v = va_arg(va, long); break;
+            case 3: v = va_arg(va, ZZT_INTMAX); break;
+            case 4: v = (ZZT_INTMAX)va_arg(va, size_t); break;
+            case 6: v = (signed char)va_arg(va, int); break;
+            default: v = va_arg(va, int); break;
+            }
+
+            if (v < 0) {
+                prefix = "-";
+                u = (ZZT_UINTMAX)0 - (ZZT_UINTMAX)v;
+            } else {
+                u = (ZZT_UINTMAX)v;
+            }
+            break;
+        }
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            switch (length) {
+            case 1: u = (unsigned short)va_arg(va, unsigned); break;
+            case 2: u = va_arg(va, unsigned long); break;
+            case 3: u = va_arg(va, ZZT_UINTMAX); break;
+            case 4: u = va_arg(va, size_t); break;
+            case 6: u = (unsigned char)va_arg(va, unsigned); break;
+            default: u = va_arg(va, unsigned); break;
+            }
+
+            base = *fmt == 'o' ? 8 : *fmt == 'u' ? 10 : 16;
+            if (alt && base == 16 && u != 0) {
+                prefix = *fmt == 'X' ? "0X" : "0x";
+            }
+            break;
+        case 'p':
+            u = (ZZT_UINTMAX)(size_t)va_arg(va, void *);
+            prefix = "0x";
+            base = 16;
+            break;
+        case 'f':
+        case 'F': {
+            double v = length == 5 ? (double)va_arg(va, long double)
+                                   : va_arg(va, double);
+            ZZT_UINTMAX scale = 1;
+
+            /* Format a fixed-point integer scaled by 10^precision. */
+            point = prec < 0 ? 6 : prec > 9 ? 9 : (int)prec;
+            for (count = 0; count < point; count++) {
+                scale *= 10;
+            }
+            if (v < 0) {
+                prefix = "-";
+                v = -v;
+            }
+
+            prec = -1;
+            if (v < (double)(((ZZT_UINTMAX)-1 / 2) / scale)) {
+                /* Round half to even, as printf does for exact halves. */
+                v *= (double)scale;
+                u = (ZZT_UINTMAX)v;
+                v -= (double)u;
+                u += v > 0.5 || (v == 0.5 && (u & 1) != 0);
+                break;
+            }
+
+            /* NaN, infinity or too large, print the conversion itself. */
+            str = start;
+            len = (long)(fmt + 1 - start);
+            prefix = "";
+            width = 0;
+            break;
+        }
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (length == 5) {
+                (void)va_arg(va, long double);
+            } else {
+                (void)va_arg(va, double);
+            }
+
+            str = start;
+            len = (long)(fmt + 1 - start);
+            prec = -1;
+            width = 0;
+            break;
+        default:
+            /* Can't skip an argument we don't understand, so stop here. */
+            for (; *start != '\0'; start++) {
+                zzt_format_putc(&out, *start);
+            }
+            fmt = start;
+            break;
+        }
+
+        if (*fmt == '\0') {
+            break;
+        } else if (str == digits && *fmt != 'c') {
+            const char *set = *fmt == 'X' ? "0123456789ABCDEF"
+                                          : "0123456789abcdef";
+            char *d = digits + sizeof(digits);
+
+            /* A precision of zero prints nothing for zero, like printf. */
+            for (count = 0;
+                 u != 0 || count <= point || (count == 0 && prec != 0);
+                 count++) {
+                if (count == point && point != 0) {
+                    *--d = '.';
+                }
+                *--d = set[u % base];
+                u /= base;
+            }
+
+            str = d;
+            len = (long)(digits + sizeof(digits) - d);
+            if (alt && base == 8 && (len == 0 || *d != '0')) {
+                *--d = '0';
+                str = d;
+                len += 1;
+            }
+            if (prec >= 0) {
+                zero = ZZT_FALSE;
+                if (prec > len) {
+                    fill = prec - len;
+                }
+            }
+        }
+
+        width -= len + fill + (long)strlen(prefix);
+        if (zero && !left && width > 0) {
+            fill += width;
+            width = 0;
+        }
+
+        if (!left) {
+            zzt_format_pad(&out, ' ', width);
+        }
+        for (; *prefix != '\0'; prefix++) {
+            zzt_format_putc(&out, *prefix);
+        }
+        zzt_format_pad(&out, '0', fill);
+        for (; len > 0; len--) {
+            zzt_format_putc(&out, *str++);
+        }
+        if (left) {
+            zzt_format_pad(&out, ' ', width);
+        }
+
+        fmt += 1;
+    }
+
+    if (buflen != 0) {
+        *out.w = '\0';
+    }
+
+    return out.len;
+}
+
+#define zzt_vsprintf(buf, buflen, fmt, va) zzt_format(buf, buflen, fmt, va)
+
+#if !defined(ZZTEST_CONFIG_PRINTF) && !defined(ZZTEST_CONFIG_WIRE) && \
+    !defined(ZZTEST_CONFIG_TRANSPORT)
+
+/**
+ * @brief Default ZZT_PRINTF with the built-in formatter.  Overlong lines
+ *        are cut short, keeping their newline.
+ *
+ * @param fmt Format string.
+ * @param ... Format parameters.
+ */
+static int
+zzt_printf(const char *fmt, ...)
+{
+    char buf[ZZT_PRINT_BUFFER_];
+    unsigned long len = 0;
+    va_list va;
+    va_start(va, fmt);
+
+    len = zzt_format(buf, sizeof(buf), fmt, va);
+    if (len >= sizeof(buf)) {
+        memcpy(buf + sizeof(buf) - 5, "...\n", 5);
+        len = sizeof(buf) - 1;
+    }
+    fputs(buf, stdout);
+
+    va_end(va);
+    return (int)len;
+}
+
+#endif
+
+#elif defined(__GNUC__)
 #define zzt_vsprintf(buf, buflen, fmt, va) vsnprintf(buf, buflen, fmt, va)
 #elif defined(_MSC_VER) /* FIXME: When was this added? */
 #define zzt_vsprintf(buf, buflen, fmt, va) \
@@ -117,8 +960,531 @@ zzt_sprintf(char *buf, unsigned buflen, const char *fmt, ...)
     va_end(va);
 }
 
-/**
- * @brief Turn a string into a typical quoted string literal.
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+
+#define ZZT_TRANSPORT_MASK_ (ZZTEST_CONFIG_TRANSPORT_RING - 1)
+
+#if defined(__unix__) || defined(__APPLE__)
+
+/**
+ * @brief Stand-in transport writing to standard output, usually a pipe into
+ *        zztdecode.  Writes no more than POSIX guarantees a pipe takes at
+ *        once, and only when poll says there's room.
+ */
+static unsigned long
+zzt_transport_stdout(void *user, const unsigned char *data, unsigned long len)
+{
+    struct pollfd pfd;
+    long written = 0;
+
+    (void)user;
+    pfd.fd = 1;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) != 1 || (pfd.revents & POLLOUT) == 0) {
+        /* Nobody may be listening.  Frames stay queued, and once the ring
+         * fills, the ones dropped show up as gaps in sequence numbers. */
+        return 0;
+    }
+
+    written = (long)write(1, data, len < 512 ? len : 512);
+    return written > 0 ? (unsigned long)written : 0;
+}
+
+#endif
+
+/*
+ * Output is queued in a ring of frames and handed to the transport when the
+ * runner gets a chance, so a slow link never stalls a test.  A frame that
+ * doesn't fit is dropped whole, and the gap it leaves in sequence numbers
+ * tells the decoder how many were lost.  Head and tail count bytes ever
+ * written and sent.
+ */
+static unsigned char g_transportRing[ZZTEST_CONFIG_TRANSPORT_RING];
+static unsigned long g_transportHead;
+static unsigned long g_transportTail;
+static unsigned char g_transportSeq;
+#if defined(__unix__) || defined(__APPLE__)
+static zzt_transport_func g_transportFunc = zzt_transport_stdout;
+#else
+static zzt_transport_func g_transportFunc;
+#endif
+static void *g_transportUser;
+
+/**
+ * @brief Hand queued output to the transport until it's busy.  Caller holds
+ *        g_transportLock.
+ */
+static void
+zzt_transport_send(void)
+{
+    while (g_transportFunc != NULL && g_transportTail != g_transportHead) {
+        unsigned long off = g_transportTail & ZZT_TRANSPORT_MASK_;
+        unsigned long len = g_transportHead - g_transportTail;
+        unsigned long sent = 0;
+
+        /* Only the part before the ring wraps is contiguous. */
+        if (len > ZZTEST_CONFIG_TRANSPORT_RING - off) {
+            len = ZZTEST_CONFIG_TRANSPORT_RING - off;
+        }
+
+        sent = g_transportFunc(g_transportUser, g_transportRing + off, len);
+        g_transportTail += sent;
+        if (sent < len) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Add a byte to the CRC of a frame.
+ */
+static unsigned
+zzt_transport_crc(unsigned crc, unsigned char byte)
+{
+    int bit = 0;
+
+    crc ^= (unsigned)byte << 8;
+    for (bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000U) ? (crc << 1) ^ ZZT_FRAME_CRC_POLY : crc << 1;
+    }
+    return crc & 0xFFFFU;
+}
+
+/**
+ * @brief Queue one frame of output, or drop it if there's no room even
+ *        after sending what we can.  Caller holds g_transportLock.
+ */
+static void
+zzt_transport_put(const char *text, unsigned long len)
+{
+    unsigned crc = ZZT_FRAME_CRC_INIT;
+    unsigned char header[3];
+    unsigned long i = 0;
+
+    if (len > ZZT_FRAME_PAYLOAD_MAX) {
+        len = ZZT_FRAME_PAYLOAD_MAX;
+    }
+
+    header[0] = (unsigned char)(len & 0xFF);
+    header[1] = (unsigned char)(len >> 8);
+    header[2] = g_transportSeq++;
+
+    if (ZZTEST_CONFIG_TRANSPORT_RING - (g_transportHead - g_transportTail) <
+        len + ZZT_FRAME_OVERHEAD) {
+        zzt_transport_send();
+        if (ZZTEST_CONFIG_TRANSPORT_RING -
+                (g_transportHead - g_transportTail) <
+            len + ZZT_FRAME_OVERHEAD) {
+            return;
+        }
+    }
+
+#define PUT_(c) \
+    (g_transportRing[g_transportHead++ & ZZT_TRANSPORT_MASK_] = (c))
+
+    PUT_(ZZT_FRAME_SYNC);
+    for (i = 0; i < sizeof(header); i++) {
+        crc = zzt_transport_crc(crc, header[i]);
+        PUT_(header[i]);
+    }
+    for (i = 0; i < len; i++) {
+        crc = zzt_transport_crc(crc, (unsigned char)text[i]);
+        PUT_((unsigned char)text[i]);
+    }
+    PUT_((unsigned char)(crc & 0xFF));
+    PUT_((unsigned char)(crc >> 8));
+#undef PUT_
+}
+
+#if !defined(ZZTEST_CONFIG_WIRE)
+
+/**
+ * @brief ZZT_PRINTF with ZZTEST_CONFIG_TRANSPORT, queueing each call as a
+ *        frame.
+ *
+ * @param fmt Format string.
+ * @param ... Format parameters.
+ */
+static int
+zzt_transport_printf(const char *fmt, ...)
+{
+    char buf[ZZT_PRINT_BUFFER_];
+    unsigned long len = 0;
+    va_list va;
+    va_start(va, fmt);
+
+    zzt_vsprintf(buf, sizeof(buf), fmt, va);
+    len = (unsigned long)strlen(buf);
+
+    ZZT_LOCK_(&g_transportLock);
+    zzt_transport_put(buf, len);
+    ZZT_UNLOCK_(&g_transportLock);
+
+    va_end(va);
+    return (int)len;
+}
+
+#endif
+
+/* Polls a flush makes without progress when zzt_ms doesn't run. */
+#define ZZT_TRANSPORT_SPINS_ 100000000UL
+
+/**
+ * @brief Send everything queued, waiting on the transport while it takes
+ *        something at least every ZZTEST_CONFIG_TRANSPORT_TIMEOUT ms.  What
+ *        a stalled link never took is dropped, and the decoder sees the gap
+ *        in sequence numbers.  Used before forking and when the run ends.
+ */
+static void
+zzt_transport_flush(void)
+{
+    unsigned long queued = 0, least = ULONG_MAX, since = zzt_ms(), spins = 0;
+
+    while ((queued = zzt_transport_poll()) != 0 && g_transportFunc != NULL) {
+        if (queued < least) {
+            least = queued;
+            since = zzt_ms();
+            spins = 0;
+        } else if (zzt_ms() - since >= ZZTEST_CONFIG_TRANSPORT_TIMEOUT ||
+                   ++spins >= ZZT_TRANSPORT_SPINS_) {
+            ZZT_LOCK_(&g_transportLock);
+            g_transportTail = g_transportHead;
+            ZZT_UNLOCK_(&g_transportLock);
+            break;
+        }
+    }
+}
+
+#endif
+
+#if !defined(ZZTEST_CONFIG_NO_TRACE) || defined(ZZTEST_CONFIG_WIRE)
+
+/**
+ * @brief Parse a single printf conversion.
+ *
+ * @param fmt Pointer just past the '%' that starts the conversion.
+ * @param type Type of argument the conversion consumes.
+ * @param stars Number of '*' width and precision arguments consumed.
+ * @return Pointer just past the conversion.
+ */
+static const char *
+zzt_trace_spec(const char *fmt, enum zzt_targ_e *type, int *stars)
+{
+    int length = 0; /* 1 = h/hh, 2 = l, 3 = ll/j/I64, 4 = z/t, 5 = L */
+
+    *stars = 0;
+    while (*fmt != '\0' && strchr("-+ #0'", *fmt) != NULL) {
+        fmt += 1;
+    }
+
+    if (*fmt == '*') {
+        *stars += 1;
+        fmt += 1;
+    }
+    while (*fmt >= '0' && *fmt <= '9') {
+        fmt += 1;
+    }
+
+    if (*fmt == '.') {
+        fmt += 1;
+        if (*fmt == '*') {
+            *stars += 1;
+            fmt += 1;
+        }
+        while (*fmt >= '0' && *fmt <= '9') {
+            fmt += 1;
+        }
+    }
+
+    if (fmt[0] == 'h') {
+        length = 1;
+        fmt += fmt[1] == 'h' ? 2 : 1;
+    } else if (fmt[0] == 'l' && fmt[1] == 'l') {
+        length = 3;
+        fmt += 2;
+    } else if (fmt[0] == 'l') {
+        length = 2;
+        fmt += 1;
+    } else if (fmt[0] == 'j' || fmt[0] == 'q') {
+        length = 3;
+        fmt += 1;
+    } else if (fmt[0] == 'I' && fmt[1] == '6' && fmt[2] == '4') {
+        length = 3;
+        fmt += 3;
+    } else if (fmt[0] == 'z' || fmt[0] == 't') {
+        length = 4;
+        fmt += 1;
+    } else if (fmt[0] == 'L') {
+        length = 5;
+        fmt += 1;
+    }
+
+    switch (*fmt) {
+    case '%': *type = ZZT_TARG_NONE; break;
+    case 'c': *type = length == 0 ? ZZT_TARG_INT : ZZT_TARG_BAD; break;
+    case 'd':
+    case 'i':
+        switch (length) {
+        case 0:
+        case 1: *type = ZZT_TARG_INT; break;
+        case 2: *type = ZZT_TARG_LONG; break;
+        case 3: *type = ZZT_TARG_MAX; break;
+        case 4: *type = ZZT_TARG_SIZE; break;
+        default: *type = ZZT_TARG_BAD; break;
+        }
+        break;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+        switch (length) {
+        case 0:
+        case 1: *type = ZZT_TARG_UINT; break;
+        case 2: *type = ZZT_TARG_ULONG; break;
+        case 3: *type = ZZT_TARG_UMAX; break;
+        case 4: *type = ZZT_TARG_USIZE; break;
+        default: *type = ZZT_TARG_BAD; break;
+        }
+        break;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        if (length == 0) {
+            *type = ZZT_TARG_DOUBLE;
+        } else if (length == 5) {
+            *type = ZZT_TARG_LDOUBLE;
+        } else {
+            *type = ZZT_TARG_BAD;
+        }
+        break;
+    case 's': *type = length == 0 ? ZZT_TARG_STR : ZZT_TARG_BAD; break;
+    case 'p': *type = length == 0 ? ZZT_TARG_PTR : ZZT_TARG_BAD; break;
+    default: *type = ZZT_TARG_BAD; return fmt;
+    }
+
+    return fmt + 1;
+}
+
+#endif
+
+#if defined(ZZTEST_CONFIG_NO_TRACE)
+
+#define zzt_trace_print() ZZT_PRINTF("\n")
+#define zzt_trace_reset() ((void)0)
+
+#else
+
+/**
+ * @brief Capture a trace's format string and arguments without formatting.
+ *
+ * @param frame Frame to capture into.
+ * @param fmt Format string.  Must outlive the trace, as literals do.
+ * @param va Format arguments.
+ */
+static void
+zzt_trace_capture(
+    struct zzt_trace_frame_s *frame, const char *fmt, va_list va)
+{
+    const char *cur = fmt;
+    enum zzt_targ_e type = ZZT_TARG_NONE;
+    int stars = 0, count = 0;
+    unsigned long textUsed = 0;
+
+    /* Count arguments first, as we can't rewind va. */
+    while ((cur = strchr(cur, '%')) != NULL) {
+        cur = zzt_trace_spec(cur + 1, &type, &stars);
+        count += stars + (type != ZZT_TARG_NONE);
+        if (type == ZZT_TARG_BAD) {
+            break;
+        }
+    }
+
+    frame->fmt = fmt;
+    if (type == ZZT_TARG_BAD || count > ZZT_TRACE_ARGS_) {
+        frame->eager = ZZT_TRUE;
+        zzt_vsprintf(frame->text, sizeof(frame->text), fmt, va);
+        return;
+    }
+
+    frame->eager = ZZT_FALSE;
+    count = 0;
+    cur = fmt;
+    while ((cur = strchr(cur, '%')) != NULL) {
+        union zzt_trace_arg_u *arg = NULL;
+
+        cur = zzt_trace_spec(cur + 1, &type, &stars);
+        for (; stars > 0; stars--) {
+            frame->args[count++].i = va_arg(va, int);
+        }
+
+        arg = &frame->args[count];
+        switch (type) {
+        case ZZT_TARG_NONE: continue;
+        case ZZT_TARG_INT: arg->i = va_arg(va, int); break;
+        case ZZT_TARG_LONG: arg->i = va_arg(va, long); break;
+        case ZZT_TARG_MAX: arg->i = va_arg(va, ZZT_INTMAX); break;
+        case ZZT_TARG_SIZE: arg->u = va_arg(va, size_t); break;
+        case ZZT_TARG_UINT: arg->u = va_arg(va, unsigned); break;
+        case ZZT_TARG_ULONG: arg->u = va_arg(va, unsigned long); break;
+        case ZZT_TARG_UMAX: arg->u = va_arg(va, ZZT_UINTMAX); break;
+        case ZZT_TARG_USIZE: arg->u = va_arg(va, size_t); break;
+        case ZZT_TARG_DOUBLE: arg->d = va_arg(va, double); break;
+        case ZZT_TARG_LDOUBLE: arg->d = (double)va_arg(va, long double); break;
+        case ZZT_TARG_PTR: arg->p = va_arg(va, void *); break;
+        case ZZT_TARG_STR: {
+            const char *str = va_arg(va, const char *);
+            unsigned long len = 0;
+
+            if (str == NULL) {
+                str = "(null)";
+            }
+
+            if (textUsed >= sizeof(frame->text)) {
+                /* Earlier strings filled the buffer, cut this one. */
+                arg->p = "";
+                break;
+            }
+
+            len = (unsigned long)strlen(str);
+            if (len >= sizeof(frame->text) - textUsed) {
+                len = sizeof(frame->text) - textUsed - 1;
+            }
+
+            memcpy(frame->text + textUsed, str, len);
+            frame->text[textUsed + len] = '\0';
+            arg->p = frame->text + textUsed;
+            textUsed += len + 1;
+            break;
+        }
+        default: break;
+        }
+        count += 1;
+    }
+}
+
+/**
+ * @brief Format a captured trace.
+ *
+ * @param buf Buffer to write to.
+ * @param buflen Length of buffer.
+ * @param frame Captured trace.
+ */
+static void
+zzt_trace_format(
+    char *buf, unsigned long buflen, const struct zzt_trace_frame_s *frame)
+{
+    const char *cur = frame->fmt;
+    char *w = buf;
+    char *end = buf + buflen - 1;
+    int count = 0;
+
+    if (frame->eager) {
+        zzt_sprintf(buf, buflen, "%s", frame->text);
+        return;
+    }
+
+    while (*cur != '\0' && w < end) {
+        const char *start = cur;
+        const union zzt_trace_arg_u *arg = NULL;
+        enum zzt_targ_e type = ZZT_TARG_NONE;
+        char spec[32];
+        char *sw = spec;
+        int stars = 0;
+
+        if (*cur != '%') {
+            *w++ = *cur++;
+            continue;
+        }
+
+        cur = zzt_trace_spec(cur + 1, &type, &stars);
+        if (type == ZZT_TARG_NONE) {
+            *w++ = '%';
+            continue;
+        }
+
+        /* Rebuild the conversion with captured widths in place of '*'. */
+        for (; start < cur && sw < spec + sizeof(spec) - 12; start++) {
+            if (*start == '*') {
+                zzt_sprintf(sw, 12, "%d", (int)frame->args[count++].i);
+                sw += strlen(sw);
+            } else {
+                *sw++ = *start;
+            }
+        }
+        *sw = '\0';
+
+        arg = &frame->args[count++];
+        switch (type) {
+        case ZZT_TARG_INT: zzt_sprintf(w, end - w + 1, spec, (int)arg->i); break;
+        case ZZT_TARG_LONG:
+            zzt_sprintf(w, end - w + 1, spec, (long)arg->i);
+            break;
+        case ZZT_TARG_MAX: zzt_sprintf(w, end - w + 1, spec, arg->i); break;
+        case ZZT_TARG_SIZE:
+        case ZZT_TARG_USIZE:
+            zzt_sprintf(w, end - w + 1, spec, (size_t)arg->u);
+            break;
+        case ZZT_TARG_UINT:
+            zzt_sprintf(w, end - w + 1, spec, (unsigned)arg->u);
+            break;
+        case ZZT_TARG_ULONG:
+            zzt_sprintf(w, end - w + 1, spec, (unsigned long)arg->u);
+            break;
+        case ZZT_TARG_UMAX: zzt_sprintf(w, end - w + 1, spec, arg->u); break;
+        case ZZT_TARG_DOUBLE: zzt_sprintf(w, end - w + 1, spec, arg->d); break;
+        case ZZT_TARG_LDOUBLE:
+            zzt_sprintf(w, end - w + 1, spec, (long double)arg->d);
+            break;
+        case ZZT_TARG_STR:
+        case ZZT_TARG_PTR: zzt_sprintf(w, end - w + 1, spec, arg->p); break;
+        default: break;
+        }
+        w += strlen(w);
+    }
+
+    *w = '\0';
+}
+
+/**
+ * @brief Print every active trace, innermost first, followed by a blank
+ *        line.
+ */
+static void
+zzt_trace_print(void)
+{
+    int i;
+    for (i = g_traceDepth; i >= 0; i--) {
+        if (g_traceFrames[i].fmt != NULL) {
+            char buf[256];
+            zzt_trace_format(buf, sizeof(buf), &g_traceFrames[i]);
+            ZZT_PRINTF("Scoped trace: %s\n", buf);
+        }
+    }
+
+    ZZT_PRINTF("\n");
+}
+
+/**
+ * @brief Discard all traces, used when a new test starts.
+ */
+static void
+zzt_trace_reset(void)
+{
+    g_traceDepth = 0;
+    g_traceOverflow = 0;
+    g_traceFrames[0].fmt = NULL;
+}
+
+#endif
+
+/**
+ * @brief Turn a string into a typical quoted string literal.
  *
  * @param buf Buffer to write to.
  * @param buflen Length of destination buffer.
@@ -143,6 +1509,17 @@ zzt_stringify(char *buf, unsigned long buflen, const char *str)
     }
 
     WRITE_('\"');
+#if defined(ZZTEST_CONFIG_NO_ESCAPE)
+    /* Copy the string as-is, control characters and all. */
+    while (*cur != '\0') {
+        if (REMAIN_() < 2) {
+            partial = ZZT_TRUE;
+            break;
+        }
+        WRITE_(*cur);
+        cur += 1;
+    }
+#else
     while (*cur != '\0') {
         if (*cur == '\t' || *cur == '\n' || *cur == '\r' || *cur == '\\') {
             if (REMAIN_() < 3) {
@@ -178,6 +1555,7 @@ zzt_stringify(char *buf, unsigned long buflen, const char *str)
 
         cur += 1;
     }
+#endif
 
     if (partial) {
         w = end - 5;
@@ -270,6 +1648,12 @@ zzt_printerr(enum zzt_fmt_e fmt, enum zzt_cmp_e cmp, const void *l,
 
     zzt_printv(lbuf, sizeof(lbuf), fmt, l);
     zzt_printv(rbuf, sizeof(rbuf), fmt, r);
+
+    if (g_quiet) {
+        return;
+    }
+
+    ZZT_LOCK_(&g_printLock);
     if (fmt != ZZT_FMT_STR) {
         ZZT_PRINTF("%s(%lu): error: Expected %s %s %s, actual %s vs %s\n", file,
             line, ls, g_cmpStrings[cmp], rs, lbuf, rbuf);
@@ -287,11 +1671,9 @@ zzt_printerr(enum zzt_fmt_e fmt, enum zzt_cmp_e cmp, const void *l,
         }
     }
 
-    if (g_scopedTrace[0] != '\0') {
-        ZZT_PRINTF("Scoped trace: %s\n\n", g_scopedTrace);
-    } else {
-        ZZT_PRINTF("\n");
-    }
+    zzt_trace_print();
+    ZZT_UNLOCK_(&g_printLock);
+    ZZT_FUZZ_CRASH_();
 }
 
 /**
@@ -309,6 +1691,12 @@ zzt_add_fail(struct zzt_test_s *test)
     }
 }
 
+#if defined(ZZTEST_CONFIG_NO_SKIP_LIST)
+
+#define zzt_add_skip(test) ((void)(test))
+
+#else
+
 /**
  * @brief Add a test to our list of skipped tests.
  */
@@ -324,218 +1712,5507 @@ zzt_add_skip(struct zzt_test_s *test)
     }
 }
 
-/******************************************************************************/
-
-void
-zzt_pass(struct zzt_test_state_s *state)
-{
-    state->passed += 1;
-}
+#endif
 
-/******************************************************************************/
+#if defined(ZZT_PERF_)
 
-void
-zzt_skip(struct zzt_test_state_s *state)
+/**
+ * @brief Open hardware counters for the calling thread and its children.
+ *
+ * @details Counters that can't be opened are left at -1 and skipped, which
+ *          is the usual state of affairs inside containers and VMs.
+ *
+ * @return Number of counters that were opened.
+ */
+static int
+zzt_perf_open(void)
 {
-    state->skipped += 1;
-}
+    int i, opened = 0;
 
-/******************************************************************************/
+    for (i = 0; i < ZZT_PERF_MAX; i++) {
+        struct perf_event_attr attr;
 
-void
-zzt_fail(struct zzt_test_state_s *state, const char *file, unsigned long line,
-    const char *msgstr)
-{
-    ZZT_PRINTF("%s(%lu): error: %s\n", file, line, msgstr);
-    if (g_scopedTrace[0] != '\0') {
-        ZZT_PRINTF("Scoped trace: %s\n\n", g_scopedTrace);
-    } else {
-        ZZT_PRINTF("\n");
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = g_perfConfigs[i];
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        g_perfFds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (g_perfFds[i] >= 0) {
+            opened += 1;
+        }
     }
 
-    state->failed += 1;
+    return opened;
 }
 
-/******************************************************************************/
-
-ZZT_BOOL
-zzt_cmp_int(struct zzt_test_state_s *state, enum zzt_fmt_e fmt,
-    enum zzt_cmp_e cmp, ZZT_INTMAX l, ZZT_INTMAX r, const char *ls,
-    const char *rs, const char *file, unsigned long line)
+/**
+ * @brief Close any counters opened by zzt_perf_open.
+ */
+static void
+zzt_perf_close(void)
 {
-    ZZT_BOOL isEqual = ZZT_FALSE;
-
-    switch (cmp) {
-    case ZZT_CMP_EQ: isEqual = l == r; break;
-    case ZZT_CMP_NE: isEqual = l != r; break;
-    case ZZT_CMP_LT: isEqual = l < r; break;
-    case ZZT_CMP_LE: isEqual = l <= r; break;
-    case ZZT_CMP_GT: isEqual = l > r; break;
-    case ZZT_CMP_GE: isEqual = l >= r; break;
+    int i;
+    for (i = 0; i < ZZT_PERF_MAX; i++) {
+        if (g_perfFds[i] >= 0) {
+            close(g_perfFds[i]);
+            g_perfFds[i] = -1;
+        }
     }
+}
 
-    if (isEqual) {
-        state->passed += 1;
-        return ZZT_TRUE;
+/**
+ * @brief Reset and start all open counters.
+ */
+static void
+zzt_perf_start(void)
+{
+    int i;
+    for (i = 0; i < ZZT_PERF_MAX; i++) {
+        if (g_perfFds[i] >= 0) {
+            ioctl(g_perfFds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(g_perfFds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
     }
+}
 
-    state->failed += 1;
+/**
+ * @brief Stop all open counters and add their values to totals.
+ *
+ * @param values Counter values for this run.
+ * @param totals Running totals, or NULL.
+ */
+static void
+zzt_perf_stop(ZZT_UINTMAX *values, ZZT_UINTMAX *totals)
+{
+    int i;
+    for (i = 0; i < ZZT_PERF_MAX; i++) {
+        __u64 count = 0;
+
+        values[i] = 0;
+        if (g_perfFds[i] < 0) {
+            continue;
+        }
+
+        ioctl(g_perfFds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(g_perfFds[i], &count, sizeof(count)) == sizeof(count)) {
+            values[i] = count;
+            if (totals != NULL) {
+                totals[i] += count;
+            }
+        }
+    }
+}
+
+#if defined(ZZTEST_CONFIG_BENCH)
+
+/**
+ * @brief Read all open counters without stopping them.
+ */
+static void
+zzt_perf_read(ZZT_UINTMAX *values)
+{
+    int i;
+    for (i = 0; i < ZZT_PERF_MAX; i++) {
+        __u64 count = 0;
+
+        values[i] = 0;
+        if (g_perfFds[i] >= 0 &&
+            read(g_perfFds[i], &count, sizeof(count)) == sizeof(count)) {
+            values[i] = count;
+        }
+    }
+}
+
+#endif
+
+/**
+ * @brief Print the values of all open counters.
+ *
+ * @param name Name of the test or suite being reported.
+ * @param values Counter values.
+ */
+static void
+zzt_perf_print(const char *name, const ZZT_UINTMAX *values)
+{
+    char buf[256];
+    char *w = buf;
+    int i;
+
+    buf[0] = '\0';
+    for (i = 0; i < ZZT_PERF_MAX; i++) {
+        if (g_perfFds[i] < 0) {
+            continue;
+        }
+
+        zzt_sprintf(w, sizeof(buf) - (w - buf), "%s%" ZZT_PRIuMAX " %s",
+            w == buf ? "" : ", ", values[i], g_perfNames[i]);
+        w += strlen(w);
+    }
+
+    ZZT_PRINTF(ZZTLOG_PERF " %s: %s\n", name, buf);
+}
+
+#endif /* defined(ZZT_PERF_) */
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+/**
+ * @brief Move a thread's counts into the state they belong to.
+ *
+ * @details Caller must hold g_threadLock.
+ */
+static void
+zzt_thread_fold(struct zzt_thread_counts_s *counts)
+{
+    if (counts->state != NULL) {
+        counts->state->passed += counts->passed;
+        counts->state->failed += counts->failed;
+        counts->state->skipped += counts->skipped;
+        if (counts->state->fail_file == NULL) {
+            counts->state->fail_file = counts->fail_file;
+            counts->state->fail_line = counts->fail_line;
+        }
+    }
+
+    counts->passed = 0;
+    counts->failed = 0;
+    counts->skipped = 0;
+    counts->fail_file = NULL;
+    counts->fail_line = 0;
+}
+
+/**
+ * @brief Thread exit hook, folds the exiting thread's counts.
+ */
+#if defined(_WIN32)
+static VOID WINAPI
+zzt_thread_exit(PVOID ptr)
+#else
+static void
+zzt_thread_exit(void *ptr)
+#endif
+{
+    struct zzt_thread_counts_s *counts = (struct zzt_thread_counts_s *)ptr;
+    struct zzt_thread_counts_s **link = &g_threadCountsHead;
+
+    ZZT_LOCK_(&g_threadLock);
+    zzt_thread_fold(counts);
+    counts->state = NULL;
+    for (; *link; link = &(*link)->next) {
+        if (*link == counts) {
+            *link = counts->next;
+            break;
+        }
+    }
+    counts->registered = ZZT_FALSE;
+    ZZT_UNLOCK_(&g_threadLock);
+}
+
+/**
+ * @brief Point this thread's counts at a new test state.
+ */
+static void
+zzt_thread_attach(
+    struct zzt_thread_counts_s *counts, struct zzt_test_state_s *state)
+{
+    ZZT_LOCK_(&g_threadLock);
+    zzt_thread_fold(counts);
+    counts->state = state;
+    if (!counts->registered) {
+        counts->registered = ZZT_TRUE;
+        counts->next = g_threadCountsHead;
+        g_threadCountsHead = counts;
+        if (g_threadKeyValid) {
+#if defined(_WIN32)
+            FlsSetValue(g_threadKey, counts);
+#else
+            pthread_setspecific(g_threadKey, counts);
+#endif
+        }
+    }
+    ZZT_UNLOCK_(&g_threadLock);
+}
+
+/**
+ * @brief Return this thread's counts for the given test state.
+ */
+static struct zzt_thread_counts_s *
+zzt_thread_counts(struct zzt_test_state_s *state)
+{
+    struct zzt_thread_counts_s *counts = &g_threadCounts;
+    if (counts->state != state) {
+        zzt_thread_attach(counts, state);
+    }
+    return counts;
+}
+
+/**
+ * @brief Fold every thread's counts for a finished test into its state.
+ */
+static void
+zzt_thread_collect(struct zzt_test_state_s *state)
+{
+    struct zzt_thread_counts_s *counts = NULL;
+
+    ZZT_LOCK_(&g_threadLock);
+    for (counts = g_threadCountsHead; counts; counts = counts->next) {
+        if (counts->state == state) {
+            zzt_thread_fold(counts);
+            counts->state = NULL;
+        }
+    }
+    ZZT_UNLOCK_(&g_threadLock);
+}
+
+#endif /* defined(ZZTEST_CONFIG_THREADS) */
+
+#if defined(ZZTEST_CONFIG_THREADS) || defined(ZZTEST_CONFIG_BENCH)
+
+/**
+ * @brief Count the processors online, for --jobs and benchmark results.
+ */
+static unsigned long
+zzt_cpu_count(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned long)count : 1;
+#else
+    return 1;
+#endif
+}
+
+#endif
+
+/**
+ * @brief Remember where a test first failed.
+ */
+static void
+zzt_fail_at(struct zzt_test_state_s *state, const char *file, unsigned long line)
+{
+#if defined(ZZTEST_CONFIG_THREADS)
+    /* Kept with the counts, and folded into the state with them. */
+    struct zzt_thread_counts_s *counts = zzt_thread_counts(state);
+    if (counts->fail_file == NULL) {
+        counts->fail_file = file;
+        counts->fail_line = line;
+    }
+#else
+    if (state->fail_file == NULL) {
+        state->fail_file = file;
+        state->fail_line = line;
+    }
+#endif
+}
+
+/******************************************************************************/
+
+void
+zzt_pass(struct zzt_test_state_s *state)
+{
+    ZZT_COUNT_(state, passed);
+}
+
+/******************************************************************************/
+
+void
+zzt_skip(struct zzt_test_state_s *state)
+{
+    ZZT_COUNT_(state, skipped);
+}
+
+/******************************************************************************/
+
+void
+zzt_collect(struct zzt_test_state_s *state)
+{
+#if defined(ZZTEST_CONFIG_THREADS)
+    zzt_thread_collect(state);
+#else
+    (void)state;
+#endif
+}
+
+/******************************************************************************/
+
+void
+zzt_fail(struct zzt_test_state_s *state, const char *file, unsigned long line,
+    const char *msgstr)
+{
+    if (!g_quiet) {
+        ZZT_LOCK_(&g_printLock);
+        ZZT_PRINTF("%s(%lu): error: %s\n", file, line, msgstr);
+        zzt_trace_print();
+        ZZT_UNLOCK_(&g_printLock);
+    }
+
+    ZZT_COUNT_(state, failed);
+    zzt_fail_at(state, file, line);
+    ZZT_FUZZ_CRASH_();
+}
+
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
+
+/******************************************************************************/
+
+void
+zzt_timed_init(struct zzt_timed_s *timed, unsigned long runs)
+{
+    timed->runs = runs < 1                          ? 1
+                  : runs > ZZTEST_CONFIG_TIMED_RUNS ? ZZTEST_CONFIG_TIMED_RUNS
+                                                    : runs;
+    timed->count = 0;
+    timed->start = 0;
+}
+
+/******************************************************************************/
+
+int
+zzt_timed_next(struct zzt_timed_s *timed)
+{
+    ZZT_UINTMAX now = zzt_ns();
+
+    if (timed->count != 0) {
+        timed->ns[timed->count - 1] = now - timed->start;
+    }
+    if (timed->count == timed->runs) {
+        return 0;
+    }
+    timed->count += 1;
+    timed->start = zzt_ns();
+    return 1;
+}
+
+/******************************************************************************/
+
+ZZT_BOOL
+zzt_expect_faster(struct zzt_test_state_s *state, struct zzt_timed_s *timed,
+    unsigned long us, const char *expr, const char *file, unsigned long line)
+{
+    char msg[512], scaled[64];
+    unsigned long i = 0, j = 0, n = timed->count;
+    unsigned long scale = zzt_time_scale(), budget = zzt_scale_budget(us);
+    ZZT_UINTMAX median = 0, ns = 0;
+
+    /* Few runs, so insertion sort for the median. */
+    for (i = 1; i < n; i++) {
+        ns = timed->ns[i];
+        for (j = i; j > 0 && timed->ns[j - 1] > ns; j--) {
+            timed->ns[j] = timed->ns[j - 1];
+        }
+        timed->ns[j] = ns;
+    }
+    median = n % 2 != 0 ? timed->ns[n / 2]
+                        : (timed->ns[n / 2 - 1] + timed->ns[n / 2]) / 2;
+
+    /* In whole microseconds first, budget * 1000 may not fit in 32 bits. */
+    if (median / 1000 < budget ||
+        (median / 1000 == budget && median % 1000 == 0)) {
+        zzt_pass(state);
+        return ZZT_TRUE;
+    }
+
+    scaled[0] = '\0';
+    if (scale != 1000) {
+        zzt_sprintf(scaled, sizeof(scaled), " (%lu us scaled by %lu.%03lu)",
+            us, scale / 1000, scale % 1000);
+    }
+    zzt_sprintf(msg, sizeof(msg),
+        "Expected %s to take at most %lu us%s, the median of %lu runs took "
+        "%lu.%03lu us",
+        expr, budget, scaled, n, (unsigned long)(median / 1000),
+        (unsigned long)(median % 1000));
+    zzt_fail(state, file, line, msg);
+    return ZZT_FALSE;
+}
+
+#endif /* !defined(ZZTEST_CONFIG_NO_TIMING) */
+
+/******************************************************************************/
+
+ZZT_BOOL
+zzt_cmp_int(struct zzt_test_state_s *state, enum zzt_fmt_e fmt,
+    enum zzt_cmp_e cmp, ZZT_INTMAX l, ZZT_INTMAX r, const char *ls,
+    const char *rs, const char *file, unsigned long line)
+{
+    ZZT_BOOL isEqual = ZZT_FALSE;
+
+    switch (cmp) {
+    case ZZT_CMP_EQ: isEqual = l == r; break;
+    case ZZT_CMP_NE: isEqual = l != r; break;
+    case ZZT_CMP_LT: isEqual = l < r; break;
+    case ZZT_CMP_LE: isEqual = l <= r; break;
+    case ZZT_CMP_GT: isEqual = l > r; break;
+    case ZZT_CMP_GE: isEqual = l >= r; break;
+    }
+
+    if (isEqual) {
+        ZZT_COUNT_(state, passed);
+        return ZZT_TRUE;
+    }
+
+    ZZT_COUNT_(state, failed);
+    zzt_fail_at(state, file, line);
+    zzt_printerr(fmt, cmp, &l, &r, ls, rs, file, line);
+    return ZZT_FALSE;
+}
+
+/******************************************************************************/
+
+ZZT_BOOL
+zzt_cmp_uint(struct zzt_test_state_s *state, enum zzt_fmt_e fmt,
+    enum zzt_cmp_e cmp, ZZT_UINTMAX l, ZZT_UINTMAX r, const char *ls,
+    const char *rs, const char *file, unsigned long line)
+{
+    ZZT_BOOL isEqual = ZZT_FALSE;
+
+    switch (cmp) {
+    case ZZT_CMP_EQ: isEqual = l == r; break;
+    case ZZT_CMP_NE: isEqual = l != r; break;
+    case ZZT_CMP_LT: isEqual = l < r; break;
+    case ZZT_CMP_LE: isEqual = l <= r; break;
+    case ZZT_CMP_GT: isEqual = l > r; break;
+    case ZZT_CMP_GE: isEqual = l >= r; break;
+    }
+
+    if (isEqual) {
+        ZZT_COUNT_(state, passed);
+        return ZZT_TRUE;
+    }
+
+    ZZT_COUNT_(state, failed);
+    zzt_fail_at(state, file, line);
     zzt_printerr(fmt, cmp, &l, &r, ls, rs, file, line);
     return ZZT_FALSE;
 }
 
 /******************************************************************************/
 
-ZZT_BOOL
-zzt_cmp_uint(struct zzt_test_state_s *state, enum zzt_fmt_e fmt,
-    enum zzt_cmp_e cmp, ZZT_UINTMAX l, ZZT_UINTMAX r, const char *ls,
-    const char *rs, const char *file, unsigned long line)
+ZZT_BOOL
+zzt_cmp_str(struct zzt_test_state_s *state, enum zzt_fmt_e fmt,
+    enum zzt_cmp_e cmp, const char *l, const char *r, const char *ls,
+    const char *rs, const char *file, unsigned long line)
+{
+    ZZT_BOOL isEqual = ZZT_FALSE;
+
+    switch (cmp) {
+    case ZZT_CMP_EQ: isEqual = 0 == strcmp(l, r); break;
+    case ZZT_CMP_NE: isEqual = 0 != strcmp(l, r); break;
+    }
+
+    if (isEqual) {
+        ZZT_COUNT_(state, passed);
+        return ZZT_TRUE;
+    }
+
+    ZZT_COUNT_(state, failed);
+    zzt_fail_at(state, file, line);
+    zzt_printerr(fmt, cmp, l, r, ls, rs, file, line);
+    return ZZT_FALSE;
+}
+
+/******************************************************************************/
+
+void
+zzt_scoped_trace(const char *fmt, ...)
+{
+#if defined(ZZTEST_CONFIG_NO_TRACE)
+    (void)fmt;
+#else
+    va_list va;
+    if (g_traceOverflow > 0) {
+        return; /* Pushed past the last frame, keep what it holds. */
+    }
+
+    va_start(va, fmt);
+
+    zzt_trace_capture(&g_traceFrames[g_traceDepth], fmt, va);
+
+    va_end(va);
+#endif
+}
+
+/******************************************************************************/
+
+void
+zzt_vscoped_trace(const char *fmt, va_list va)
+{
+#if defined(ZZTEST_CONFIG_NO_TRACE)
+    (void)fmt;
+    (void)va;
+#else
+    if (g_traceOverflow == 0) {
+        zzt_trace_capture(&g_traceFrames[g_traceDepth], fmt, va);
+    }
+#endif
+}
+
+/******************************************************************************/
+
+void
+zzt_trace_push(void)
+{
+#if !defined(ZZTEST_CONFIG_NO_TRACE)
+    if (g_traceDepth == ZZT_TRACE_DEPTH_ - 1) {
+        g_traceOverflow += 1;
+        return;
+    }
+
+    g_traceDepth += 1;
+    g_traceFrames[g_traceDepth].fmt = NULL;
+#endif
+}
+
+/******************************************************************************/
+
+void
+zzt_trace_pop(void)
+{
+#if !defined(ZZTEST_CONFIG_NO_TRACE)
+    if (g_traceOverflow > 0) {
+        g_traceOverflow -= 1;
+        return;
+    }
+
+    g_traceFrames[g_traceDepth].fmt = NULL;
+    if (g_traceDepth > 0) {
+        g_traceDepth -= 1;
+    }
+#endif
+}
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+
+void
+zzt_transport_set(zzt_transport_func func, void *user)
+{
+    ZZT_LOCK_(&g_transportLock);
+    g_transportFunc = func;
+    g_transportUser = user;
+    ZZT_UNLOCK_(&g_transportLock);
+}
+
+/******************************************************************************/
+
+unsigned long
+zzt_transport_poll(void)
+{
+    unsigned long queued = 0;
+
+    ZZT_LOCK_(&g_transportLock);
+    zzt_transport_send();
+    queued = g_transportHead - g_transportTail;
+    ZZT_UNLOCK_(&g_transportLock);
+
+    return queued;
+}
+
+#endif
+
+/******************************************************************************/
+
+#if defined(ZZT_HAS_DEATH_TEST)
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+/**
+ * @brief Take every lock a death test child can reach, in the order they
+ *        nest elsewhere, so a fork under --jobs can't copy one held by
+ *        another worker into the child.  g_asyncLock is left out, as this
+ *        thread may hold it, and the child never takes it.
+ */
+static void
+zzt_fork_lock(void)
+{
+    ZZT_LOCK_(&g_jobsLock);
+    ZZT_LOCK_(&g_printLock);
+#if defined(ZZTEST_CONFIG_WIRE)
+    ZZT_LOCK_(&g_wireLock);
+#endif
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+    ZZT_LOCK_(&g_transportLock);
+#endif
+    ZZT_LOCK_(&g_threadLock);
+}
+
+/**
+ * @brief Release the locks of zzt_fork_lock, in the parent and the child.
+ */
+static void
+zzt_fork_unlock(void)
+{
+    ZZT_UNLOCK_(&g_threadLock);
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+    ZZT_UNLOCK_(&g_transportLock);
+#endif
+#if defined(ZZTEST_CONFIG_WIRE)
+    ZZT_UNLOCK_(&g_wireLock);
+#endif
+    ZZT_UNLOCK_(&g_printLock);
+    ZZT_UNLOCK_(&g_jobsLock);
+}
+
+#endif /* defined(ZZTEST_CONFIG_THREADS) */
+
+ZZT_BOOL
+zzt_death_fork(struct zzt_death_s *death)
+{
+    int errPipe[2], statusPipe[2];
+
+    death->pid = -1;
+    death->errfd = -1;
+    death->statusfd = -1;
+
+    if (pipe(errPipe) != 0) {
+        return ZZT_FALSE;
+    } else if (pipe(statusPipe) != 0) {
+        close(errPipe[0]);
+        close(errPipe[1]);
+        return ZZT_FALSE;
+    }
+
+    /* Anything still buffered would be written twice. */
+    fflush(stdout);
+    fflush(stderr);
+#if defined(ZZTEST_CONFIG_WIRE)
+    zzt_wire_flush();
+#endif
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+    zzt_transport_flush();
+#endif
+
+#if defined(ZZTEST_CONFIG_THREADS)
+    zzt_fork_lock();
+    death->pid = (int)fork();
+    zzt_fork_unlock();
+#else
+    death->pid = (int)fork();
+#endif
+    if (death->pid == 0) {
+        close(errPipe[0]);
+        close(statusPipe[0]);
+        dup2(errPipe[1], 2);
+        close(errPipe[1]);
+        death->statusfd = statusPipe[1];
+        g_deathChildFd = statusPipe[1];
+        return ZZT_TRUE;
+    }
+
+    close(errPipe[1]);
+    close(statusPipe[1]);
+    if (death->pid < 0) {
+        close(errPipe[0]);
+        close(statusPipe[0]);
+        return ZZT_FALSE;
+    }
+
+    death->errfd = errPipe[0];
+    death->statusfd = statusPipe[0];
+    return ZZT_FALSE;
+}
+
+/******************************************************************************/
+
+void
+zzt_death_returned(struct zzt_death_s *death)
+{
+    char returned = 'R';
+
+    fflush(stdout);
+    fflush(stderr);
+    if (write(death->statusfd, &returned, 1) != 1) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+/**
+ * @brief Wait for a death test pipe to be readable or hang up, until the
+ *        deadline passes.
+ *
+ * @return False if the deadline passed first.
+ */
+static ZZT_BOOL
+zzt_death_wait(int fd, unsigned long deadline)
+{
+    struct pollfd pfd;
+    long left = 0;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for (;;) {
+        left = (long)(deadline - zzt_ms());
+        pfd.revents = 0;
+        switch (poll(&pfd, 1, left > 0 ? (int)left : 0)) {
+        case 0: return ZZT_FALSE;
+        case 1: return ZZT_TRUE;
+        default: break; /* Interrupted, wait for what's left. */
+        }
+    }
+}
+
+/******************************************************************************/
+
+ZZT_BOOL
+zzt_death_check(struct zzt_test_state_s *state, struct zzt_death_s *death,
+    int pred, const char *pattern, const char *stmt, const char *file,
+    unsigned long line)
+{
+    char errbuf[1024];
+    char msg[1536];
+    char status[64];
+    char returned = '\0';
+    unsigned long errlen = 0;
+    unsigned long deadline = zzt_ms() + ZZTEST_CONFIG_DEATH_TIMEOUT;
+    int wstatus = 0;
+    ZZT_BOOL matched = ZZT_FALSE, alive = ZZT_TRUE;
+
+    if (death->pid < 0) {
+        zzt_fail(state, file, line, "Death test: could not fork");
+        return ZZT_FALSE;
+    }
+
+    /* Drain stderr to EOF, keeping what fits. */
+    while ((alive = zzt_death_wait(death->errfd, deadline)) != ZZT_FALSE) {
+        char scratch[256];
+        long got = (long)read(death->errfd, scratch, sizeof(scratch));
+        if (got <= 0) {
+            break;
+        } else if (errlen + got >= sizeof(errbuf)) {
+            got = (long)(sizeof(errbuf) - errlen - 1);
+        }
+
+        memcpy(errbuf + errlen, scratch, got);
+        errlen += got;
+    }
+    errbuf[errlen] = '\0';
+
+    if (alive) {
+        alive = zzt_death_wait(death->statusfd, deadline);
+    }
+    if (!alive || read(death->statusfd, &returned, 1) != 1) {
+        returned = '\0';
+    }
+
+    close(death->errfd);
+    close(death->statusfd);
+    if (!alive) {
+        kill(death->pid, SIGKILL);
+        waitpid(death->pid, &wstatus, 0);
+        zzt_sprintf(msg, sizeof(msg),
+            "Death test: %s\n    Result: still running after %lu ms, "
+            "killed.\n Error msg:\n%s",
+            stmt, (unsigned long)ZZTEST_CONFIG_DEATH_TIMEOUT, errbuf);
+        zzt_fail(state, file, line, msg);
+        return ZZT_FALSE;
+    }
+    waitpid(death->pid, &wstatus, 0);
+
+    if (WIFEXITED(wstatus)) {
+        zzt_sprintf(status, sizeof(status), "exited with code %d",
+            WEXITSTATUS(wstatus));
+    } else if (WIFSIGNALED(wstatus)) {
+        zzt_sprintf(status, sizeof(status), "killed by signal %d",
+            WTERMSIG(wstatus));
+    } else {
+        zzt_sprintf(status, sizeof(status), "ended with status %d", wstatus);
+    }
+
+    if (returned == 'R') {
+        zzt_sprintf(msg, sizeof(msg),
+            "Death test: %s\n    Result: failed to die.\n Error msg:\n%s",
+            stmt, errbuf);
+        zzt_fail(state, file, line, msg);
+        return ZZT_FALSE;
+    }
+
+    if (pred == ZZT_DIED) {
+        matched = (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) != 0) ||
+                  WIFSIGNALED(wstatus);
+    } else if (pred >= 0) {
+        matched = WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == pred;
+    } else {
+        matched = WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == -pred;
+    }
+
+    if (!matched) {
+        zzt_sprintf(msg, sizeof(msg),
+            "Death test: %s\n    Result: died but not as expected, %s.\n"
+            " Error msg:\n%s",
+            stmt, status, errbuf);
+        zzt_fail(state, file, line, msg);
+        return ZZT_FALSE;
+    }
+
+    if (pattern != NULL && pattern[0] != '\0') {
+        regex_t re;
+
+        if (regcomp(&re, pattern, REG_EXTENDED | REG_NOSUB) != 0) {
+            zzt_sprintf(msg, sizeof(msg),
+                "Death test: %s\n    Result: invalid regex \"%s\".", stmt,
+                pattern);
+            zzt_fail(state, file, line, msg);
+            return ZZT_FALSE;
+        }
+
+        matched = regexec(&re, errbuf, 0, NULL, 0) == 0;
+        regfree(&re);
+        if (!matched) {
+            zzt_sprintf(msg, sizeof(msg),
+                "Death test: %s\n    Result: %s, but stderr did not match "
+                "\"%s\".\n Error msg:\n%s",
+                stmt, status, pattern, errbuf);
+            zzt_fail(state, file, line, msg);
+            return ZZT_FALSE;
+        }
+    }
+
+    zzt_pass(state);
+    return ZZT_TRUE;
+}
+
+#endif /* defined(ZZT_HAS_DEATH_TEST) */
+
+/******************************************************************************/
+
+#define ZZT_U32_(x) ((x) & 0xFFFFFFFFUL)
+#define ZZT_ROTL32_(x, k) ZZT_U32_(((x) << (k)) | (ZZT_U32_(x) >> (32 - (k))))
+
+/**
+ * @brief Seed a property's generator, xoshiro128** seeded by splitmix32.
+ */
+static void
+zzt_prop_seed(struct zzt_prop_s *prop, unsigned long seed)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        unsigned long z = ZZT_U32_(seed += 0x9E3779B9UL);
+        z = ZZT_U32_((z ^ (z >> 16)) * 0x85EBCA6BUL);
+        z = ZZT_U32_((z ^ (z >> 13)) * 0xC2B2AE35UL);
+        prop->rng[i] = z ^ (z >> 16);
+    }
+}
+
+/**
+ * @brief Return 32 random bits.
+ */
+static unsigned long
+zzt_prop_rand(struct zzt_prop_s *prop)
+{
+    unsigned long *s = prop->rng;
+    unsigned long result = ZZT_U32_(ZZT_ROTL32_(ZZT_U32_(s[1] * 5), 7) * 9);
+    unsigned long t = ZZT_U32_(s[1] << 9);
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = ZZT_ROTL32_(s[3], 11);
+    return result;
+}
+
+/**
+ * @brief Make one choice in [0, bound].  Generated choices favor the ends
+ *        of the range, replayed choices are clamped to it.
+ */
+static ZZT_UINTMAX
+zzt_prop_draw(struct zzt_prop_s *prop, ZZT_UINTMAX bound)
+{
+    ZZT_UINTMAX value = 0;
+
+    if (prop->replay) {
+        if (prop->numChoices < prop->replayLen) {
+            value = prop->choices[prop->numChoices];
+            if (value > bound) {
+                value = bound;
+            }
+        }
+    } else {
+        unsigned long r = zzt_prop_rand(prop);
+        if ((r & 15) == 0) {
+            value = 0;
+        } else if ((r & 15) == 1) {
+            value = bound;
+        } else {
+            value = zzt_prop_rand(prop);
+            if (bound > 0xFFFFFFFFUL) {
+                value = ((value << 16) << 16) | zzt_prop_rand(prop);
+            }
+            if (bound != (ZZT_UINTMAX)-1) {
+                value %= bound + 1;
+            }
+        }
+    }
+
+    if (prop->numChoices < prop->maxChoices) {
+        prop->choices[prop->numChoices] = value;
+        prop->numChoices += 1;
+    } else {
+        prop->overrun = ZZT_TRUE;
+    }
+    return value;
+}
+
+/**
+ * @brief Take len bytes from the property's scratch space.
+ */
+static unsigned char *
+zzt_prop_alloc(struct zzt_prop_s *prop, unsigned long len)
+{
+    unsigned char *ptr = prop->data + prop->dataUsed;
+    if (len > prop->dataLen - prop->dataUsed) {
+        prop->overrun = ZZT_TRUE;
+        return NULL;
+    }
+
+    prop->dataUsed += len;
+    return ptr;
+}
+
+/**
+ * @brief Run a property once against a scratch state.
+ *
+ * @return True if the property failed.
+ */
+static ZZT_BOOL
+zzt_prop_once(struct zzt_prop_s *prop, zzt_propfunc func)
+{
+    struct zzt_test_state_s scratch;
+
+    memset(&scratch, 0, sizeof(scratch));
+    prop->numChoices = 0;
+    prop->dataUsed = 0;
+    prop->numGens = 0;
+    prop->overrun = ZZT_FALSE;
+
+    g_quiet += 1;
+    func(&scratch, prop);
+    g_quiet -= 1;
+#if defined(ZZTEST_CONFIG_THREADS)
+    zzt_thread_collect(&scratch);
+#endif
+
+    return scratch.failed != 0 && !prop->overrun;
+}
+
+/**
+ * @brief Replay a candidate in prop->choices, keeping it if it still fails
+ *        and is smaller than the best so far.  Fewer choices are smaller,
+ *        then the first differing choice decides.
+ *
+ * @return True if the candidate was kept.
+ */
+static ZZT_BOOL
+zzt_prop_try(struct zzt_prop_s *prop, zzt_propfunc func, unsigned long len,
+    unsigned long *bestLen)
+{
+    unsigned long i = 0;
+
+    prop->replay = ZZT_TRUE;
+    prop->replayLen = len;
+    if (!zzt_prop_once(prop, func) || prop->numChoices > *bestLen) {
+        return ZZT_FALSE;
+    }
+
+    if (prop->numChoices == *bestLen) {
+        while (i < *bestLen && prop->choices[i] == prop->best[i]) {
+            i += 1;
+        }
+        if (i == *bestLen || prop->choices[i] > prop->best[i]) {
+            return ZZT_FALSE;
+        }
+    }
+
+    memcpy(prop->best, prop->choices, prop->numChoices * sizeof(ZZT_UINTMAX));
+    *bestLen = prop->numChoices;
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Shrink the failing choices in prop->best.
+ *
+ * @return Number of smaller failing inputs found.
+ */
+static unsigned long
+zzt_prop_shrink(struct zzt_prop_s *prop, zzt_propfunc func,
+    unsigned long *bestLen, unsigned long budget)
+{
+    unsigned long shrinks = 0, attempts = 0, i = 0, size = 0;
+    ZZT_BOOL improved = ZZT_TRUE;
+
+#define TRY_(len) (attempts++, zzt_prop_try(prop, func, len, bestLen))
+
+    while (improved && attempts < budget) {
+        improved = ZZT_FALSE;
+
+        /* Delete runs of choices, which shortens buffers and strings. */
+        for (size = 8; size > 0; size /= 2) {
+            for (i = 0; i + size <= *bestLen && attempts < budget;) {
+                memcpy(prop->choices, prop->best, i * sizeof(ZZT_UINTMAX));
+                memcpy(prop->choices + i, prop->best + i + size,
+                    (*bestLen - i - size) * sizeof(ZZT_UINTMAX));
+                if (TRY_(*bestLen - size)) {
+                    shrinks += 1;
+                    improved = ZZT_TRUE;
+                } else {
+                    i += 1;
+                }
+            }
+        }
+
+        /* Binary search each choice toward zero. */
+        for (i = 0; i < *bestLen && attempts < budget; i++) {
+            ZZT_UINTMAX lo = 0, hi = prop->best[i];
+            while (lo < hi && i < *bestLen && attempts < budget) {
+                ZZT_UINTMAX mid = lo + (hi - lo) / 2;
+
+                memcpy(prop->choices, prop->best,
+                    *bestLen * sizeof(ZZT_UINTMAX));
+                prop->choices[i] = mid;
+                if (TRY_(*bestLen)) {
+                    shrinks += 1;
+                    improved = ZZT_TRUE;
+                    hi = i < *bestLen ? prop->best[i] : 0;
+                } else {
+                    lo = mid + 1;
+                }
+            }
+
+            /* Neighbors can fail where the midpoints passed, as when
+             * zigzagged integers alternate sign. */
+            for (size = 1; size <= 2 && i < *bestLen; size++) {
+                if (prop->best[i] >= size && attempts < budget) {
+                    memcpy(prop->choices, prop->best,
+                        *bestLen * sizeof(ZZT_UINTMAX));
+                    prop->choices[i] -= size;
+                    if (TRY_(*bestLen)) {
+                        shrinks += 1;
+                        improved = ZZT_TRUE;
+                    }
+                }
+            }
+        }
+    }
+
+#undef TRY_
+    return shrinks;
+}
+
+/******************************************************************************/
+
+void
+zzt_prop_run(struct zzt_test_state_s *state, zzt_propfunc func, void *arena,
+    unsigned long arenalen, unsigned long runs, unsigned long seed)
+{
+    struct zzt_prop_s prop;
+    unsigned char *base = (unsigned char *)arena;
+    unsigned long align = 0, run = 0, bestLen = 0, shrinks = 0;
+    const char *env = getenv("ZZTEST_PROP_SEED");
+    int failed = 0;
+
+    if (env != NULL) {
+        seed = strtoul(env, NULL, 0);
+    }
+
+    /* Quarter each for choices and best, the rest for generated data. */
+    align = (unsigned long)((size_t)base % sizeof(ZZT_UINTMAX));
+    if (align != 0) {
+        align = sizeof(ZZT_UINTMAX) - align;
+    }
+    base += align;
+    arenalen = arenalen > align ? arenalen - align : 0;
+
+    memset(&prop, 0, sizeof(prop));
+    prop.maxChoices = arenalen / 4 / sizeof(ZZT_UINTMAX);
+    prop.choices = (ZZT_UINTMAX *)base;
+    prop.best = prop.choices + prop.maxChoices;
+    prop.data = (unsigned char *)(prop.best + prop.maxChoices);
+    prop.dataLen = arenalen - 2 * prop.maxChoices * sizeof(ZZT_UINTMAX);
+    zzt_prop_seed(&prop, seed);
+
+    for (run = 1; run <= runs; run++) {
+        prop.replay = ZZT_FALSE;
+        if (zzt_prop_once(&prop, func)) {
+            break;
+        } else if (prop.overrun) {
+            zzt_fail(state, __FILE__, __LINE__,
+                "Property arena exhausted, use a larger arena");
+            return;
+        }
+    }
+
+    if (run > runs) {
+        zzt_pass(state);
+        return;
+    }
+
+    bestLen = prop.numChoices;
+    memcpy(prop.best, prop.choices, bestLen * sizeof(ZZT_UINTMAX));
+    shrinks = zzt_prop_shrink(&prop, func, &bestLen, 100 * bestLen + 1000);
+
+    /* Replay the smallest input for real, printing what was generated. */
+    ZZT_PRINTF("%s: Property falsified after %lu runs and %lu shrinks "
+               "(seed 0x%lx):\n",
+        state->test != NULL ? state->test->test_name : "property", run,
+        shrinks, seed);
+    memcpy(prop.choices, prop.best, bestLen * sizeof(ZZT_UINTMAX));
+    prop.replay = ZZT_TRUE;
+    prop.replayLen = bestLen;
+    prop.report = ZZT_TRUE;
+    prop.numChoices = 0;
+    prop.dataUsed = 0;
+    prop.numGens = 0;
+#if defined(ZZTEST_CONFIG_THREADS)
+    zzt_thread_collect(state);
+#endif
+    failed = state->failed;
+    func(state, &prop);
+#if defined(ZZTEST_CONFIG_THREADS)
+    zzt_thread_collect(state);
+#endif
+    if (state->failed == failed) {
+        zzt_fail(state, __FILE__, __LINE__,
+            "Falsifying input no longer fails, property is nondeterministic");
+    }
+}
+
+/******************************************************************************/
+
+ZZT_INTMAX
+zzt_gen_int(struct zzt_prop_s *prop, ZZT_INTMAX lo, ZZT_INTMAX hi)
+{
+    ZZT_INTMAX value = 0;
+
+    if (lo <= 0 && hi >= 0) {
+        /* Zigzag, so small choices are small magnitudes of either sign. */
+        ZZT_UINTMAX neg = (ZZT_UINTMAX)0 - (ZZT_UINTMAX)lo;
+        ZZT_UINTMAX mag = (ZZT_UINTMAX)hi > neg ? (ZZT_UINTMAX)hi : neg;
+        ZZT_UINTMAX bound = mag > ((ZZT_UINTMAX)-1) / 2 ? (ZZT_UINTMAX)-1
+                                                         : mag * 2;
+        ZZT_UINTMAX d = zzt_prop_draw(prop, bound);
+
+        if (d % 2 == 0) {
+            value = (ZZT_UINTMAX)(d / 2) > (ZZT_UINTMAX)hi ? hi
+                                                            : (ZZT_INTMAX)(d / 2);
+        } else {
+            value = d / 2 + 1 > neg ? lo : -(ZZT_INTMAX)(d / 2) - 1;
+        }
+    } else if (lo > 0) {
+        value = lo + (ZZT_INTMAX)zzt_prop_draw(
+                         prop, (ZZT_UINTMAX)hi - (ZZT_UINTMAX)lo);
+    } else {
+        value = hi - (ZZT_INTMAX)zzt_prop_draw(
+                         prop, (ZZT_UINTMAX)hi - (ZZT_UINTMAX)lo);
+    }
+
+    if (prop->report) {
+        ZZT_PRINTF("  #%lu = %" ZZT_PRIiMAX "\n", prop->numGens, value);
+    }
+    prop->numGens += 1;
+    return value;
+}
+
+/******************************************************************************/
+
+ZZT_UINTMAX
+zzt_gen_uint(struct zzt_prop_s *prop, ZZT_UINTMAX lo, ZZT_UINTMAX hi)
+{
+    ZZT_UINTMAX value = lo + zzt_prop_draw(prop, hi - lo);
+
+    if (prop->report) {
+        ZZT_PRINTF("  #%lu = %" ZZT_PRIuMAX "\n", prop->numGens, value);
+    }
+    prop->numGens += 1;
+    return value;
+}
+
+/******************************************************************************/
+
+unsigned char *
+zzt_gen_bytes(struct zzt_prop_s *prop, unsigned long minlen,
+    unsigned long maxlen, unsigned long *len)
+{
+    unsigned long i, count = minlen + (unsigned long)zzt_prop_draw(
+                                          prop, maxlen - minlen);
+    unsigned char *buf = zzt_prop_alloc(prop, count + 1);
+
+    if (buf == NULL) {
+        *len = 0;
+        return prop->data;
+    }
+
+    for (i = 0; i < count; i++) {
+        buf[i] = (unsigned char)zzt_prop_draw(prop, 0xFF);
+    }
+    buf[count] = 0;
+    *len = count;
+
+    if (prop->report) {
+        char hex[16 * 6 + 8];
+        char *w = hex;
+        for (i = 0; i < count && i < 16; i++) {
+            zzt_sprintf(w, 7, "%s0x%02x", i ? ", " : "", buf[i]);
+            w += strlen(w);
+        }
+        zzt_sprintf(w, 8, "%s", count > 16 ? ", ..." : "");
+        ZZT_PRINTF("  #%lu = { %s } (%lu bytes)\n", prop->numGens, hex, count);
+    }
+    prop->numGens += 1;
+    return buf;
+}
+
+/******************************************************************************/
+
+char *
+zzt_gen_str(struct zzt_prop_s *prop, unsigned long minlen, unsigned long maxlen)
+{
+    unsigned long i, count = minlen + (unsigned long)zzt_prop_draw(
+                                          prop, maxlen - minlen);
+    char *str = (char *)zzt_prop_alloc(prop, count + 1);
+
+    if (str == NULL) {
+        return (char *)"";
+    }
+
+    for (i = 0; i < count; i++) {
+        str[i] = (char)(' ' + zzt_prop_draw(prop, '~' - ' '));
+    }
+    str[count] = '\0';
+
+    if (prop->report) {
+        char buf[128];
+        zzt_stringify(buf, sizeof(buf), str);
+        ZZT_PRINTF("  #%lu = %s\n", prop->numGens, buf);
+    }
+    prop->numGens += 1;
+    return str;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Run a fuzz test body against one corpus file.
+ */
+static void
+zzt_fuzz_file(
+    struct zzt_test_state_s *state, zzt_fuzzfunc func, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    unsigned char *data = NULL;
+    long len = 0;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0 ||
+        (len = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        zzt_fail(state, path, 0, "Could not read corpus input");
+        if (file != NULL) {
+            fclose(file);
+        }
+        return;
+    }
+
+    /* Exactly sized, so sanitizers catch reads past the end. */
+    data = (unsigned char *)malloc(len > 0 ? (size_t)len : 1);
+    if (data == NULL || fread(data, 1, (size_t)len, file) != (size_t)len) {
+        zzt_fail(state, path, 0, "Could not read corpus input");
+    } else {
+        zzt_trace_push();
+        zzt_scoped_trace("Corpus input: %s", path);
+        func(state, data, (unsigned long)len);
+        zzt_trace_pop();
+    }
+
+    free(data);
+    fclose(file);
+}
+
+/******************************************************************************/
+
+void
+zzt_fuzz_replay(struct zzt_test_state_s *state, zzt_fuzzfunc func,
+    const char *corpus, const char *name)
+{
+    char path[1024];
+    const char *env = getenv("ZZTEST_FUZZ_CORPUS");
+#if defined(_WIN32)
+    WIN32_FIND_DATAA find;
+    HANDLE dir = INVALID_HANDLE_VALUE;
+#elif defined(ZZT_DIRENT_)
+    DIR *dir = NULL;
+    struct dirent *entry = NULL;
+    struct stat st;
+#endif
+
+    if (env != NULL) {
+        corpus = env;
+    }
+
+    /* libFuzzer always tries the empty input first, so do we. */
+    func(state, (const unsigned char *)"", 0);
+
+#if defined(_WIN32)
+    zzt_sprintf(path, sizeof(path), "%s\\%s\\*", corpus, name);
+    dir = FindFirstFileA(path, &find);
+    if (dir == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    do {
+        if (find.cFileName[0] == '.' ||
+            (find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            continue;
+        }
+
+        zzt_sprintf(
+            path, sizeof(path), "%s\\%s\\%s", corpus, name, find.cFileName);
+        zzt_fuzz_file(state, func, path);
+    } while (FindNextFileA(dir, &find));
+    FindClose(dir);
+#elif defined(ZZT_DIRENT_)
+    zzt_sprintf(path, sizeof(path), "%s/%s", corpus, name);
+    dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        zzt_sprintf(path, sizeof(path), "%s/%s/%s", corpus, name, entry->d_name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            zzt_fuzz_file(state, func, path);
+        }
+    }
+    closedir(dir);
+#else
+    /* No portable way to list a directory, so only the empty input. */
+    (void)path;
+    (void)name;
+#endif
+}
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_FUZZER)
+
+void
+zzt_fuzz_register(struct zzt_fuzz_target_s *target)
+{
+    target->next = g_fuzzTargets;
+    g_fuzzTargets = target;
+}
+
+/**
+ * @brief Pick the target named by ZZTEST_FUZZ_TARGET, or the only target.
+ */
+static struct zzt_fuzz_target_s *
+zzt_fuzz_select(void)
+{
+    struct zzt_fuzz_target_s *target = g_fuzzTargets;
+    const char *name = getenv("ZZTEST_FUZZ_TARGET");
+
+    for (; target != NULL; target = target->next) {
+        if (name != NULL && !strcmp(name, target->name)) {
+            return target;
+        }
+    }
+
+    if (name == NULL && g_fuzzTargets != NULL && g_fuzzTargets->next == NULL) {
+        return g_fuzzTargets;
+    }
+
+    ZZT_PRINTF("error: Set ZZTEST_FUZZ_TARGET to one of:\n");
+    for (target = g_fuzzTargets; target != NULL; target = target->next) {
+        ZZT_PRINTF("  %s\n", target->name);
+    }
+    exit(1);
+    return NULL;
+}
+
+int
+LLVMFuzzerTestOneInput(const unsigned char *data, size_t size);
+
+/******************************************************************************/
+
+int
+LLVMFuzzerTestOneInput(const unsigned char *data, size_t size)
+{
+    struct zzt_test_state_s state;
+
+    if (g_fuzzTarget == NULL) {
+        g_fuzzTarget = zzt_fuzz_select();
+    }
+
+    memset(&state, 0, sizeof(state));
+    zzt_trace_reset();
+    g_fuzzing = 1;
+    g_fuzzTarget->func(&state, data, (unsigned long)size);
+    g_fuzzing = 0;
+    return 0;
+}
+
+#endif /* defined(ZZTEST_CONFIG_FUZZER) */
+
+/******************************************************************************/
+
+/**
+ * @brief Hash a string, FNV-1a.
+ */
+static unsigned long
+zzt_hash_str(const char *name)
+{
+    unsigned long hash = 2166136261UL;
+    for (; *name != '\0'; name++) {
+        hash = ((hash ^ (unsigned char)*name) * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Read a whole file into a NUL-terminated buffer.
+ */
+static char *
+zzt_file_read(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    char *text = NULL;
+    long len = 0;
+
+    if (file == NULL) {
+        return NULL;
+    }
+
+    if (fseek(file, 0, SEEK_END) == 0 && (len = ftell(file)) >= 0 &&
+        fseek(file, 0, SEEK_SET) == 0) {
+        text = (char *)malloc((size_t)len + 1);
+        if (text != NULL && fread(text, 1, (size_t)len, file) == (size_t)len) {
+            text[len] = '\0';
+        } else {
+            free(text);
+            text = NULL;
+        }
+    }
+
+    fclose(file);
+    return text;
+}
+
+/**
+ * @brief Split the next line out of *text.
+ */
+static char *
+zzt_split_line(char **text)
+{
+    char *line = *text;
+
+    if (*line == '\0') {
+        return NULL;
+    }
+
+    while (**text != '\0' && **text != '\n') {
+        *text += 1;
+    }
+    if (**text == '\n') {
+        **text = '\0';
+        *text += 1;
+    }
+    return line;
+}
+
+/**
+ * @brief Split the next whitespace separated token out of *line.
+ */
+static char *
+zzt_split_token(char **line)
+{
+    char *start = *line;
+
+    while (*start == ' ' || *start == '\t' || *start == '\r') {
+        start++;
+    }
+    if (*start == '\0') {
+        *line = start;
+        return NULL;
+    }
+
+    *line = start;
+    while (**line != '\0' && **line != ' ' && **line != '\t' && **line != '\r') {
+        *line += 1;
+    }
+    if (**line != '\0') {
+        **line = '\0';
+        *line += 1;
+    }
+    return start;
+}
+
+/**
+ * @brief Check whether a set contains a string.
+ */
+static ZZT_BOOL
+zzt_names_has(const struct zzt_names_s *set, const char *name)
+{
+    unsigned long slot = 0;
+
+    if (set->cap == 0) {
+        return ZZT_FALSE;
+    }
+
+    slot = zzt_hash_str(name) & (set->cap - 1);
+    for (; set->slots[slot] != NULL; slot = (slot + 1) & (set->cap - 1)) {
+        if (!strcmp(set->slots[slot], name)) {
+            return ZZT_TRUE;
+        }
+    }
+    return ZZT_FALSE;
+}
+
+/**
+ * @brief Add a string to a set.  The string is not copied.
+ */
+static void
+zzt_names_add(struct zzt_names_s *set, const char *name)
+{
+    unsigned long i = 0, slot = 0;
+
+    if (zzt_names_has(set, name)) {
+        return;
+    }
+
+    if (set->count * 2 >= set->cap) {
+        unsigned long cap = set->cap ? set->cap * 2 : 256;
+        const char **slots = (const char **)calloc(cap, sizeof(*slots));
+        if (slots == NULL) {
+            return;
+        }
+
+        for (i = 0; i < set->cap; i++) {
+            if (set->slots[i] != NULL) {
+                slot = zzt_hash_str(set->slots[i]) & (cap - 1);
+                while (slots[slot] != NULL) {
+                    slot = (slot + 1) & (cap - 1);
+                }
+                slots[slot] = set->slots[i];
+            }
+        }
+
+        free((void *)set->slots);
+        set->slots = slots;
+        set->cap = cap;
+    }
+
+    slot = zzt_hash_str(name) & (set->cap - 1);
+    while (set->slots[slot] != NULL) {
+        slot = (slot + 1) & (set->cap - 1);
+    }
+    set->slots[slot] = name;
+    set->count += 1;
+}
+
+/**
+ * @brief Empty a set.
+ */
+static void
+zzt_names_free(struct zzt_names_s *set)
+{
+    free((void *)set->slots);
+    set->slots = NULL;
+    set->cap = 0;
+    set->count = 0;
+}
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_WIRE)
+
+#define ZZT_WIRE_MASK_ (ZZTEST_CONFIG_WIRE_STRINGS - 1)
+#define ZZT_WIRE_TEXT_MAX_ 512 /* Longer strings are cut short. */
+#define ZZT_WIRE_EVENT_ (ZZT_FRAME_PAYLOAD_MAX - sizeof(ZZT_WIRE_MAGIC))
+
+/* String already sent, keyed by two hashes of its text. */
+struct zzt_wire_string_s {
+    unsigned long hash;
+    unsigned long check;
+    unsigned long id; /* ID plus one, zero if the slot is empty. */
+};
+
+/* Event being encoded. */
+struct zzt_wire_event_s {
+    unsigned char buf[ZZT_WIRE_EVENT_];
+    unsigned long len;
+};
+
+/*
+ * Events are buffered until a test finishes, then written out in one go, or
+ * sent as one frame with ZZTEST_CONFIG_TRANSPORT.
+ */
+static struct zzt_wire_string_s g_wireStrings[ZZTEST_CONFIG_WIRE_STRINGS];
+static unsigned long g_wireCount;
+static unsigned char g_wireBuf[ZZT_FRAME_PAYLOAD_MAX];
+static unsigned long g_wireLen;
+static ZZT_BOOL g_wireStarted;
+
+/**
+ * @brief Write out buffered events.  Caller holds g_wireLock.
+ */
+static void
+zzt_wire_send(void)
+{
+    if (g_wireLen == 0) {
+        return;
+    }
+
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+    ZZT_LOCK_(&g_transportLock);
+    zzt_transport_put((const char *)g_wireBuf, g_wireLen);
+    ZZT_UNLOCK_(&g_transportLock);
+#else
+    fwrite(g_wireBuf, 1, g_wireLen, stdout);
+    fflush(stdout);
+#endif
+    g_wireLen = 0;
+}
+
+/**
+ * @brief Write out buffered events, used between tests and before forking.
+ */
+static void
+zzt_wire_flush(void)
+{
+    ZZT_LOCK_(&g_wireLock);
+    zzt_wire_send();
+    ZZT_UNLOCK_(&g_wireLock);
+}
+
+/**
+ * @brief Buffer an encoded event.  Caller holds g_wireLock.
+ */
+static void
+zzt_wire_emit(const struct zzt_wire_event_s *event)
+{
+    if (!g_wireStarted) {
+#if defined(_WIN32) && !defined(ZZTEST_CONFIG_TRANSPORT)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        memcpy(g_wireBuf, ZZT_WIRE_MAGIC, sizeof(ZZT_WIRE_MAGIC) - 1);
+        g_wireLen = sizeof(ZZT_WIRE_MAGIC) - 1;
+        g_wireStarted = ZZT_TRUE;
+    }
+
+    if (g_wireLen + event->len > sizeof(g_wireBuf)) {
+        zzt_wire_send();
+    }
+    memcpy(g_wireBuf + g_wireLen, event->buf, event->len);
+    g_wireLen += event->len;
+}
+
+/**
+ * @brief Append a number to an event, LEB128.
+ */
+static void
+zzt_wire_number(struct zzt_wire_event_s *event, ZZT_UINTMAX u)
+{
+    for (; u >= 0x80; u >>= 7) {
+        event->buf[event->len++] = (unsigned char)((u & 0x7F) | 0x80);
+    }
+    event->buf[event->len++] = (unsigned char)u;
+}
+
+/**
+ * @brief Append a signed number to an event, zigzag encoded.
+ */
+static void
+zzt_wire_signed(struct zzt_wire_event_s *event, ZZT_INTMAX v)
+{
+    if (v < 0) {
+        zzt_wire_number(event, ((ZZT_UINTMAX)(-(v + 1)) << 1) | 1);
+    } else {
+        zzt_wire_number(event, (ZZT_UINTMAX)v << 1);
+    }
+}
+
+/**
+ * @brief Append text to an event, cut short to fit if need be.
+ */
+static void
+zzt_wire_text(struct zzt_wire_event_s *event, const char *str)
+{
+    unsigned long len = (unsigned long)strlen(str);
+    unsigned long room = sizeof(event->buf) - event->len - 3;
+
+    if (len > room) {
+        len = room;
+    }
+    zzt_wire_number(event, len);
+    memcpy(event->buf + event->len, str, len);
+    event->len += len;
+}
+
+/**
+ * @brief Find the ID of a string, sending the string first if it's new.
+ *        Caller holds g_wireLock and has checked there's room.
+ *
+ * @return ID of the string plus one.
+ */
+static unsigned long
+zzt_wire_intern(const char *str)
+{
+    struct zzt_wire_event_s event;
+    unsigned long hash = zzt_hash_str(str), check = 5381, i = 0;
+    const char *cur = str;
+
+    for (; *cur != '\0'; cur++) {
+        check = ((check * 33) ^ (unsigned char)*cur) & 0xFFFFFFFFUL;
+    }
+    check ^= (unsigned long)(cur - str);
+
+    i = hash & ZZT_WIRE_MASK_;
+    for (; g_wireStrings[i].id != 0; i = (i + 1) & ZZT_WIRE_MASK_) {
+        if (g_wireStrings[i].hash == hash && g_wireStrings[i].check == check) {
+            return g_wireStrings[i].id;
+        }
+    }
+
+    event.len = 0;
+    event.buf[event.len++] = ZZT_WIRE_STRING;
+    if (cur - str > ZZT_WIRE_TEXT_MAX_) {
+        char cut[ZZT_WIRE_TEXT_MAX_ + 1];
+        memcpy(cut, str, ZZT_WIRE_TEXT_MAX_);
+        cut[ZZT_WIRE_TEXT_MAX_] = '\0';
+        zzt_wire_text(&event, cut);
+    } else {
+        zzt_wire_text(&event, str);
+    }
+    zzt_wire_emit(&event);
+
+    g_wireStrings[i].hash = hash;
+    g_wireStrings[i].check = check;
+    g_wireStrings[i].id = ++g_wireCount;
+    return g_wireCount;
+}
+
+/**
+ * @brief ZZT_PRINTF with ZZTEST_CONFIG_WIRE, sending the format string and
+ *        arguments instead of the text they make.
+ *
+ * @param fmt Format string.
+ * @param ... Format parameters.
+ */
+static int
+zzt_wire_printf(const char *fmt, ...)
+{
+    struct zzt_wire_event_s event;
+    enum zzt_targ_e type = ZZT_TARG_NONE;
+    const char *cur = fmt;
+    unsigned long strings = 1, args = 0;
+    int stars = 0;
+    va_list va;
+    va_start(va, fmt);
+
+    /* Count first, as anything we can't encode is sent as text instead. */
+    while ((cur = strchr(cur, '%')) != NULL) {
+        const char *start = cur;
+        cur = zzt_trace_spec(cur + 1, &type, &stars);
+        strings += type == ZZT_TARG_STR;
+        args += stars + 1;
+        if (type == ZZT_TARG_BAD ||
+            ((type == ZZT_TARG_DOUBLE || type == ZZT_TARG_LDOUBLE) &&
+                (stars != 0 || cur - start > 31))) {
+            break;
+        }
+    }
+
+    ZZT_LOCK_(&g_wireLock);
+    event.len = 0;
+    if (cur != NULL || args > 12 ||
+        g_wireCount + strings > ZZTEST_CONFIG_WIRE_STRINGS / 4 * 3) {
+        char text[ZZT_PRINT_BUFFER_];
+        zzt_vsprintf(text, sizeof(text), fmt, va);
+        event.buf[event.len++] = ZZT_WIRE_TEXT;
+        zzt_wire_text(&event, text);
+        zzt_wire_emit(&event);
+        ZZT_UNLOCK_(&g_wireLock);
+        va_end(va);
+        return 0;
+    }
+
+    event.buf[event.len++] = ZZT_WIRE_PRINT;
+    zzt_wire_number(&event, zzt_wire_intern(fmt) - 1);
+    for (cur = fmt; (cur = strchr(cur, '%')) != NULL;) {
+        const char *start = cur;
+        cur = zzt_trace_spec(cur + 1, &type, &stars);
+        for (; stars > 0; stars--) {
+            zzt_wire_signed(&event, va_arg(va, int));
+        }
+
+        switch (type) {
+        case ZZT_TARG_INT:
+            if (*(cur - 1) == 'c') {
+                event.buf[event.len++] = (unsigned char)va_arg(va, int);
+            } else {
+                zzt_wire_signed(&event, va_arg(va, int));
+            }
+            break;
+        case ZZT_TARG_LONG: zzt_wire_signed(&event, va_arg(va, long)); break;
+        case ZZT_TARG_MAX:
+            zzt_wire_signed(&event, va_arg(va, ZZT_INTMAX));
+            break;
+        case ZZT_TARG_SIZE:
+        case ZZT_TARG_USIZE:
+            zzt_wire_number(&event, va_arg(va, size_t));
+            break;
+        case ZZT_TARG_UINT:
+            zzt_wire_number(&event, va_arg(va, unsigned));
+            break;
+        case ZZT_TARG_ULONG:
+            zzt_wire_number(&event, va_arg(va, unsigned long));
+            break;
+        case ZZT_TARG_UMAX:
+            zzt_wire_number(&event, va_arg(va, ZZT_UINTMAX));
+            break;
+        case ZZT_TARG_PTR:
+            zzt_wire_number(&event, (size_t)va_arg(va, void *));
+            break;
+        case ZZT_TARG_DOUBLE:
+        case ZZT_TARG_LDOUBLE: {
+            char spec[32], text[64];
+            memcpy(spec, start, (size_t)(cur - start));
+            spec[cur - start] = '\0';
+            if (type == ZZT_TARG_LDOUBLE) {
+                zzt_sprintf(text, sizeof(text), spec, va_arg(va, long double));
+            } else {
+                zzt_sprintf(text, sizeof(text), spec, va_arg(va, double));
+            }
+            zzt_wire_text(&event, text);
+            break;
+        }
+        case ZZT_TARG_STR: {
+            const char *str = va_arg(va, const char *);
+            zzt_wire_number(&event, zzt_wire_intern(str ? str : "(null)") - 1);
+            break;
+        }
+        default: break;
+        }
+    }
+
+    zzt_wire_emit(&event);
+    ZZT_UNLOCK_(&g_wireLock);
+    va_end(va);
+    return 0;
+}
+
+#endif /* defined(ZZTEST_CONFIG_WIRE) */
+
+/******************************************************************************/
+
+/**
+ * @brief Identify the test binary by its size and hash, so results cached
+ *        by one build are never used by another.
+ *
+ * @return True if the binary could be read.
+ */
+static ZZT_BOOL
+zzt_cache_key(char *buf, unsigned buflen)
+{
+    unsigned char chunk[4096];
+    unsigned long hash = 2166136261UL, size = 0;
+    size_t i = 0, len = 0;
+    FILE *file = NULL;
+#if defined(_WIN32)
+    char path[MAX_PATH];
+
+    if (GetModuleFileNameA(NULL, path, sizeof(path)) != 0) {
+        file = fopen(path, "rb");
+    }
+#elif defined(__linux__)
+    file = fopen("/proc/self/exe", "rb");
+#endif
+
+    if (file == NULL && g_options.argv0 != NULL) {
+        file = fopen(g_options.argv0, "rb");
+    }
+    if (file == NULL) {
+        return ZZT_FALSE;
+    }
+
+    while ((len = fread(chunk, 1, sizeof(chunk), file)) != 0) {
+        for (i = 0; i < len; i++) {
+            hash = ((hash ^ chunk[i]) * 16777619UL) & 0xFFFFFFFFUL;
+        }
+        size += (unsigned long)len;
+    }
+
+    fclose(file);
+    zzt_sprintf(buf, buflen, "%lu-%08lx", size, hash);
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Load the names of tests that passed when the cache was written by
+ *        this same binary.  The cache is a "zztcache 1 <key>" line followed
+ *        by one test name per line.
+ */
+static void
+zzt_cache_load(const char *path)
+{
+    char header[64];
+    char *cursor = NULL, *line = NULL;
+
+    if (!zzt_cache_key(g_cacheKey, sizeof(g_cacheKey))) {
+        ZZT_PRINTF("warning: Could not read the test binary, not caching\n");
+        g_options.cache = NULL;
+        return;
+    }
+
+    g_cacheText = zzt_file_read(path);
+    cursor = g_cacheText;
+    if (cursor == NULL) {
+        return;
+    }
+
+    zzt_sprintf(header, sizeof(header), "zztcache 1 %s", g_cacheKey);
+    line = zzt_split_line(&cursor);
+    if (line == NULL || strcmp(line, header) != 0) {
+        return;
+    }
+
+    while ((line = zzt_split_line(&cursor)) != NULL) {
+        line = zzt_split_token(&line);
+        if (line != NULL) {
+            zzt_names_add(&g_cached, line);
+        }
+    }
+}
+
+/**
+ * @brief Save the names of tests that passed, in the order they're run.
+ */
+static void
+zzt_cache_save(const char *path)
+{
+    struct zzt_test_suite_s *suite = g_suitesHead;
+    struct zzt_test_s *test = NULL;
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        ZZT_PRINTF("%s: warning: Could not write test cache\n", path);
+        return;
+    }
+
+    fputs("zztcache 1 ", file);
+    fputs(g_cacheKey, file);
+    fputc('\n', file);
+    for (; suite; suite = suite->next) {
+        for (test = suite->head; test; test = test->next) {
+            if (zzt_names_has(&g_cachePassed, test->test_name)) {
+                fputs(test->test_name, file);
+                fputc('\n', file);
+            }
+        }
+    }
+
+    fclose(file);
+}
+
+/**
+ * @brief Free everything the cache owns.
+ */
+static void
+zzt_cache_close(void)
+{
+    zzt_names_free(&g_cached);
+    zzt_names_free(&g_cachePassed);
+    free(g_cacheText);
+    g_cacheText = NULL;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Copy the tail of a string that may not fit, always terminating.
+ */
+static void
+zzt_copy_tail(char *dst, size_t dstlen, const char *src)
+{
+    size_t len = strlen(src);
+
+    if (len >= dstlen) {
+        src += len - (dstlen - 1);
+        len = dstlen - 1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/**
+ * @brief Create a results log with room for capacity records.  The file is
+ *        mapped where possible, so a record costs a memcpy and survives the
+ *        runner crashing.
+ *
+ * @return True if the log was created.
+ */
+static ZZT_BOOL
+zzt_log_open(const char *path, unsigned long capacity)
+{
+    struct zzt_log_header_s header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ZZT_LOG_MAGIC, sizeof(ZZT_LOG_MAGIC));
+    header.record_size = sizeof(struct zzt_log_record_s);
+    header.capacity = capacity;
+
+    memset(&g_log, 0, sizeof(g_log));
+    g_log.size = sizeof(header) + capacity * sizeof(struct zzt_log_record_s);
+
+#if defined(_WIN32)
+    g_log.file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (g_log.file != INVALID_HANDLE_VALUE) {
+        g_log.mapping = CreateFileMappingA(
+            g_log.file, NULL, PAGE_READWRITE, 0, (DWORD)g_log.size, NULL);
+        if (g_log.mapping != NULL) {
+            g_log.header = (struct zzt_log_header_s *)MapViewOfFile(
+                g_log.mapping, FILE_MAP_WRITE, 0, 0, g_log.size);
+        }
+        if (g_log.header == NULL) {
+            if (g_log.mapping != NULL) {
+                CloseHandle(g_log.mapping);
+            }
+            CloseHandle(g_log.file);
+        }
+    }
+#elif defined(ZZT_MMAP_)
+    g_log.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (g_log.fd >= 0) {
+        /* Extend by writing the last byte, as ftruncate isn't C89 POSIX. */
+        if (lseek(g_log.fd, (off_t)g_log.size - 1, SEEK_SET) >= 0 &&
+            write(g_log.fd, "", 1) == 1) {
+            void *map = mmap(NULL, g_log.size, PROT_READ | PROT_WRITE,
+                MAP_SHARED, g_log.fd, 0);
+            if (map != MAP_FAILED) {
+                g_log.header = (struct zzt_log_header_s *)map;
+            }
+        }
+        if (g_log.header == NULL) {
+            close(g_log.fd);
+        }
+    }
+#endif
+
+    if (g_log.header != NULL) {
+        memcpy(g_log.header, &header, sizeof(header));
+        g_log.records = (struct zzt_log_record_s *)(g_log.header + 1);
+        return ZZT_TRUE;
+    }
+
+    /* No mapping, so write through stdio and flush every record. */
+    g_log.stream = fopen(path, "wb");
+    if (g_log.stream == NULL) {
+        ZZT_PRINTF("%s: warning: Could not create results log\n", path);
+        return ZZT_FALSE;
+    }
+
+    g_log.streamHeader = header;
+    g_log.header = &g_log.streamHeader;
+    fwrite(&header, sizeof(header), 1, g_log.stream);
+    fflush(g_log.stream);
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Write record number slot.  Slots past the capacity are dropped.
+ */
+static void
+zzt_log_write(unsigned long slot, const struct zzt_log_record_s *record)
+{
+    if (g_log.header == NULL || slot >= g_log.header->capacity) {
+        return;
+    }
+
+    if (slot >= g_log.header->count) {
+        g_log.header->count = slot + 1;
+    }
+
+    if (g_log.stream == NULL) {
+        memcpy(&g_log.records[slot], record, sizeof(*record));
+        return;
+    }
+
+    fseek(g_log.stream, (long)(sizeof(struct zzt_log_header_s) +
+                               slot * sizeof(struct zzt_log_record_s)),
+        SEEK_SET);
+    fwrite(record, sizeof(*record), 1, g_log.stream);
+    fseek(g_log.stream, 0, SEEK_SET);
+    fwrite(g_log.header, sizeof(*g_log.header), 1, g_log.stream);
+    fflush(g_log.stream);
+}
+
+/**
+ * @brief Fill in a record for a test.
+ */
+static void
+zzt_log_record(struct zzt_log_record_s *record, unsigned long index,
+    enum zzt_status_e status, unsigned long ms,
+    const struct zzt_test_state_s *state)
+{
+    memset(record, 0, sizeof(*record));
+    record->index = index;
+    record->status = (unsigned long)status;
+    record->ms = ms;
+    zzt_copy_tail(record->name, sizeof(record->name), state->test->test_name);
+    record->passed = (unsigned long)state->passed;
+    record->failed = (unsigned long)state->failed;
+    record->skipped = (unsigned long)state->skipped;
+    if (state->fail_file != NULL) {
+        zzt_copy_tail(record->fail_file, sizeof(record->fail_file),
+            state->fail_file);
+        record->fail_line = state->fail_line;
+    }
+}
+
+/**
+ * @brief Read the records of a results log written by an earlier run.
+ *
+ * @return Records to be freed by the caller, or NULL.
+ */
+static struct zzt_log_record_s *
+zzt_log_read(const char *path, const char *why, struct zzt_log_header_s *header)
+{
+    struct zzt_log_record_s *records = NULL;
+    unsigned long stored = 0;
+    long size = 0;
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        return NULL;
+    }
+
+    if (fread(header, sizeof(*header), 1, file) != 1 ||
+        memcmp(header->magic, ZZT_LOG_MAGIC, sizeof(ZZT_LOG_MAGIC)) != 0 ||
+        header->record_size != sizeof(struct zzt_log_record_s)) {
+        ZZT_PRINTF("%s: warning: Not a results log, %s\n", path, why);
+        fclose(file);
+        return NULL;
+    }
+
+    /* Trust the count no further than the records the file really holds. */
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 &&
+        (unsigned long)size >= sizeof(*header)) {
+        stored = ((unsigned long)size - sizeof(*header)) /
+                 sizeof(struct zzt_log_record_s);
+    }
+    if (fseek(file, (long)sizeof(*header), SEEK_SET) != 0) {
+        stored = 0;
+    }
+    if (header->count > header->capacity) {
+        header->count = header->capacity;
+    }
+    if (header->count > stored) {
+        header->count = stored;
+    }
+
+    records = (struct zzt_log_record_s *)malloc(
+        (header->count + 1) * sizeof(struct zzt_log_record_s));
+    if (records != NULL) {
+        header->count = (unsigned long)fread(
+            records, sizeof(struct zzt_log_record_s), header->count, file);
+    }
+    fclose(file);
+    return records;
+}
+
+/**
+ * @brief Check that a record from an earlier run belongs to a test, since
+ *        tests may have been added or removed since.
+ */
+static ZZT_BOOL
+zzt_log_matches(
+    const struct zzt_log_record_s *record, const struct zzt_test_s *test)
+{
+    char name[sizeof(record->name)];
+
+    zzt_copy_tail(name, sizeof(name), test->test_name);
+    return !strncmp(name, record->name, sizeof(name));
+}
+
+/**
+ * @brief Load the results log of an earlier run, so tests it finished can
+ *        be skipped and the test it crashed in marked as failed.
+ */
+static void
+zzt_resume_load(const char *path)
+{
+    struct zzt_log_header_s header;
+    unsigned long i = 0;
+
+    g_resumeRecords = zzt_log_read(path, "not resuming", &header);
+    if (g_resumeRecords == NULL) {
+        return;
+    }
+    g_resumeSlots = (unsigned long *)calloc(g_testsCount + 1, sizeof(long));
+    if (g_resumeSlots == NULL) {
+        header.count = 0;
+    }
+
+    for (i = 0; i < header.count; i++) {
+        if (g_resumeRecords[i].status == 0) {
+            continue; /* Queued by a parallel run, never started. */
+        }
+        if (g_resumeRecords[i].index < g_testsCount) {
+            g_resumeSlots[g_resumeRecords[i].index] = i + 1;
+        }
+        if (g_resumeRecords[i].status == ZZT_STATUS_RUNNING) {
+            g_resumeRunning += 1;
+        }
+    }
+
+    /* A run that finished leaves nothing to resume, so start over. */
+    if (g_resumeRunning == 0 && header.count == header.capacity) {
+        free(g_resumeRecords);
+        free(g_resumeSlots);
+        g_resumeRecords = NULL;
+        g_resumeSlots = NULL;
+    }
+}
+
+/**
+ * @brief Find a test's record from the run being resumed.
+ *
+ * @return True if the test finished or crashed in that run.
+ */
+static ZZT_BOOL
+zzt_resume_find(unsigned long index, const struct zzt_test_s *test,
+    struct zzt_log_record_s *record)
+{
+    if (g_resumeSlots == NULL || g_resumeSlots[index] == 0) {
+        return ZZT_FALSE;
+    }
+
+    memcpy(record, &g_resumeRecords[g_resumeSlots[index] - 1], sizeof(*record));
+    return zzt_log_matches(record, test);
+}
+
+/**
+ * @brief Close the results log.
+ */
+static void
+zzt_log_close(void)
+{
+    if (g_log.stream != NULL) {
+        fclose(g_log.stream);
+    } else if (g_log.header != NULL) {
+#if defined(_WIN32)
+        UnmapViewOfFile(g_log.header);
+        CloseHandle(g_log.mapping);
+        CloseHandle(g_log.file);
+#elif defined(ZZT_MMAP_)
+        munmap((void *)g_log.header, g_log.size);
+        close(g_log.fd);
+#endif
+    }
+    memset(&g_log, 0, sizeof(g_log));
+
+    free(g_resumeRecords);
+    free(g_resumeSlots);
+    g_resumeRecords = NULL;
+    g_resumeSlots = NULL;
+    g_resumeRunning = 0;
+}
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_SELECT)
+
+#define ZZT_NOINST_ __attribute__((no_instrument_function))
+
+void
+__cyg_profile_func_enter(void *fn, void *site) ZZT_NOINST_;
+void
+__cyg_profile_func_exit(void *fn, void *site) ZZT_NOINST_;
+
+/**
+ * @brief Called on entry to every function built with -finstrument-functions.
+ *        Adds the function to the set entered by the current test.
+ */
+void
+__cyg_profile_func_enter(void *fn, void *site)
+{
+    unsigned long i = 0, mask = ZZTEST_CONFIG_SELECT_FUNCS - 1;
+    unsigned long hash = (unsigned long)((size_t)fn >> 4) * 2654435761UL;
+
+    (void)site;
+    if (!g_selectRecording) {
+        return;
+    }
+
+    for (i = 0; i <= mask; i++) {
+        void **slot = &g_selectFns[(hash + i) & mask];
+        if (*slot == NULL) {
+            __sync_bool_compare_and_swap(slot, NULL, fn);
+        }
+        if (*slot == fn) {
+            return;
+        }
+    }
+    g_selectOverflow = 1;
+}
+
+void
+__cyg_profile_func_exit(void *fn, void *site)
+{
+    (void)fn;
+    (void)site;
+}
+
+/**
+ * @brief Double the symbol table.
+ */
+static ZZT_BOOL
+zzt_map_grow(void)
+{
+    unsigned long i = 0, slot = 0;
+    unsigned long cap = g_mapHashCap ? g_mapHashCap * 2 : 1024;
+    unsigned long *hash = (unsigned long *)calloc(cap, sizeof(*hash));
+    const char **syms = (const char **)malloc(cap / 2 * sizeof(*syms));
+
+    if (hash == NULL || syms == NULL) {
+        free(hash);
+        free((void *)syms);
+        return ZZT_FALSE;
+    }
+
+    for (i = 0; i < g_mapSymsCount; i++) {
+        syms[i] = g_mapSyms[i];
+        slot = zzt_hash_str(syms[i]) & (cap - 1);
+        while (hash[slot] != 0) {
+            slot = (slot + 1) & (cap - 1);
+        }
+        hash[slot] = i + 1;
+    }
+
+    free(g_mapHash);
+    free((void *)g_mapSyms);
+    g_mapHash = hash;
+    g_mapHashCap = cap;
+    g_mapSyms = syms;
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Find a symbol's number, adding it if add is set.
+ *
+ * @return Number of the symbol, or -1 if it isn't in the map.
+ */
+static long
+zzt_map_sym(const char *name, ZZT_BOOL add)
+{
+    unsigned long slot = 0;
+
+    if (g_mapHashCap != 0) {
+        slot = zzt_hash_str(name) & (g_mapHashCap - 1);
+        for (; g_mapHash[slot] != 0; slot = (slot + 1) & (g_mapHashCap - 1)) {
+            if (!strcmp(g_mapSyms[g_mapHash[slot] - 1], name)) {
+                return (long)g_mapHash[slot] - 1;
+            }
+        }
+    }
+
+    if (!add || (g_mapSymsCount * 2 >= g_mapHashCap && !zzt_map_grow())) {
+        return -1;
+    }
+
+    slot = zzt_hash_str(name) & (g_mapHashCap - 1);
+    while (g_mapHash[slot] != 0) {
+        slot = (slot + 1) & (g_mapHashCap - 1);
+    }
+
+    g_mapSyms[g_mapSymsCount] = name;
+    g_mapSymsCount += 1;
+    g_mapHash[slot] = g_mapSymsCount;
+    return (long)g_mapSymsCount - 1;
+}
+
+/**
+ * @brief Find a test in the map, adding it if add is set.
+ */
+static struct zzt_map_test_s *
+zzt_map_test(const char *name, ZZT_BOOL add)
+{
+    struct zzt_map_test_s *entry = g_mapTests, **tail = &g_mapTests;
+
+    for (; entry != NULL; entry = entry->next) {
+        if (!strcmp(entry->name, name)) {
+            return entry;
+        }
+        tail = &entry->next;
+    }
+
+    if (add) {
+        /* Append, so the saved map keeps a stable order. */
+        entry = (struct zzt_map_test_s *)calloc(1, sizeof(*entry));
+        if (entry != NULL) {
+            entry->name = name;
+            *tail = entry;
+        }
+    }
+    return entry;
+}
+
+/**
+ * @brief Load the map, made of "S <symbol>" lines numbered from zero and
+ *        "T <test> <symbol numbers...>" lines.
+ */
+static void
+zzt_map_load(const char *path)
+{
+    char *text = zzt_file_read(path);
+    char *cursor = text, *line = NULL, *tok = NULL;
+    struct zzt_map_test_s *entry = NULL;
+    unsigned long num = 0, *syms = NULL;
+
+    if (text == NULL) {
+        return;
+    }
+
+    line = zzt_split_line(&cursor);
+    if (line == NULL || strcmp(line, "zztmap 1") != 0) {
+        ZZT_PRINTF("%s: warning: Ignoring unknown test map format\n", path);
+        free(text);
+        return;
+    }
+
+    g_mapText = text;
+    while ((line = zzt_split_line(&cursor)) != NULL) {
+        tok = zzt_split_token(&line);
+        if (tok == NULL) {
+            continue;
+        } else if (!strcmp(tok, "S") &&
+                   (tok = zzt_split_token(&line)) != NULL) {
+            zzt_map_sym(tok, ZZT_TRUE);
+            continue;
+        } else if (strcmp(tok, "T") != 0 ||
+                   (tok = zzt_split_token(&line)) == NULL ||
+                   (entry = zzt_map_test(tok, ZZT_TRUE)) == NULL) {
+            continue;
+        }
+
+        while ((tok = zzt_split_token(&line)) != NULL) {
+            num = strtoul(tok, NULL, 10);
+            if (num >= g_mapSymsCount) {
+                continue;
+            }
+
+            syms = (unsigned long *)realloc(
+                entry->syms, (entry->count + 1) * sizeof(*syms));
+            if (syms == NULL) {
+                break;
+            }
+            entry->syms = syms;
+            entry->syms[entry->count] = num;
+            entry->count += 1;
+        }
+    }
+}
+
+/**
+ * @brief Mark the symbols listed in a file of changed symbols, one symbol
+ *        per whitespace separated token.
+ *
+ * @return True if the file could be read.
+ */
+static ZZT_BOOL
+zzt_map_changed(const char *path)
+{
+    char *text = zzt_file_read(path);
+    char *cursor = text, *line = NULL, *tok = NULL;
+    long num = 0;
+
+    if (text == NULL) {
+        return ZZT_FALSE;
+    }
+
+    g_mapChanged = (unsigned char *)calloc(g_mapSymsCount + 1, 1);
+    if (g_mapChanged == NULL) {
+        free(text);
+        return ZZT_FALSE;
+    }
+
+    g_mapChangedCount = g_mapSymsCount;
+    while ((line = zzt_split_line(&cursor)) != NULL) {
+        while ((tok = zzt_split_token(&line)) != NULL) {
+            num = zzt_map_sym(tok, ZZT_FALSE);
+            if (num >= 0) {
+                g_mapChanged[num] = 1;
+            }
+        }
+    }
+
+    free(text);
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Decide whether a test should run.  Tests run unless changes were
+ *        given and the test is mapped without calling a changed function.
+ */
+static ZZT_BOOL
+zzt_map_wanted(struct zzt_test_s *test)
+{
+    struct zzt_map_test_s *entry = NULL;
+    unsigned long i = 0;
+
+    if (g_mapChanged == NULL) {
+        return ZZT_TRUE;
+    }
+
+    entry = zzt_map_test(test->test_name, ZZT_FALSE);
+    if (entry == NULL) {
+        return ZZT_TRUE;
+    }
+
+    for (i = 0; i < entry->count; i++) {
+        if (entry->syms[i] < g_mapChangedCount && g_mapChanged[entry->syms[i]]) {
+            return ZZT_TRUE;
+        }
+    }
+    return ZZT_FALSE;
+}
+
+/**
+ * @brief Start recording the functions a test enters.
+ */
+static void
+zzt_map_start(void)
+{
+    memset(g_selectFns, 0, sizeof(g_selectFns));
+    g_selectOverflow = 0;
+    g_selectRecording = 1;
+}
+
+/**
+ * @brief Stop recording.
+ */
+static void
+zzt_map_stop(void)
+{
+    g_selectRecording = 0;
+}
+
+/**
+ * @brief Replace the test's entry with the functions it entered, named with
+ *        dladdr.  Called after the test's allocations have been checked.
+ */
+static void
+zzt_map_record(struct zzt_test_s *test)
+{
+    struct zzt_map_test_s *entry = NULL;
+    unsigned long i = 0;
+    Dl_info info;
+
+    entry = zzt_map_test(test->test_name, ZZT_TRUE);
+    if (entry == NULL) {
+        return;
+    }
+
+    free(entry->syms);
+    entry->syms = (unsigned long *)malloc(
+        ZZTEST_CONFIG_SELECT_FUNCS * sizeof(*entry->syms));
+    entry->count = 0;
+    if (entry->syms == NULL) {
+        return;
+    }
+
+    if (g_selectOverflow) {
+        ZZT_PRINTF("%s: warning: Test entered over %d functions, raise "
+                   "ZZTEST_CONFIG_SELECT_FUNCS\n",
+            test->test_name, ZZTEST_CONFIG_SELECT_FUNCS);
+    }
+
+    for (i = 0; i < ZZTEST_CONFIG_SELECT_FUNCS; i++) {
+        long num = 0;
+
+        if (g_selectFns[i] == NULL || !dladdr(g_selectFns[i], &info) ||
+            info.dli_sname == NULL) {
+            continue;
+        }
+
+        num = zzt_map_sym(info.dli_sname, ZZT_TRUE);
+        if (num >= 0) {
+            entry->syms[entry->count] = (unsigned long)num;
+            entry->count += 1;
+        }
+    }
+}
+
+/**
+ * @brief qsort comparison for symbol numbers.
+ */
+static int
+zzt_map_cmp(const void *l, const void *r)
+{
+    unsigned long a = *(const unsigned long *)l;
+    unsigned long b = *(const unsigned long *)r;
+    return a < b ? -1 : a > b;
+}
+
+/**
+ * @brief Write the map, keeping only symbols that some test still uses.
+ *        Renumbers symbols in place, so only zzt_map_close may follow.
+ */
+static void
+zzt_map_save(const char *path)
+{
+    struct zzt_map_test_s *entry = NULL;
+    unsigned long i = 0, used = 0;
+    unsigned long *renumber =
+        (unsigned long *)calloc(g_mapSymsCount + 1, sizeof(*renumber));
+    FILE *file = NULL;
+
+    if (renumber == NULL) {
+        return;
+    }
+
+    file = fopen(path, "w");
+    if (file == NULL) {
+        ZZT_PRINTF("%s: warning: Could not write test map\n", path);
+        free(renumber);
+        return;
+    }
+
+    fprintf(file, "zztmap 1\n");
+    for (entry = g_mapTests; entry != NULL; entry = entry->next) {
+        for (i = 0; i < entry->count; i++) {
+            renumber[entry->syms[i]] = 1;
+        }
+    }
+    for (i = 0; i < g_mapSymsCount; i++) {
+        if (renumber[i]) {
+            fprintf(file, "S %s\n", g_mapSyms[i]);
+            renumber[i] = used;
+            used += 1;
+        }
+    }
+    for (entry = g_mapTests; entry != NULL; entry = entry->next) {
+        for (i = 0; i < entry->count; i++) {
+            entry->syms[i] = renumber[entry->syms[i]];
+        }
+        qsort(entry->syms, entry->count, sizeof(*entry->syms), zzt_map_cmp);
+
+        fprintf(file, "T %s", entry->name);
+        for (i = 0; i < entry->count; i++) {
+            fprintf(file, " %lu", entry->syms[i]);
+        }
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    free(renumber);
+}
+
+/**
+ * @brief Free everything the map owns.
+ */
+static void
+zzt_map_close(void)
+{
+    while (g_mapTests != NULL) {
+        struct zzt_map_test_s *next = g_mapTests->next;
+        free(g_mapTests->syms);
+        free(g_mapTests);
+        g_mapTests = next;
+    }
+
+    free((void *)g_mapSyms);
+    free(g_mapHash);
+    free(g_mapChanged);
+    free(g_mapText);
+    g_mapSyms = NULL;
+    g_mapSymsCount = 0;
+    g_mapHash = NULL;
+    g_mapHashCap = 0;
+    g_mapChanged = NULL;
+    g_mapText = NULL;
+}
+
+#endif /* defined(ZZTEST_CONFIG_SELECT) */
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_ALLOC)
+
+void
+zzt_track_alloc(size_t size)
+{
+    long bytes = 0;
+
+    ZZT_ATOMIC_ADD_(&g_alloc.count, 1);
+    ZZT_ATOMIC_ADD_(&g_alloc.blocks, 1);
+    bytes = ZZT_ATOMIC_ADD_(&g_alloc.bytes, (long)size);
+#if defined(ZZTEST_CONFIG_THREADS)
+    g_allocThreadCount += 1;
+    g_allocThreadBytes += (long)size;
+    for (;;) {
+        long peak = g_alloc.peak;
+        if (bytes <= peak ||
+            ZZT_ATOMIC_CAS_(&g_alloc.peak, peak, bytes) == peak) {
+            break;
+        }
+    }
+#else
+    if (bytes > g_alloc.peak) {
+        g_alloc.peak = bytes;
+    }
+#endif
+}
+
+/******************************************************************************/
+
+void
+zzt_track_free(size_t size)
+{
+    ZZT_ATOMIC_ADD_(&g_alloc.blocks, -1);
+    ZZT_ATOMIC_ADD_(&g_alloc.bytes, -(long)size);
+#if defined(ZZTEST_CONFIG_THREADS)
+    g_allocThreadBytes -= (long)size;
+#endif
+}
+
+/******************************************************************************/
+
+unsigned long
+zzt_alloc_count(void)
+{
+#if defined(ZZTEST_CONFIG_THREADS)
+    /* Tests on other workers of a parallel run allocate meanwhile. */
+    return g_allocThreadCount;
+#else
+    return g_alloc.count;
+#endif
+}
+
+/******************************************************************************/
+
+long
+zzt_alloc_bytes(void)
+{
+#if defined(ZZTEST_CONFIG_THREADS)
+    return g_allocThreadBytes;
+#else
+    return g_alloc.bytes;
+#endif
+}
+
+#endif /* defined(ZZTEST_CONFIG_ALLOC) */
+
+/******************************************************************************/
+
+#if defined(ZZT_ALLOC_INTERPOSE_)
+
+/*
+ * glibc exports its allocator under these names, so our definitions of the
+ * standard allocation functions can forward to them without dlsym.  Sizes
+ * are taken from malloc_usable_size so allocation and free always agree.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *ptr);
+
+void *
+malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    if (ptr != NULL) {
+        zzt_track_alloc(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void *
+calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    if (ptr != NULL) {
+        zzt_track_alloc(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    size_t oldSize = 0;
+    void *newPtr = NULL;
+
+    if (ptr != NULL) {
+        oldSize = malloc_usable_size(ptr);
+    }
+
+    newPtr = __libc_realloc(ptr, size);
+    if (newPtr != NULL) {
+        if (ptr != NULL) {
+            zzt_track_free(oldSize);
+        }
+        zzt_track_alloc(malloc_usable_size(newPtr));
+    } else if (ptr != NULL && size == 0) {
+        zzt_track_free(oldSize);
+    }
+    return newPtr;
+}
+
+void *
+memalign(size_t align, size_t size)
+{
+    void *ptr = __libc_memalign(align, size);
+    if (ptr != NULL) {
+        zzt_track_alloc(malloc_usable_size(ptr));
+    }
+    return ptr;
+}
+
+void *
+aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+int
+posix_memalign(void **out, size_t align, size_t size)
+{
+    void *ptr = NULL;
+
+    if (align < sizeof(void *) || (align & (align - 1)) != 0) {
+        return 22; /* EINVAL */
+    }
+
+    ptr = memalign(align, size);
+    if (ptr == NULL) {
+        return 12; /* ENOMEM */
+    }
+
+    *out = ptr;
+    return 0;
+}
+
+void
+free(void *ptr)
+{
+    if (ptr != NULL) {
+        zzt_track_free(malloc_usable_size(ptr));
+        __libc_free(ptr);
+    }
+}
+
+#endif /* defined(ZZT_ALLOC_INTERPOSE_) */
+
+/******************************************************************************/
+
+/* Counts of finished tests, for the summary. */
+struct zzt_totals_s {
+    unsigned long passed;
+    unsigned long failed;
+    unsigned long skipped;
+    unsigned long cached;  /* Passed in an earlier run of this binary. */
+    unsigned long resumed; /* Finished in the run being resumed. */
+};
+
+/**
+ * @brief Count a finished test, hold it to the --warn-ms and --fail-ms
+ *        budgets, and write its record to the results log.
+ *
+ * @return Result to print for the test.
+ */
+static const char *
+zzt_test_finish(struct zzt_totals_s *totals, unsigned long index,
+    unsigned long slot, struct zzt_test_state_s *state, unsigned long ms)
+{
+    const char *result = ZZTLOG_OK;
+    enum zzt_status_e status = ZZT_STATUS_PASSED;
+    struct zzt_log_record_s record;
+    unsigned long failMs = zzt_scale_budget(g_options.failMs);
+    unsigned long warnMs = zzt_scale_budget(g_options.warnMs);
+
+    state->test->ms = ms;
+    if (failMs != 0 && ms > failMs) {
+        ZZT_LOCK_(&g_printLock);
+        ZZT_PRINTF("%s: error: Took %lu ms, over the budget of %lu ms\n",
+            state->test->test_name, ms, failMs);
+        ZZT_UNLOCK_(&g_printLock);
+        state->failed += 1;
+    } else if (warnMs != 0 && ms > warnMs) {
+        ZZT_LOCK_(&g_printLock);
+        ZZT_PRINTF("%s: warning: Took %lu ms, over the budget of %lu ms\n",
+            state->test->test_name, ms, warnMs);
+        ZZT_UNLOCK_(&g_printLock);
+    }
+
+    if (state->failed != 0) {
+        result = ZZTLOG_FAILED;
+        status = ZZT_STATUS_FAILED;
+        zzt_add_fail(state->test);
+        totals->failed += 1;
+    } else if (state->skipped != 0) {
+        result = ZZTLOG_SKIPPED;
+        status = ZZT_STATUS_SKIPPED;
+        zzt_add_skip(state->test);
+        totals->skipped += 1;
+    } else {
+        totals->passed += 1;
+        if (g_options.cache != NULL) {
+            zzt_names_add(&g_cachePassed, state->test->test_name);
+        }
+    }
+
+    zzt_log_record(&record, index, status, ms, state);
+    zzt_log_write(slot, &record);
+    return result;
+}
+
+#if !defined(ZZTEST_CONFIG_ALLOC) || defined(ZZTEST_CONFIG_ASYNC) || \
+    defined(ZZTEST_CONFIG_THREADS)
+/**
+ * @brief Print the result line of a finished test.
+ */
+static void
+zzt_test_print(const char *result, const char *name, unsigned long ms)
+{
+    if (ms) {
+        ZZT_PRINTF("%s %s (%lu ms)\n", result, name, ms);
+    } else {
+        ZZT_PRINTF("%s %s\n", result, name);
+    }
+}
+#endif
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_ASYNC)
+
+/*
+ * An async test waits in a slot for one descriptor or timer at a time, and
+ * is done once a callback returns without waiting again.  Each wait has a
+ * deadline, so a test that never hears back fails instead of hanging.
+ */
+struct zzt_async_s {
+    struct zzt_test_state_s state;
+    zzt_async_cb cb; /* Pending wait, or NULL. */
+    void *user;
+    int fd; /* Descriptor waited for, or -1 for a timer. */
+    int events;
+    unsigned long deadline; /* zzt_ms() the wait ends at. */
+    unsigned long timeout;  /* Milliseconds a descriptor wait may take. */
+    const char *file;       /* Location of the wait. */
+    unsigned long line;
+    unsigned long index;   /* Position of the test among all tests. */
+    unsigned long logSlot; /* Record of the test in the results log. */
+    unsigned long startMs;
+    ZZT_BOOL busy;
+};
+
+static struct zzt_async_s g_asyncSlots[ZZTEST_CONFIG_ASYNC_SLOTS];
+static struct zzt_async_s *g_asyncNext; /* Slot for the test being run. */
+static unsigned long g_asyncCount;      /* Tests in flight. */
+static ZZT_BOOL g_asyncStarted;         /* The test being run is in flight. */
+#if defined(ZZT_EPOLL_)
+static int g_asyncEpoll = -1;
+#endif
+
+/**
+ * @brief Find a slot for a test.
+ *
+ * @return Free slot, or NULL if all are taken.
+ */
+static struct zzt_async_s *
+zzt_async_slot(void)
+{
+    unsigned long i = 0;
+    for (; i < ZZTEST_CONFIG_ASYNC_SLOTS; i++) {
+        if (!g_asyncSlots[i].busy) {
+            return &g_asyncSlots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Clear a pending wait and call its continuation.
+ */
+static void
+zzt_async_call(struct zzt_async_s *async, int events)
+{
+    zzt_async_cb cb = async->cb;
+#if defined(ZZT_EPOLL_)
+    struct epoll_event event;
+
+    if (async->fd >= 0) {
+        /* Removed first, the callback may close it. */
+        memset(&event, 0, sizeof(event));
+        epoll_ctl(g_asyncEpoll, EPOLL_CTL_DEL, async->fd, &event);
+    }
+#endif
+    async->cb = NULL;
+    cb(&async->state, async, async->user, events);
+}
+
+/**
+ * @brief Fail a descriptor wait that ran out of time, or end a timer.
+ */
+static void
+zzt_async_expire(struct zzt_async_s *async)
+{
+    char msg[128];
+
+    if (async->fd >= 0) {
+        zzt_sprintf(msg, sizeof(msg),
+            "Timed out after %lu ms waiting for descriptor %d",
+            async->timeout, async->fd);
+        zzt_fail(&async->state, async->file, async->line, msg);
+    }
+    zzt_async_call(async, 0);
+}
+
+/**
+ * @brief Wait until a descriptor is ready or a deadline passes, and call
+ *        the continuations that are due.
+ */
+static void
+zzt_async_step(void)
+{
+    unsigned long i = 0, now = zzt_ms();
+    long until = -1;
+    int count = 0, n = 0;
+#if defined(ZZT_EPOLL_)
+    struct epoll_event ready[ZZTEST_CONFIG_ASYNC_SLOTS];
+#else
+    struct pollfd fds[ZZTEST_CONFIG_ASYNC_SLOTS];
+    struct zzt_async_s *owners[ZZTEST_CONFIG_ASYNC_SLOTS];
+#endif
+
+    for (i = 0; i < ZZTEST_CONFIG_ASYNC_SLOTS; i++) {
+        struct zzt_async_s *async = &g_asyncSlots[i];
+        long left = (long)(async->deadline - now);
+        if (async->cb == NULL) {
+            continue;
+        }
+        if (left < 0) {
+            left = 0;
+        }
+        if (until < 0 || left < until) {
+            until = left;
+        }
+#if !defined(ZZT_EPOLL_)
+        if (async->fd >= 0) {
+            fds[count].fd = async->fd;
+            fds[count].events =
+                (short)(((async->events & ZZT_ASYNC_READ) ? POLLIN : 0) |
+                        ((async->events & ZZT_ASYNC_WRITE) ? POLLOUT : 0));
+            fds[count].revents = 0;
+            owners[count] = async;
+            count += 1;
+        }
+#endif
+    }
+    if (until < 0) {
+        return; /* Nothing is waiting. */
+    }
+    if (until > INT_MAX) {
+        until = INT_MAX;
+    }
+
+#if defined(ZZT_EPOLL_)
+    if (g_asyncEpoll >= 0) {
+        count = epoll_wait(
+            g_asyncEpoll, ready, ZZTEST_CONFIG_ASYNC_SLOTS, (int)until);
+    } else {
+        count = poll(NULL, 0, (int)until);
+    }
+    for (n = 0; n < count; n++) {
+        struct zzt_async_s *async =
+            &g_asyncSlots[(unsigned long)(ready[n].data.u64 >> 32)];
+        int fd = (int)(ready[n].data.u64 & 0xFFFFFFFFUL);
+        int events = 0;
+        if (ready[n].events & (EPOLLERR | EPOLLHUP)) {
+            events = async->events; /* Let the test find out. */
+        } else {
+            events |= (ready[n].events & EPOLLIN) ? ZZT_ASYNC_READ : 0;
+            events |= (ready[n].events & EPOLLOUT) ? ZZT_ASYNC_WRITE : 0;
+        }
+        /* An earlier callback may have moved the wait. */
+        if (async->cb != NULL && async->fd == fd) {
+            zzt_async_call(async, events & async->events);
+        }
+    }
+#else
+    if (poll(fds, (nfds_t)count, (int)until) > 0) {
+        for (n = 0; n < count; n++) {
+            struct zzt_async_s *async = owners[n];
+            int events = 0;
+            if (fds[n].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                events = async->events;
+            } else {
+                events |= (fds[n].revents & POLLIN) ? ZZT_ASYNC_READ : 0;
+                events |= (fds[n].revents & POLLOUT) ? ZZT_ASYNC_WRITE : 0;
+            }
+            /* An earlier callback may have moved the wait. */
+            if (events != 0 && async->cb != NULL && async->fd == fds[n].fd) {
+                zzt_async_call(async, events & async->events);
+            }
+        }
+    }
+#endif
+
+    now = zzt_ms();
+    for (i = 0; i < ZZTEST_CONFIG_ASYNC_SLOTS; i++) {
+        struct zzt_async_s *async = &g_asyncSlots[i];
+        if (async->cb != NULL && (long)(async->deadline - now) <= 0) {
+            zzt_async_expire(async);
+        }
+    }
+}
+
+/**
+ * @brief Pick a slot for the async test about to run under the runner.
+ */
+static void
+zzt_async_prepare(unsigned long index, unsigned long logSlot)
+{
+    g_asyncNext = zzt_async_slot();
+    if (g_asyncNext != NULL) {
+        g_asyncNext->index = index;
+        g_asyncNext->logSlot = logSlot;
+        g_asyncNext->startMs = zzt_ms();
+    }
+}
+
+/**
+ * @brief Report the async tests that are done, and free their slots.
+ */
+static void
+zzt_async_reap(struct zzt_totals_s *totals)
+{
+    unsigned long i = 0;
+
+    for (; i < ZZTEST_CONFIG_ASYNC_SLOTS; i++) {
+        struct zzt_async_s *async = &g_asyncSlots[i];
+        const char *result = NULL;
+        unsigned long ms = 0;
+
+        if (!async->busy || async->cb != NULL) {
+            continue;
+        }
+
+#if defined(ZZTEST_CONFIG_THREADS)
+        zzt_thread_collect(&async->state);
+#endif
+        ms = zzt_ms() - async->startMs;
+        result = zzt_test_finish(
+            totals, async->index, async->logSlot, &async->state, ms);
+        zzt_test_print(result, async->state.test->test_name, ms);
+        async->busy = ZZT_FALSE;
+        g_asyncCount -= 1;
+#if defined(ZZTEST_CONFIG_WIRE)
+        zzt_wire_flush();
+#endif
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+        zzt_transport_poll();
+#endif
+    }
+}
+
+/**
+ * @brief Run the event loop until at most max async tests are in flight.
+ */
+static void
+zzt_async_drain(struct zzt_totals_s *totals, unsigned long max)
+{
+    while (g_asyncCount > max) {
+        zzt_async_step();
+        zzt_async_reap(totals);
+    }
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Take a slot for a test and run its body.
+ */
+static void
+zzt_async_begin(struct zzt_async_s *async, struct zzt_test_state_s *state,
+    zzt_asyncfunc func)
+{
+    async->state = *state;
+    async->cb = NULL;
+    async->fd = -1;
+    async->timeout = ZZTEST_CONFIG_ASYNC_TIMEOUT;
+    async->busy = ZZT_TRUE;
+    func(&async->state, async);
+}
+
+/**
+ * @brief Hand the counts of a test that is done back, and free its slot.
+ */
+static void
+zzt_async_end(struct zzt_async_s *async, struct zzt_test_state_s *state)
+{
+#if defined(ZZTEST_CONFIG_THREADS)
+    zzt_thread_collect(&async->state);
+#endif
+    *state = async->state;
+    async->busy = ZZT_FALSE;
+}
+
+/******************************************************************************/
+
+void
+zzt_async_start(struct zzt_test_state_s *state, zzt_asyncfunc func)
+{
+    struct zzt_async_s *async = g_asyncNext;
+
+    if (async != NULL) {
+        g_asyncNext = NULL;
+        zzt_async_begin(async, state, func);
+        if (async->cb != NULL) {
+            /* Left in flight, zzt_async_reap finishes it. */
+            g_asyncCount += 1;
+            g_asyncStarted = ZZT_TRUE;
+        } else {
+            zzt_async_end(async, state);
+        }
+        return;
+    }
+
+    /* Outside the runner, or on a worker of a parallel run. */
+    ZZT_LOCK_(&g_asyncLock);
+    async = zzt_async_slot();
+    if (async == NULL) {
+        zzt_fail(state, __FILE__, __LINE__, "No free async test slot");
+    } else {
+        zzt_async_begin(async, state, func);
+        while (async->cb != NULL) {
+            zzt_async_step();
+        }
+        zzt_async_end(async, state);
+    }
+    ZZT_UNLOCK_(&g_asyncLock);
+}
+
+/******************************************************************************/
+
+void
+zzt_async_wait(struct zzt_async_s *async, int fd, int events, zzt_async_cb cb,
+    void *user, const char *file, unsigned long line)
+{
+    char msg[64];
+#if defined(ZZT_EPOLL_)
+    struct epoll_event event;
+#endif
+
+    if (async->cb != NULL) {
+        zzt_fail(&async->state, file, line, "Test is already waiting");
+        return;
+    }
+
+#if defined(ZZT_EPOLL_)
+    if (g_asyncEpoll < 0) {
+        g_asyncEpoll = epoll_create(ZZTEST_CONFIG_ASYNC_SLOTS);
+    }
+    memset(&event, 0, sizeof(event));
+    event.events = ((events & ZZT_ASYNC_READ) ? EPOLLIN : 0) |
+                   ((events & ZZT_ASYNC_WRITE) ? EPOLLOUT : 0);
+    /* The slot and the descriptor, so a stale event can be told apart. */
+    event.data.u64 = (unsigned long)(async - g_asyncSlots);
+    event.data.u64 = (event.data.u64 << 32) | (unsigned)fd;
+    if (g_asyncEpoll < 0 ||
+        epoll_ctl(g_asyncEpoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+        zzt_sprintf(msg, sizeof(msg), "Can't wait for descriptor %d", fd);
+        zzt_fail(&async->state, file, line, msg);
+        return;
+    }
+#else
+    if (fd < 0) {
+        zzt_sprintf(msg, sizeof(msg), "Can't wait for descriptor %d", fd);
+        zzt_fail(&async->state, file, line, msg);
+        return;
+    }
+#endif
+
+    async->cb = cb;
+    async->user = user;
+    async->fd = fd;
+    async->events = events;
+    async->deadline = zzt_ms() + async->timeout;
+    async->file = file;
+    async->line = line;
+}
+
+/******************************************************************************/
+
+void
+zzt_async_sleep(struct zzt_async_s *async, unsigned long ms, zzt_async_cb cb,
+    void *user, const char *file, unsigned long line)
+{
+    if (async->cb != NULL) {
+        zzt_fail(&async->state, file, line, "Test is already waiting");
+        return;
+    }
+
+    async->cb = cb;
+    async->user = user;
+    async->fd = -1;
+    async->events = 0;
+    async->deadline = zzt_ms() + ms;
+    async->file = file;
+    async->line = line;
+}
+
+/******************************************************************************/
+
+void
+zzt_async_timeout(struct zzt_async_s *async, unsigned long ms)
+{
+    async->timeout = ms;
+}
+
+#endif /* defined(ZZTEST_CONFIG_ASYNC) */
+
+#if defined(ZZTEST_CONFIG_BENCH)
+
+/* A benchmark being measured, see zzt_bench_run. */
+struct zzt_bench_state_s {
+    struct zzt_bench_s pub; /* First, so the two convert. */
+    unsigned long iters;    /* Iterations in each batch. */
+    ZZT_UINTMAX start;      /* Clock at the start of the batch. */
+    ZZT_UINTMAX pausedAt;   /* Clock at BENCH_PAUSE, if paused. */
+    ZZT_UINTMAX paused;     /* Time paused during the batch. */
+    ZZT_UINTMAX first;      /* Clock at the start of the first batch. */
+    ZZT_BOOL running;
+    ZZT_BOOL isPaused;
+    ZZT_BOOL done;
+    unsigned long samplesCount;
+    ZZT_UINTMAX samples[ZZTEST_CONFIG_BENCH_SAMPLES]; /* ps per iteration */
+#if defined(ZZTEST_CONFIG_THREADS)
+    struct zzt_bench_group_s *group; /* Threads batched together, or NULL. */
+#endif
+#if defined(ZZT_PERF_)
+    ZZT_UINTMAX perfAt[ZZT_PERF_MAX]; /* Counters at the start of the batch. */
+    ZZT_UINTMAX perf[ZZT_PERF_MAX];   /* Counted over the sampled batches. */
+    ZZT_UINTMAX perfIters;            /* Iterations of the sampled batches. */
+#endif
+};
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+/*
+ * Threads of a BENCH_THREADS run, which go through each batch in lockstep.
+ * The last thread to finish a batch times it for all of them and starts
+ * the next, so the samples cover every thread running at once.
+ */
+struct zzt_bench_group_s {
+    zzt_mutex_t lock;
+    struct zzt_bench_state_s batches; /* Batching shared by the threads. */
+    unsigned long present;    /* Threads still running the body. */
+    unsigned long arrived;    /* Threads done with the current batch. */
+    volatile long generation; /* Bumped as each batch starts. */
+    ZZT_BOOL aborted;         /* A thread left its loop early. */
+};
+
+/* One thread of a BENCH_THREADS run. */
+struct zzt_bench_thread_s {
+    struct zzt_bench_state_s bench;
+    struct zzt_test_state_s *state;
+    zzt_benchfunc func;
+#if defined(_WIN32)
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+    ZZT_BOOL started;
+};
+
+#endif /* defined(ZZTEST_CONFIG_THREADS) */
+
+/* Sink zzt_bench_escape stores to, which the optimizer can't see past. */
+static const volatile void *volatile g_benchSink;
+
+/* Benchmark results, see --bench-out. */
+static FILE *g_benchOut;
+static unsigned long g_benchOutCount;
+
+/**
+ * @brief Divide a time by a number of iterations, in picoseconds so fast
+ *        loops keep their fraction of a nanosecond.
+ */
+static ZZT_UINTMAX
+zzt_bench_ps(ZZT_UINTMAX ns, unsigned long iters)
+{
+    /* Split, so ns * 1000 can't overflow a 32-bit ZZT_UINTMAX.  The
+     * remainder can be as large as iters, so it's scaled as a double. */
+    return ns / iters * 1000 +
+           (ZZT_UINTMAX)((double)(ns % iters) * 1000 / iters);
+}
+
+/**
+ * @brief Format a time in picoseconds with three decimals, in ns, us, ms
+ *        or s.
+ */
+static void
+zzt_bench_time(char *buf, unsigned buflen, ZZT_UINTMAX ps)
+{
+    static const char *units[] = {"ns", "us", "ms", "s"};
+    int unit = 0;
+
+    while (unit < 3 && ps >= 1000000) {
+        ps /= 1000;
+        unit += 1;
+    }
+    zzt_sprintf(buf, buflen, "%lu.%03lu %s", (unsigned long)(ps / 1000),
+        (unsigned long)(ps % 1000), units[unit]);
+}
+
+/**
+ * @brief Format the throughput of count units every ps picoseconds with
+ *        one decimal and a k, M, G or T prefix, as in "1.5 GB/s".
+ */
+static void
+zzt_bench_rate(char *buf, unsigned buflen, double count, ZZT_UINTMAX ps,
+    const char *unit)
+{
+    static const char *prefixes[] = {"", "k", "M", "G", "T"};
+    double rate = count * 1e12 / (double)(ps != 0 ? ps : 1);
+    int prefix = 0;
+
+    while (prefix < 4 && rate >= 999.95) {
+        rate /= 1000;
+        prefix += 1;
+    }
+    rate = rate * 10 + 0.5;
+    zzt_sprintf(buf, buflen, "%lu.%lu %s%s", (unsigned long)rate / 10,
+        (unsigned long)rate % 10, prefixes[prefix], unit);
+}
+
+/**
+ * @brief Order samples for the median.
+ */
+static int
+zzt_bench_cmp(const void *l, const void *r)
+{
+    ZZT_UINTMAX lv = *(const ZZT_UINTMAX *)l;
+    ZZT_UINTMAX rv = *(const ZZT_UINTMAX *)r;
+    return lv < rv ? -1 : lv > rv;
+}
+
+/**
+ * @brief Run a benchmark body at one input size, and sort its samples.
+ *
+ * @return False if the body failed, skipped or never finished a batch.
+ */
+static ZZT_BOOL
+zzt_bench_measure(struct zzt_test_state_s *state, zzt_benchfunc func,
+    struct zzt_bench_state_s *bench, unsigned long size, const char *name)
+{
+    memset(bench, 0, sizeof(*bench));
+    bench->pub.size = size;
+    bench->pub.threads = 1;
+    func(state, &bench->pub);
+#if defined(ZZTEST_CONFIG_THREADS)
+    zzt_thread_collect(state);
+#endif
+    if (state->failed || state->skipped) {
+        return ZZT_FALSE;
+    }
+    if (bench->samplesCount == 0) {
+        ZZT_PRINTF(ZZTLOG_BENCH " %s: no complete batch\n", name);
+        return ZZT_FALSE;
+    }
+
+    qsort(bench->samples, bench->samplesCount, sizeof(ZZT_UINTMAX),
+        zzt_bench_cmp);
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Base 2 logarithm of x >= 1, one bit of the fraction per squaring
+ *        so libm isn't needed.
+ */
+static double
+zzt_log2(double x)
+{
+    double result = 0, bit = 1;
+    int i;
+
+    for (; x >= 2; x /= 2) {
+        result += 1;
+    }
+    for (i = 0; i < 24; i++) {
+        x *= x;
+        bit /= 2;
+        if (x >= 2) {
+            x /= 2;
+            result += bit;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Square root of x >= 0 by Newton's method, so libm isn't needed.
+ */
+static double
+zzt_sqrt(double x)
+{
+    double guess = x > 1 ? x : 1;
+    int i;
+
+    for (i = 0; i < 64 && x > 0; i++) {
+        guess = (guess + x / guess) / 2;
+    }
+    return x > 0 ? guess : 0;
+}
+
+/* Complexities a size sweep is fit against. */
+enum zzt_big_o_e {
+    ZZT_BIG_O_1,
+    ZZT_BIG_O_LOG_N,
+    ZZT_BIG_O_N,
+    ZZT_BIG_O_N_LOG_N,
+    ZZT_BIG_O_N_2,
+    ZZT_BIG_O_MAX
+};
+
+static const char *g_bigONames[] = {
+    "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)"};
+static const char *g_bigOUnits[] = {"", " per log n", " per n",
+    " per n log n", " per n^2"};
+
+/**
+ * @brief Value of a complexity at size n.
+ */
+static double
+zzt_big_o(enum zzt_big_o_e bigO, double n)
+{
+    switch (bigO) {
+    case ZZT_BIG_O_LOG_N: return zzt_log2(n);
+    case ZZT_BIG_O_N: return n;
+    case ZZT_BIG_O_N_LOG_N: return n * zzt_log2(n);
+    case ZZT_BIG_O_N_2: return n * n;
+    default: return 1;
+    }
+}
+
+/**
+ * @brief Fit times to each complexity by least squares, and print the one
+ *        with the smallest error relative to the mean time.
+ */
+static void
+zzt_bench_fit(const unsigned long *sizes, const double *times,
+    unsigned long count)
+{
+    enum zzt_big_o_e bigO, best = ZZT_BIG_O_1;
+    double bestCoef = 0, bestRms = -1, mean = 0;
+    char coef[32];
+    unsigned long i;
+
+    for (i = 0; i < count; i++) {
+        mean += times[i] / (double)count;
+    }
+    for (bigO = ZZT_BIG_O_1; bigO < ZZT_BIG_O_MAX;
+         bigO = (enum zzt_big_o_e)(bigO + 1)) {
+        double tf = 0, ff = 0, coefficient = 0, rms = 0;
+        for (i = 0; i < count; i++) {
+            double f = zzt_big_o(bigO, (double)sizes[i]);
+            tf += times[i] * f;
+            ff += f * f;
+        }
+        coefficient = ff > 0 ? tf / ff : 0;
+        for (i = 0; i < count; i++) {
+            double error =
+                times[i] - coefficient * zzt_big_o(bigO, (double)sizes[i]);
+            rms += error * error / (double)count;
+        }
+        if (bestRms < 0 || rms < bestRms) {
+            best = bigO;
+            bestCoef = coefficient;
+            bestRms = rms;
+        }
+    }
+
+    if (bestCoef < 1000) {
+        /* Steps of an O(n^2) loop can take less than a nanosecond. */
+        unsigned long fs = (unsigned long)(bestCoef * 1000 + 0.5);
+        zzt_sprintf(coef, sizeof(coef), "%lu.%03lu ps", fs / 1000, fs % 1000);
+    } else {
+        zzt_bench_time(coef, sizeof(coef), (ZZT_UINTMAX)(bestCoef + 0.5));
+    }
+    ZZT_PRINTF(ZZTLOG_BENCH " Fits %s at %s%s (RMS %lu%%)\n",
+        g_bigONames[best], coef, g_bigOUnits[best],
+        (unsigned long)(zzt_sqrt(bestRms) * 100 / (mean > 0 ? mean : 1) + 0.5));
+}
+
+/**
+ * @brief Write str to file as a JSON string.
+ */
+static void
+zzt_json_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+    for (; *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', file);
+            fputc(*str, file);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned)(unsigned char)*str);
+        } else {
+            fputc(*str, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/**
+ * @brief Find the model name of the processor, or leave buf empty.
+ */
+static void
+zzt_bench_cpu(char *buf, unsigned buflen)
+{
+#if defined(__linux__)
+    char line[256];
+    char *value = NULL;
+    FILE *file = fopen("/proc/cpuinfo", "r");
+
+    buf[0] = '\0';
+    if (file == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "model name", 10) == 0 &&
+            (value = strchr(line, ':')) != NULL) {
+            value += strspn(value, ": \t");
+            value[strcspn(value, "\r\n")] = '\0';
+            zzt_sprintf(buf, buflen, "%s", value);
+            break;
+        }
+    }
+    fclose(file);
+#else
+    (void)buflen;
+    buf[0] = '\0';
+#endif
+}
+
+/**
+ * @brief Start the benchmark results file with what was measured on, so
+ *        results from different machines aren't compared unawares.
+ */
+static void
+zzt_bench_out_open(const char *path)
+{
+    char cpu[128], compiler[64], date[32];
+    time_t now = time(NULL);
+    struct tm *utc = gmtime(&now);
+
+    g_benchOut = fopen(path, "w");
+    g_benchOutCount = 0;
+    if (g_benchOut == NULL) {
+        ZZT_PRINTF("%s: warning: Could not write benchmark results\n", path);
+        return;
+    }
+
+    date[0] = '\0';
+    if (utc != NULL) {
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", utc);
+    }
+    zzt_bench_cpu(cpu, sizeof(cpu));
+#if defined(__clang__)
+    zzt_sprintf(compiler, sizeof(compiler), "clang %s", __clang_version__);
+#elif defined(__GNUC__)
+    zzt_sprintf(compiler, sizeof(compiler), "gcc %s", __VERSION__);
+#elif defined(_MSC_VER)
+    zzt_sprintf(compiler, sizeof(compiler), "msvc %lu",
+        (unsigned long)_MSC_VER);
+#else
+    compiler[0] = '\0';
+#endif
+
+    fputs("{\n  \"context\": {\n    \"date\": ", g_benchOut);
+    zzt_json_string(g_benchOut, date);
+    fputs(",\n    \"program\": ", g_benchOut);
+    zzt_json_string(
+        g_benchOut, g_options.argv0 != NULL ? g_options.argv0 : "");
+    fputs(",\n    \"cpu\": ", g_benchOut);
+    zzt_json_string(g_benchOut, cpu);
+    fprintf(g_benchOut, ",\n    \"cpus\": %lu,\n    \"compiler\": ",
+        zzt_cpu_count());
+    zzt_json_string(g_benchOut, compiler);
+    fprintf(g_benchOut,
+        ",\n    \"pointer_bits\": %lu,\n    \"bench_time_ms\": %lu,\n"
+        "    \"bench_samples\": %lu\n  },\n  \"benchmarks\": [",
+        (unsigned long)(sizeof(void *) * CHAR_BIT),
+        (unsigned long)ZZTEST_CONFIG_BENCH_TIME,
+        (unsigned long)ZZTEST_CONFIG_BENCH_SAMPLES);
+}
+
+/**
+ * @brief Finish the benchmark results file.
+ */
+static void
+zzt_bench_out_close(void)
+{
+    if (g_benchOut != NULL) {
+        fputs(g_benchOutCount != 0 ? "\n  ]\n}\n" : "]\n}\n", g_benchOut);
+        fclose(g_benchOut);
+        g_benchOut = NULL;
+    }
+}
+
+/**
+ * @brief Sample at percentile pct of sorted samples, by nearest rank.
+ */
+static double
+zzt_bench_percentile(const struct zzt_bench_state_s *bench, unsigned pct)
+{
+    unsigned long rank = (bench->samplesCount * pct + 99) / 100;
+    return (double)bench->samples[rank != 0 ? rank - 1 : 0] / 1000;
+}
+
+/**
+ * @brief Add the measured benchmark to the results file, one object per
+ *        line so tools can read it without a JSON parser.  Times are in
+ *        nanoseconds per iteration of one thread.
+ */
+static void
+zzt_bench_export(const char *name, const struct zzt_bench_state_s *bench)
+{
+    double mean = 0, var = 0, median = 0, delta = 0;
+    unsigned long i = 0, n = bench->samplesCount;
+
+    if (g_benchOut == NULL) {
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        mean += (double)bench->samples[i] / 1000;
+    }
+    mean /= (double)n;
+    for (i = 0; i < n; i++) {
+        delta = (double)bench->samples[i] / 1000 - mean;
+        var += delta * delta;
+    }
+    var = n > 1 ? var / (double)(n - 1) : 0;
+    median = (double)bench->samples[n / 2] / 1000;
+
+    fputs(g_benchOutCount != 0 ? ",\n    {\"name\": " : "\n    {\"name\": ",
+        g_benchOut);
+    zzt_json_string(g_benchOut, name);
+    fprintf(g_benchOut,
+        ", \"size\": %lu, \"threads\": %lu, \"iterations\": %lu, "
+        "\"samples\": %lu, \"mean_ns\": %.3f, \"median_ns\": %.3f, "
+        "\"stddev_ns\": %.3f, \"min_ns\": %.3f, \"p10_ns\": %.3f, "
+        "\"p25_ns\": %.3f, \"p75_ns\": %.3f, \"p90_ns\": %.3f, "
+        "\"max_ns\": %.3f, \"counters\": {\"ops_per_second\": %.0f",
+        bench->pub.size, bench->pub.threads, bench->iters, n, mean, median,
+        zzt_sqrt(var), zzt_bench_percentile(bench, 0),
+        zzt_bench_percentile(bench, 10), zzt_bench_percentile(bench, 25),
+        zzt_bench_percentile(bench, 75), zzt_bench_percentile(bench, 90),
+        zzt_bench_percentile(bench, 100),
+        (double)bench->pub.threads * 1e9 / median);
+    if (bench->pub.bytes != 0) {
+        fprintf(g_benchOut, ", \"bytes_per_second\": %.0f",
+            (double)bench->pub.bytes * (double)bench->pub.threads * 1e9 /
+                median);
+    }
+#if defined(ZZT_PERF_)
+    for (i = 0; i < ZZT_PERF_MAX && bench->perfIters != 0; i++) {
+        if (g_perfFds[i] >= 0) {
+            fprintf(g_benchOut, ", \"%s\": %.3f", g_perfNames[i],
+                (double)bench->perf[i] / (double)bench->perfIters);
+        }
+    }
+#endif
+    fputs("}}", g_benchOut);
+    fflush(g_benchOut);
+    g_benchOutCount += 1;
+}
+
+/******************************************************************************/
+
+void
+zzt_bench_run(struct zzt_test_state_s *state, zzt_benchfunc func)
+{
+    struct zzt_bench_state_s bench;
+    char median[32], min[32], rate[32];
+    const char *name = state->test != NULL ? state->test->test_name : "bench";
+    ZZT_UINTMAX ps = 0;
+
+    if (!zzt_bench_measure(state, func, &bench, 0, name)) {
+        return;
+    }
+    zzt_bench_export(name, &bench);
+
+    ps = bench.samples[bench.samplesCount / 2];
+    zzt_bench_time(median, sizeof(median), ps);
+    zzt_bench_time(min, sizeof(min), bench.samples[0]);
+    rate[0] = '\0';
+    if (bench.pub.bytes != 0) {
+        rate[0] = ',';
+        rate[1] = ' ';
+        zzt_bench_rate(rate + 2, sizeof(rate) - 2, (double)bench.pub.bytes, ps,
+            "B/s");
+    }
+    ZZT_PRINTF(ZZTLOG_BENCH " %s: %s/op%s (min %s, %lu x %lu iterations)\n",
+        name, median, rate, min, bench.samplesCount, bench.iters);
+}
+
+/******************************************************************************/
+
+void
+zzt_bench_sweep(struct zzt_test_state_s *state, zzt_benchfunc func,
+    unsigned long lo, unsigned long hi)
+{
+    struct zzt_bench_state_s bench;
+    char time[32], rate[32];
+    const char *name = state->test != NULL ? state->test->test_name : "bench";
+    unsigned long sizes[sizeof(long) * CHAR_BIT];
+    double times[sizeof(long) * CHAR_BIT];
+    unsigned long count = 0, size = lo != 0 ? lo : 1;
+
+    ZZT_UINTMAX ps = 0;
+
+    ZZT_PRINTF(ZZTLOG_BENCH " %s\n", name);
+    for (;;) {
+        if (!zzt_bench_measure(state, func, &bench, size, name)) {
+            return;
+        }
+        zzt_bench_export(name, &bench);
+
+        ps = bench.samples[bench.samplesCount / 2];
+        sizes[count] = size;
+        times[count] = (double)ps;
+        zzt_bench_time(time, sizeof(time), ps);
+        if (bench.pub.bytes != 0) {
+            zzt_bench_rate(
+                rate, sizeof(rate), (double)bench.pub.bytes, ps, "B/s");
+            if (count == 0) {
+                ZZT_PRINTF(ZZTLOG_BENCH " %12s %14s %14s\n", "size",
+                    "time/op", "bytes/s");
+            }
+            ZZT_PRINTF(ZZTLOG_BENCH " %12lu %14s %14s\n", size, time, rate);
+        } else {
+            if (count == 0) {
+                ZZT_PRINTF(ZZTLOG_BENCH " %12s %14s\n", "size", "time/op");
+            }
+            ZZT_PRINTF(ZZTLOG_BENCH " %12lu %14s\n", size, time);
+        }
+        count += 1;
+
+        if (size >= hi || size > ULONG_MAX / 2) {
+            break;
+        }
+        size = size * 2 < hi ? size * 2 : hi;
+    }
+
+    if (count > 2) {
+        zzt_bench_fit(sizes, times, count);
+    }
+}
+
+/**
+ * @brief Finish the batch of bench that ended at now, sampling it if it
+ *        was long enough or growing the next one if not.
+ *
+ * @return False once the benchmark is measured.
+ */
+static ZZT_BOOL
+zzt_bench_batch(struct zzt_bench_state_s *bench, ZZT_UINTMAX now)
+{
+    ZZT_UINTMAX elapsed = 0, grown = 0;
+    ZZT_UINTMAX batch = (ZZT_UINTMAX)ZZTEST_CONFIG_BENCH_TIME * 1000000 /
+                        ZZTEST_CONFIG_BENCH_SAMPLES;
+
+    if (bench->done) {
+        return ZZT_FALSE;
+    } else if (!bench->running) {
+        bench->running = ZZT_TRUE;
+        bench->iters = 1;
+        return ZZT_TRUE;
+    }
+
+    elapsed = now - bench->start - bench->paused;
+    if (elapsed >= batch / 2 || bench->iters >= ULONG_MAX / 100) {
+        /* Long enough to measure. */
+        bench->samples[bench->samplesCount++] =
+            zzt_bench_ps(elapsed, bench->iters);
+    } else {
+        /* Aim a little past the batch time, growing at most 100x. */
+        grown = elapsed != 0 ? batch * 5 / 4 / (elapsed / bench->iters + 1)
+                             : (ZZT_UINTMAX)bench->iters * 100;
+        if (grown < (ZZT_UINTMAX)bench->iters * 2) {
+            grown = (ZZT_UINTMAX)bench->iters * 2;
+        } else if (grown > (ZZT_UINTMAX)bench->iters * 100) {
+            grown = (ZZT_UINTMAX)bench->iters * 100;
+        }
+        bench->iters = (unsigned long)grown;
+    }
+
+    if (bench->samplesCount == ZZTEST_CONFIG_BENCH_SAMPLES ||
+        (bench->samplesCount != 0 &&
+            (now - bench->first) / 4000000 >= ZZTEST_CONFIG_BENCH_TIME)) {
+        bench->running = ZZT_FALSE;
+        bench->done = ZZT_TRUE;
+        return ZZT_FALSE;
+    }
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Start the clock on the batch zzt_bench_batch planned.
+ */
+static void
+zzt_bench_start(struct zzt_bench_state_s *bench)
+{
+    bench->paused = 0;
+    bench->start = zzt_ns();
+    if (bench->first == 0) {
+        bench->first = bench->start;
+    }
+}
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+/**
+ * @brief Let other threads run while spinning.
+ */
+static void
+zzt_yield(void)
+{
+#if defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+/**
+ * @brief Wait for every thread of the group to finish its batch, then
+ *        start the next one together.
+ *
+ * @return False once the benchmark is measured.
+ */
+static int
+zzt_bench_group_next(struct zzt_bench_state_s *bench)
+{
+    struct zzt_bench_group_s *group = bench->group;
+    ZZT_UINTMAX now = zzt_ns();
+    ZZT_BOOL last = ZZT_FALSE, done = ZZT_FALSE;
+    unsigned long iters = 0;
+    long generation = 0;
+
+    ZZT_LOCK_(&group->lock);
+    if (group->batches.done) {
+        /* Measured, or stopped by a thread that left, so don't wait. */
+        ZZT_UNLOCK_(&group->lock);
+        return 0;
+    }
+    generation = ZZT_ATOMIC_ADD_(&group->generation, 0);
+    group->arrived += 1;
+    last = group->arrived == group->present;
+    if (last) {
+        /* The batch took as long as its slowest thread. */
+        group->arrived = 0;
+        if (zzt_bench_batch(&group->batches, now)) {
+            zzt_bench_start(&group->batches);
+        }
+        ZZT_ATOMIC_ADD_(&group->generation, 1);
+    }
+    ZZT_UNLOCK_(&group->lock);
+
+    while (!last && ZZT_ATOMIC_ADD_(&group->generation, 0) == generation) {
+        zzt_yield();
+    }
+
+    ZZT_LOCK_(&group->lock);
+    done = group->batches.done;
+    iters = group->batches.iters;
+    ZZT_UNLOCK_(&group->lock);
+    if (done) {
+        return 0;
+    }
+    bench->pub.left = iters - 1; /* This call is the first. */
+    return 1;
+}
+
+/**
+ * @brief Take a thread that returned from the body out of the group.  One
+ *        that left before the end stops the run, as the batch it was in
+ *        can't finish.
+ */
+static void
+zzt_bench_group_leave(struct zzt_bench_group_s *group)
+{
+    ZZT_LOCK_(&group->lock);
+    group->present -= 1;
+    if (!group->batches.done) {
+        group->aborted = ZZT_TRUE;
+        group->batches.running = ZZT_FALSE;
+        group->batches.done = ZZT_TRUE;
+        ZZT_ATOMIC_ADD_(&group->generation, 1);
+    }
+    ZZT_UNLOCK_(&group->lock);
+}
+
+/**
+ * @brief Thread of a BENCH_THREADS run, runs the body once.
+ */
+#if defined(_WIN32)
+static DWORD WINAPI
+zzt_bench_thread(LPVOID ptr)
+#else
+static void *
+zzt_bench_thread(void *ptr)
+#endif
+{
+    struct zzt_bench_thread_s *thread = (struct zzt_bench_thread_s *)ptr;
+
+    thread->func(thread->state, &thread->bench.pub);
+    zzt_bench_group_leave(thread->bench.group);
+    return 0;
+}
+
+/**
+ * @brief Run a benchmark body on count threads at once, and sort the
+ *        samples of their shared batches.
+ *
+ * @return False if the body failed, skipped or never finished a batch.
+ */
+static ZZT_BOOL
+zzt_bench_measure_threads(struct zzt_test_state_s *state, zzt_benchfunc func,
+    struct zzt_bench_group_s *group, struct zzt_bench_thread_s *threads,
+    unsigned long count, const char *name)
+{
+    unsigned long i = 0;
+
+    memset(group, 0, sizeof(*group));
+    ZZT_MUTEX_CREATE_(&group->lock);
+    group->present = count;
+    for (i = 0; i < count; i++) {
+        memset(&threads[i], 0, sizeof(threads[i]));
+        threads[i].bench.pub.thread = i;
+        threads[i].bench.pub.threads = count;
+        threads[i].bench.group = group;
+        threads[i].state = state;
+        threads[i].func = func;
+    }
+
+    for (i = 1; i < count; i++) {
+        struct zzt_bench_thread_s *thread = &threads[i];
+#if defined(_WIN32)
+        thread->thread =
+            CreateThread(NULL, 0, zzt_bench_thread, thread, 0, NULL);
+        thread->started = thread->thread != NULL;
+#else
+        thread->started = pthread_create(&thread->thread, NULL,
+                              zzt_bench_thread, thread) == 0;
+#endif
+        if (!thread->started) {
+            zzt_bench_group_leave(group);
+        }
+    }
+    zzt_bench_thread(&threads[0]);
+    for (i = 1; i < count; i++) {
+        struct zzt_bench_thread_s *thread = &threads[i];
+        if (!thread->started) {
+            continue;
+        }
+#if defined(_WIN32)
+        WaitForSingleObject(thread->thread, INFINITE);
+        CloseHandle(thread->thread);
+#else
+        pthread_join(thread->thread, NULL);
+#endif
+    }
+    ZZT_MUTEX_DESTROY_(&group->lock);
+
+    zzt_thread_collect(state);
+    if (state->failed || state->skipped) {
+        return ZZT_FALSE;
+    }
+    if (group->aborted || group->batches.samplesCount == 0) {
+        ZZT_PRINTF(ZZTLOG_BENCH " %s: no complete batch on %lu threads\n",
+            name, count);
+        return ZZT_FALSE;
+    }
+
+    qsort(group->batches.samples, group->batches.samplesCount,
+        sizeof(ZZT_UINTMAX), zzt_bench_cmp);
+    group->batches.pub.threads = count;
+    group->batches.pub.bytes = threads[0].bench.pub.bytes;
+    return ZZT_TRUE;
+}
+
+/******************************************************************************/
+
+void
+zzt_bench_scale(struct zzt_test_state_s *state, zzt_benchfunc func,
+    unsigned long maxThreads)
+{
+    struct zzt_bench_group_s group;
+    struct zzt_bench_thread_s *threads = NULL;
+    char time[32], ops[32], rate[32];
+    const char *name = state->test != NULL ? state->test->test_name : "bench";
+    unsigned long count = 1;
+    ZZT_UINTMAX ps = 0, ps1 = 0;
+    unsigned long efficiency = 0;
+
+    if (maxThreads == 0) {
+        maxThreads = zzt_cpu_count();
+    }
+    threads = (struct zzt_bench_thread_s *)malloc(
+        maxThreads * sizeof(struct zzt_bench_thread_s));
+    if (threads == NULL) {
+        zzt_fail(state, __FILE__, __LINE__, "Out of memory for threads");
+        return;
+    }
+
+    ZZT_PRINTF(ZZTLOG_BENCH " %s\n", name);
+    for (;;) {
+        if (!zzt_bench_measure_threads(
+                state, func, &group, threads, count, name)) {
+            break;
+        }
+        zzt_bench_export(name, &group.batches);
+
+        /* Each thread ran every iteration of a batch in its time. */
+        ps = group.batches.samples[group.batches.samplesCount / 2];
+        if (count == 1) {
+            ps1 = ps;
+        }
+        zzt_bench_time(time, sizeof(time), ps);
+        zzt_bench_rate(ops, sizeof(ops), (double)count, ps, "op/s");
+        efficiency = ps != 0 ? (unsigned long)(ps1 * 100 / ps) : 100;
+        if (threads[0].bench.pub.bytes != 0) {
+            zzt_bench_rate(rate, sizeof(rate),
+                (double)threads[0].bench.pub.bytes * (double)count, ps, "B/s");
+            if (count == 1) {
+                ZZT_PRINTF(ZZTLOG_BENCH " %8s %14s %14s %14s %10s\n",
+                    "threads", "time/op", "ops/s", "bytes/s", "efficiency");
+            }
+            ZZT_PRINTF(ZZTLOG_BENCH " %8lu %14s %14s %14s %9lu%%\n", count,
+                time, ops, rate, efficiency);
+        } else {
+            if (count == 1) {
+                ZZT_PRINTF(ZZTLOG_BENCH " %8s %14s %14s %10s\n", "threads",
+                    "time/op", "ops/s", "efficiency");
+            }
+            ZZT_PRINTF(ZZTLOG_BENCH " %8lu %14s %14s %9lu%%\n", count, time,
+                ops, efficiency);
+        }
+
+        if (count >= maxThreads) {
+            break;
+        }
+        count = count * 2 < maxThreads ? count * 2 : maxThreads;
+    }
+    free(threads);
+}
+
+#endif /* defined(ZZTEST_CONFIG_THREADS) */
+
+/******************************************************************************/
+
+int
+zzt_bench_next(struct zzt_bench_s *pub)
+{
+    struct zzt_bench_state_s *bench = (struct zzt_bench_state_s *)pub;
+    ZZT_UINTMAX now = zzt_ns();
+    ZZT_BOOL more = ZZT_FALSE;
+#if defined(ZZT_PERF_)
+    ZZT_UINTMAX counts[ZZT_PERF_MAX];
+    unsigned long sampled = bench->samplesCount;
+    int i;
+#endif
+
+#if defined(ZZTEST_CONFIG_THREADS)
+    if (bench->group != NULL) {
+        return zzt_bench_group_next(bench);
+    }
+#endif
+#if defined(ZZT_PERF_)
+    if (bench->running) {
+        zzt_perf_read(counts);
+    }
+#endif
+    if (bench->isPaused) {
+        bench->paused += now - bench->pausedAt;
+        bench->isPaused = ZZT_FALSE;
+    }
+    more = zzt_bench_batch(bench, now);
+#if defined(ZZT_PERF_)
+    if (bench->samplesCount != sampled) {
+        for (i = 0; i < ZZT_PERF_MAX; i++) {
+            bench->perf[i] += counts[i] - bench->perfAt[i];
+        }
+        bench->perfIters += bench->iters;
+    }
+#endif
+    if (!more) {
+        return 0;
+    }
+
+    pub->left = bench->iters - 1; /* This call is the first. */
+#if defined(ZZT_PERF_)
+    zzt_perf_read(bench->perfAt);
+#endif
+    zzt_bench_start(bench);
+    return 1;
+}
+
+/******************************************************************************/
+
+void
+zzt_bench_pause(struct zzt_bench_s *pub)
+{
+    struct zzt_bench_state_s *bench = (struct zzt_bench_state_s *)pub;
+
+    if (bench->running && !bench->isPaused) {
+        bench->pausedAt = zzt_ns();
+        bench->isPaused = ZZT_TRUE;
+    }
+}
+
+/******************************************************************************/
+
+void
+zzt_bench_resume(struct zzt_bench_s *pub)
+{
+    struct zzt_bench_state_s *bench = (struct zzt_bench_state_s *)pub;
+
+    if (bench->isPaused) {
+        bench->paused += zzt_ns() - bench->pausedAt;
+        bench->isPaused = ZZT_FALSE;
+    }
+}
+
+/******************************************************************************/
+
+void
+zzt_bench_escape(const volatile void *ptr)
+{
+    g_benchSink = ptr;
+}
+
+#endif /* defined(ZZTEST_CONFIG_BENCH) */
+
+/******************************************************************************/
+
+void
+zzt_add_test_suite(struct zzt_test_suite_s *suite)
+{
+    if (g_suitesHead == NULL) {
+        g_testsCount = suite->tests_count;
+        g_suitesHead = suite;
+        g_suitesTail = g_suitesHead;
+        g_suitesCount = 1;
+    } else {
+        g_testsCount += suite->tests_count;
+        g_suitesTail->next = suite;
+        g_suitesTail = g_suitesTail->next;
+        g_suitesCount += 1;
+    }
+}
+
+/**
+ * @brief Decide whether a test should run at all.
+ */
+static ZZT_BOOL
+zzt_test_wanted(struct zzt_test_s *test)
+{
+    (void)test;
+#if defined(ZZTEST_CONFIG_SELECT)
+    if (!zzt_map_wanted(test)) {
+        return ZZT_FALSE;
+    }
+#endif
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Count the tests in a suite that will run.
+ */
+static unsigned long
+zzt_suite_wanted(struct zzt_test_suite_s *suite)
+{
+    struct zzt_test_s *test = suite->head;
+    unsigned long count = 0;
+
+    for (; test; test = test->next) {
+        if (zzt_test_wanted(test)) {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Report a test without running it, if it finished in the run being
+ *        resumed or passed in an earlier run of this binary.
+ *
+ * @return True if the test was reported.
+ */
+static ZZT_BOOL
+zzt_test_earlier(struct zzt_totals_s *totals, struct zzt_test_s *test,
+    unsigned long index, unsigned long slot)
+{
+    const char *result = "";
+    struct zzt_test_state_s state;
+    struct zzt_log_record_s record;
+
+    if (zzt_resume_find(index, test, &record)) {
+        /* Finished, or crashed, in the run being resumed. */
+        if (record.status == ZZT_STATUS_RUNNING && g_resumeRunning > 1) {
+            /* A parallel run can't tell which of its tests crashed. */
+            ZZT_PRINTF("%s: error: Running when an earlier run crashed\n\n",
+                test->test_name);
+            record.status = ZZT_STATUS_FAILED;
+        } else if (record.status == ZZT_STATUS_RUNNING) {
+            ZZT_PRINTF(
+                "%s: error: Crashed in an earlier run\n\n", test->test_name);
+            record.status = ZZT_STATUS_FAILED;
+        }
+
+        if (record.status == ZZT_STATUS_FAILED) {
+            result = ZZTLOG_FAILED;
+            zzt_add_fail(test);
+            totals->failed += 1;
+        } else if (record.status == ZZT_STATUS_SKIPPED) {
+            result = ZZTLOG_SKIPPED;
+            zzt_add_skip(test);
+            totals->skipped += 1;
+        } else {
+            result = ZZTLOG_OK;
+            totals->passed += 1;
+            if (g_options.cache != NULL) {
+                zzt_names_add(&g_cachePassed, test->test_name);
+            }
+        }
+
+        ZZT_PRINTF("%s %s (earlier run)\n", result, test->test_name);
+        zzt_log_write(slot, &record);
+        totals->resumed += 1;
+        return ZZT_TRUE;
+    }
+
+    if (zzt_names_has(&g_cached, test->test_name)) {
+        /* Passed in an earlier run of this same binary. */
+        memset(&state, 0, sizeof(state));
+        state.test = test;
+        ZZT_PRINTF(ZZTLOG_CACHED " %s\n", test->test_name);
+        zzt_names_add(&g_cachePassed, test->test_name);
+        zzt_log_record(&record, index, ZZT_STATUS_CACHED, 0, &state);
+        zzt_log_write(slot, &record);
+        totals->passed += 1;
+        totals->cached += 1;
+        return ZZT_TRUE;
+    }
+
+    return ZZT_FALSE;
+}
+
+/******************************************************************************/
+
+#if defined(ZZTEST_CONFIG_THREADS)
+
+#define ZZT_JOB_LOCKS 2
+
+/* A test queued for a parallel run. */
+struct zzt_job_s {
+    struct zzt_test_s *test;
+    unsigned long index; /* Position of the test among all tests. */
+    unsigned long slot;  /* Record of the test in the results log. */
+    unsigned long ms;    /* Duration in the last run, or 0. */
+    const char *locks[ZZT_JOB_LOCKS]; /* Suite and test lock, or NULL. */
+};
+
+/*
+ * Each worker owns a deque of jobs, dealt out longest first.  A worker
+ * takes jobs from the head of its own deque, and once that is empty steals
+ * from the tail of another's, so the short tests left at the end of a run
+ * fill the gaps instead of workers going idle.
+ */
+struct zzt_worker_s {
+    zzt_mutex_t lock;
+    struct zzt_job_s **jobs;
+    unsigned long head; /* Next job to run. */
+    unsigned long tail; /* One past the next job to steal. */
+    unsigned long self; /* Position in g_workers. */
+#if defined(_WIN32)
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+    ZZT_BOOL started;
+    long cpu;  /* Processor the worker is pinned to, or -1. */
+    long node; /* NUMA node the worker is pinned to, or -1. */
+    unsigned long tests;
+    unsigned long stolen;
+    unsigned long busyMs; /* Time spent running tests. */
+};
+
+#if (defined(__linux__) && defined(_GNU_SOURCE)) || defined(_WIN32)
+#define ZZT_HAS_PIN
+#endif
+
+/* Processors workers may be pinned to, listed node by node. */
+struct zzt_topology_s {
+    unsigned long *cpus;
+    unsigned long cpusCount;
+    unsigned long *nodes;   /* First entry of each node in cpus, then end. */
+    unsigned long *nodeIds; /* Number the OS gives each node. */
+    unsigned long nodesCount;
+};
+
+static struct zzt_worker_s *g_workers;
+static unsigned long g_workersCount;
+static struct zzt_totals_s *g_jobsTotals;
+static unsigned long *g_jobsMs; /* Duration in the last run by index. */
+
+/*
+ * Tests holding a lock wait in g_jobsLocked, in registration order, rather
+ * than in the deques.  Workers take the first one whose locks are free
+ * before anything else, so chains of tests sharing a lock start early.
+ * Both lists are guarded by g_jobsLock.
+ */
+static struct zzt_job_s **g_jobsLocked;
+static unsigned long g_jobsLockedCount;
+static const char **g_jobsHeld; /* Locks of the running tests. */
+static unsigned long g_jobsHeldCount;
+
+static struct zzt_topology_s g_topology;
+
+#if defined(ZZT_HAS_PIN)
+
+/**
+ * @brief Add a processor the process may run on to the current node.
+ */
+static void
+zzt_topology_add(unsigned long cpu)
+{
+    unsigned long i = 0;
+
+    for (i = 0; i < g_topology.cpusCount; i++) {
+        if (g_topology.cpus[i] == cpu) {
+            return; /* Listed by an earlier node. */
+        }
+    }
+    g_topology.cpus[g_topology.cpusCount++] = cpu;
+}
+
+/**
+ * @brief Close the current node if any processors were added to it.
+ */
+static void
+zzt_topology_node(unsigned long id)
+{
+    unsigned long first = g_topology.nodes[g_topology.nodesCount];
+
+    if (g_topology.cpusCount > first) {
+        g_topology.nodeIds[g_topology.nodesCount++] = id;
+        g_topology.nodes[g_topology.nodesCount] = g_topology.cpusCount;
+    }
+}
+
+/**
+ * @brief List the processors the process may run on, node by node.  The
+ *        processors of no known node form a node of their own.
+ */
+static void
+zzt_topology_read(void)
+{
+#if defined(_WIN32)
+    DWORD_PTR allowed = 0, system = 0;
+    ULONGLONG mask = 0;
+    ULONG highest = 0;
+#else
+    cpu_set_t allowed;
+    DIR *dir = NULL;
+    struct dirent *entry = NULL;
+    FILE *file = NULL;
+    char path[64];
+    unsigned long last = 0;
+    int c = 0;
+#endif
+    unsigned long count = 0, cpu = 0, node = 0, maxNode = 0;
+
+    if (g_topology.cpus != NULL) {
+        return;
+    }
+#if defined(_WIN32)
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &allowed, &system)) {
+        return;
+    }
+    count = sizeof(allowed) * 8;
+    if (!GetNumaHighestNodeNumber(&highest)) {
+        highest = 0;
+    }
+    maxNode = highest;
+#else
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+    }
+    count = CPU_SETSIZE;
+    if ((dir = opendir("/sys/devices/system/node")) != NULL) {
+        while ((entry = readdir(dir)) != NULL) {
+            if (strncmp(entry->d_name, "node", 4) == 0 &&
+                entry->d_name[4] >= '0' && entry->d_name[4] <= '9' &&
+                (node = strtoul(entry->d_name + 4, NULL, 10)) > maxNode) {
+                maxNode = node;
+            }
+        }
+        closedir(dir);
+    }
+#endif
+
+    g_topology.cpus = (unsigned long *)malloc(count * sizeof(long));
+    g_topology.nodes = (unsigned long *)calloc(maxNode + 3, sizeof(long));
+    g_topology.nodeIds = (unsigned long *)calloc(maxNode + 2, sizeof(long));
+    if (g_topology.cpus == NULL || g_topology.nodes == NULL ||
+        g_topology.nodeIds == NULL) {
+        free(g_topology.cpus);
+        free(g_topology.nodes);
+        free(g_topology.nodeIds);
+        memset(&g_topology, 0, sizeof(g_topology));
+        return;
+    }
+
+    for (node = 0; node <= maxNode; node++) {
+#if defined(_WIN32)
+        if (!GetNumaNodeProcessorMask((UCHAR)node, &mask)) {
+            continue;
+        }
+        for (cpu = 0; cpu < count; cpu++) {
+            if ((allowed & mask & ((DWORD_PTR)1 << cpu)) != 0) {
+                zzt_topology_add(cpu);
+            }
+        }
+#else
+        /* A list of ranges such as 0-3,8-11 */
+        zzt_sprintf(path, sizeof(path),
+            "/sys/devices/system/node/node%lu/cpulist", node);
+        if ((file = fopen(path, "r")) == NULL) {
+            continue;
+        }
+        while (fscanf(file, "%lu", &cpu) == 1) {
+            last = cpu;
+            if ((c = fgetc(file)) == '-') {
+                if (fscanf(file, "%lu", &last) != 1) {
+                    break;
+                }
+                c = fgetc(file);
+            }
+            for (; cpu <= last && cpu < count; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    zzt_topology_add(cpu);
+                }
+            }
+            if (c != ',') {
+                break;
+            }
+        }
+        fclose(file);
+#endif
+        zzt_topology_node(node);
+    }
+
+    for (cpu = 0; cpu < count; cpu++) {
+#if defined(_WIN32)
+        if ((allowed & ((DWORD_PTR)1 << cpu)) != 0) {
+#else
+        if (CPU_ISSET(cpu, &allowed)) {
+#endif
+            zzt_topology_add(cpu);
+        }
+    }
+    zzt_topology_node(g_topology.nodesCount != 0 ? maxNode + 1 : 0);
+}
+
+/**
+ * @brief Keep the calling thread on the given processors.
+ *
+ * @return False if the OS refused.
+ */
+static ZZT_BOOL
+zzt_topology_pin(const unsigned long *cpus, unsigned long count)
+{
+    unsigned long i = 0;
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+
+    for (i = 0; i < count; i++) {
+        mask |= (DWORD_PTR)1 << cpus[i];
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    for (i = 0; i < count; i++) {
+        CPU_SET(cpus[i], &set);
+    }
+    /* Zero is the calling thread, not the whole process. */
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+}
+
+#endif /* defined(ZZT_HAS_PIN) */
+
+/**
+ * @brief Pin a worker as g_options.pin asks.  Neighbouring workers share
+ *        a node, so the first victims a worker steals from are local.
+ *        Memory a pinned worker touches first is allocated on its node.
+ */
+static void
+zzt_jobs_pin(struct zzt_worker_s *worker)
+{
+#if defined(ZZT_HAS_PIN)
+    unsigned long cpu = 0, node = 0, first = 0;
+
+    if (g_topology.cpusCount == 0) {
+        return;
+    }
+    if (g_options.pin == ZZT_PIN_CPU) {
+        cpu = g_topology.cpus[worker->self % g_topology.cpusCount];
+        if (zzt_topology_pin(&cpu, 1)) {
+            worker->cpu = (long)cpu;
+        }
+    } else if (g_options.pin == ZZT_PIN_NODE) {
+        node = worker->self * g_topology.nodesCount / g_workersCount;
+        first = g_topology.nodes[node];
+        if (zzt_topology_pin(g_topology.cpus + first,
+                g_topology.nodes[node + 1] - first)) {
+            worker->node = (long)g_topology.nodeIds[node];
+        }
+    }
+#else
+    (void)worker;
+#endif
+}
+
+/**
+ * @brief Read test durations from the results log of the last run, so the
+ *        longest tests can be started first.
+ */
+static void
+zzt_jobs_history(const char *path)
+{
+    struct zzt_log_header_s header;
+    struct zzt_log_record_s *records = NULL;
+    struct zzt_test_s **tests = NULL;
+    struct zzt_test_suite_s *suite = g_suitesHead;
+    struct zzt_test_s *test = NULL;
+    unsigned long i = 0, index = 0;
+
+    records = zzt_log_read(path, "not using its durations", &header);
+    if (records == NULL) {
+        return;
+    }
+
+    tests = (struct zzt_test_s **)calloc(g_testsCount + 1, sizeof(*tests));
+    g_jobsMs = (unsigned long *)calloc(g_testsCount + 1, sizeof(long));
+    if (tests != NULL && g_jobsMs != NULL) {
+        for (; suite; suite = suite->next) {
+            for (test = suite->head; test; test = test->next) {
+                tests[index++] = test;
+            }
+        }
+        for (i = 0; i < header.count; i++) {
+            index = records[i].index;
+            if (index < g_testsCount && records[i].status != 0 &&
+                zzt_log_matches(&records[i], tests[index])) {
+                g_jobsMs[index] = records[i].ms;
+            }
+        }
+    }
+
+    free(tests);
+    free(records);
+}
+
+/**
+ * @brief Order jobs longest first, then in registration order.
+ */
+static int
+zzt_jobs_cmp(const void *l, const void *r)
+{
+    const struct zzt_job_s *lj = *(const struct zzt_job_s *const *)l;
+    const struct zzt_job_s *rj = *(const struct zzt_job_s *const *)r;
+
+    if (lj->ms != rj->ms) {
+        return lj->ms > rj->ms ? -1 : 1;
+    }
+    return lj->index < rj->index ? -1 : lj->index > rj->index;
+}
+
+/**
+ * @brief Check whether a running test holds any of the locks of a job.
+ */
+static ZZT_BOOL
+zzt_jobs_blocked(const struct zzt_job_s *job)
+{
+    unsigned long i = 0, k = 0;
+
+    for (k = 0; k < ZZT_JOB_LOCKS; k++) {
+        if (job->locks[k] == NULL) {
+            continue;
+        }
+        for (i = 0; i < g_jobsHeldCount; i++) {
+            if (strcmp(g_jobsHeld[i], job->locks[k]) == 0) {
+                return ZZT_TRUE;
+            }
+        }
+    }
+    return ZZT_FALSE;
+}
+
+/**
+ * @brief Release the locks of a finished job, and claim the first waiting
+ *        job whose locks are free.  Called with g_jobsLock held, so a job
+ *        blocked by this one is seen by this worker if by no other.
+ *
+ * @return Job, or NULL if none can run now.
+ */
+static struct zzt_job_s *
+zzt_jobs_locked(struct zzt_job_s *done)
+{
+    struct zzt_job_s *job = NULL;
+    unsigned long i = 0, k = 0;
+
+    for (k = 0; done != NULL && k < ZZT_JOB_LOCKS; k++) {
+        for (i = 0; done->locks[k] != NULL && i < g_jobsHeldCount; i++) {
+            if (g_jobsHeld[i] == done->locks[k]) {
+                g_jobsHeld[i] = g_jobsHeld[--g_jobsHeldCount];
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < g_jobsLockedCount; i++) {
+        if (!zzt_jobs_blocked(g_jobsLocked[i])) {
+            job = g_jobsLocked[i];
+            memmove(&g_jobsLocked[i], &g_jobsLocked[i + 1],
+                (g_jobsLockedCount - i - 1) * sizeof(*g_jobsLocked));
+            g_jobsLockedCount -= 1;
+            break;
+        }
+    }
+
+    for (k = 0; job != NULL && k < ZZT_JOB_LOCKS; k++) {
+        if (job->locks[k] != NULL) {
+            g_jobsHeld[g_jobsHeldCount++] = job->locks[k];
+        }
+    }
+    return job;
+}
+
+/**
+ * @brief Take the next job of a worker once done is finished: a waiting
+ *        job whose locks are free, the head of its own deque, or one
+ *        stolen from another.
+ *
+ * @return Job, or NULL once every deque is empty and no waiting job can
+ *         run now.
+ */
+static struct zzt_job_s *
+zzt_jobs_next(struct zzt_worker_s *worker, struct zzt_job_s *done)
+{
+    struct zzt_job_s *job = NULL;
+    unsigned long i = 0;
+
+    ZZT_LOCK_(&g_jobsLock);
+    job = zzt_jobs_locked(done);
+    ZZT_UNLOCK_(&g_jobsLock);
+    if (job != NULL) {
+        return job;
+    }
+
+    ZZT_LOCK_(&worker->lock);
+    if (worker->head < worker->tail) {
+        job = worker->jobs[worker->head++];
+    }
+    ZZT_UNLOCK_(&worker->lock);
+
+    for (i = 1; job == NULL && i < g_workersCount; i++) {
+        struct zzt_worker_s *victim =
+            &g_workers[(worker->self + i) % g_workersCount];
+        ZZT_LOCK_(&victim->lock);
+        if (victim->head < victim->tail) {
+            job = victim->jobs[--victim->tail];
+            worker->stolen += 1;
+        }
+        ZZT_UNLOCK_(&victim->lock);
+    }
+    return job;
+}
+
+/**
+ * @brief Run one test on a worker.
+ *
+ * @return Duration of the test in milliseconds.
+ */
+static unsigned long
+zzt_jobs_test(struct zzt_job_s *job)
+{
+    const char *result = NULL;
+    unsigned long startMs = 0, ms = 0;
+    struct zzt_test_state_s state;
+    struct zzt_log_record_s record;
+
+    memset(&state, 0, sizeof(state));
+    state.test = job->test;
+
+    ZZT_LOCK_(&g_printLock);
+    ZZT_PRINTF(ZZTLOG_RUN " %s\n", job->test->test_name);
+    ZZT_UNLOCK_(&g_printLock);
+    zzt_log_record(&record, job->index, ZZT_STATUS_RUNNING, 0, &state);
+    ZZT_LOCK_(&g_jobsLock);
+    zzt_log_write(job->slot, &record);
+    ZZT_UNLOCK_(&g_jobsLock);
+    zzt_trace_reset();
+
+    startMs = zzt_ms();
+    job->test->func(&state);
+#if defined(ZZT_HAS_DEATH_TEST)
+    if (g_deathChildFd >= 0) {
+        /* The death test statement returned from the test. */
+        struct zzt_death_s death;
+        death.statusfd = g_deathChildFd;
+        zzt_death_returned(&death);
+    }
+#endif
+    zzt_thread_collect(&state);
+    ms = zzt_ms() - startMs;
+
+    ZZT_LOCK_(&g_jobsLock);
+    result = zzt_test_finish(g_jobsTotals, job->index, job->slot, &state, ms);
+    ZZT_UNLOCK_(&g_jobsLock);
+
+    ZZT_LOCK_(&g_printLock);
+    zzt_test_print(result, job->test->test_name, ms);
+    ZZT_UNLOCK_(&g_printLock);
+#if defined(ZZTEST_CONFIG_WIRE)
+    zzt_wire_flush();
+#endif
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+    zzt_transport_poll();
+#endif
+    return ms;
+}
+
+/**
+ * @brief Worker thread, runs jobs until there are none left to steal.
+ */
+#if defined(_WIN32)
+static DWORD WINAPI
+zzt_jobs_worker(LPVOID ptr)
+#else
+static void *
+zzt_jobs_worker(void *ptr)
+#endif
+{
+    struct zzt_worker_s *worker = (struct zzt_worker_s *)ptr;
+    struct zzt_job_s *job = NULL;
+
+    zzt_jobs_pin(worker);
+    while ((job = zzt_jobs_next(worker, job)) != NULL) {
+        worker->busyMs += zzt_jobs_test(job);
+        worker->tests += 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Print how each worker spent a parallel run of ms milliseconds.
+ */
+static void
+zzt_jobs_report(unsigned long ms)
+{
+    char where[32];
+    unsigned long i = 0;
+
+    for (i = 0; i < g_workersCount; i++) {
+        struct zzt_worker_s *worker = &g_workers[i];
+        where[0] = '\0';
+        if (worker->cpu >= 0) {
+            zzt_sprintf(where, sizeof(where), " on CPU %ld", worker->cpu);
+        } else if (worker->node >= 0) {
+            zzt_sprintf(where, sizeof(where), " on node %ld", worker->node);
+        }
+        if (ms) {
+            ZZT_PRINTF(ZZTLOG_H2 " Worker %lu%s: %lu tests, %lu stolen, "
+                                 "%lu ms busy (%lu%%)\n",
+                i, where, worker->tests, worker->stolen, worker->busyMs,
+                worker->busyMs * 100 / ms);
+        } else {
+            ZZT_PRINTF(ZZTLOG_H2 " Worker %lu%s: %lu tests, %lu stolen\n", i,
+                where, worker->tests, worker->stolen);
+        }
+    }
+}
+
+/**
+ * @brief Run the wanted tests on g_options.jobs workers.  This thread is
+ *        the first worker, so the run finishes even if no thread starts.
+ *
+ * @return False if the run couldn't be set up, and nothing ran.
+ */
+static ZZT_BOOL
+zzt_jobs_run(struct zzt_totals_s *totals, unsigned long testsCount)
 {
-    ZZT_BOOL isEqual = ZZT_FALSE;
+    struct zzt_test_suite_s *suite = g_suitesHead;
+    struct zzt_test_s *test = NULL;
+    struct zzt_job_s *jobs = NULL, *job = NULL, **order = NULL;
+    struct zzt_job_s **dealt = NULL, **serial = NULL;
+    unsigned long count = 0, index = 0, logSlot = 0, i = 0;
+    unsigned long serialCount = 0, lockedCount = 0;
+    unsigned long startMs = 0, ms = 0;
+    unsigned long workersCount = g_options.jobs;
 
-    switch (cmp) {
-    case ZZT_CMP_EQ: isEqual = l == r; break;
-    case ZZT_CMP_NE: isEqual = l != r; break;
-    case ZZT_CMP_LT: isEqual = l < r; break;
-    case ZZT_CMP_LE: isEqual = l <= r; break;
-    case ZZT_CMP_GT: isEqual = l > r; break;
-    case ZZT_CMP_GE: isEqual = l >= r; break;
+#if defined(ZZTEST_CONFIG_SELECT)
+    if (g_options.record) {
+        return ZZT_FALSE; /* Recording follows one test at a time. */
     }
+#endif
 
-    if (isEqual) {
-        state->passed += 1;
-        return ZZT_TRUE;
+    jobs = (struct zzt_job_s *)malloc((testsCount + 1) * sizeof(*jobs));
+    order = (struct zzt_job_s **)malloc((testsCount + 1) * sizeof(*order));
+    dealt = (struct zzt_job_s **)malloc((testsCount + 1) * sizeof(*dealt));
+    serial = (struct zzt_job_s **)malloc((testsCount + 1) * sizeof(*serial));
+    g_jobsLocked =
+        (struct zzt_job_s **)malloc((testsCount + 1) * sizeof(*g_jobsLocked));
+    g_jobsHeld = (const char **)malloc(
+        (workersCount * ZZT_JOB_LOCKS + 1) * sizeof(*g_jobsHeld));
+    g_workers = (struct zzt_worker_s *)calloc(workersCount, sizeof(*g_workers));
+    if (jobs == NULL || order == NULL || dealt == NULL || serial == NULL ||
+        g_jobsLocked == NULL || g_jobsHeld == NULL || g_workers == NULL) {
+        free(jobs);
+        free(order);
+        free(dealt);
+        free(serial);
+        free(g_jobsLocked);
+        free(g_jobsHeld);
+        free(g_workers);
+        g_jobsLocked = NULL;
+        g_jobsHeld = NULL;
+        g_workers = NULL;
+        return ZZT_FALSE;
     }
 
-    state->failed += 1;
-    zzt_printerr(fmt, cmp, &l, &r, ls, rs, file, line);
-    return ZZT_FALSE;
-}
-
-/******************************************************************************/
-
-ZZT_BOOL
-zzt_cmp_str(struct zzt_test_state_s *state, enum zzt_fmt_e fmt,
-    enum zzt_cmp_e cmp, const char *l, const char *r, const char *ls,
-    const char *rs, const char *file, unsigned long line)
-{
-    ZZT_BOOL isEqual = ZZT_FALSE;
+    for (; suite; suite = suite->next) {
+        for (test = suite->head; test; test = test->next) {
+            unsigned long testIndex = index++;
+            if (!zzt_test_wanted(test)) {
+                continue;
+            }
+            if (zzt_test_earlier(totals, test, testIndex, logSlot)) {
+                logSlot += 1;
+                continue;
+            }
+            job = &jobs[count + lockedCount + serialCount];
+            job->test = test;
+            job->index = testIndex;
+            job->slot = logSlot++;
+            job->ms = g_jobsMs != NULL ? g_jobsMs[testIndex] : 0;
+            job->locks[0] = suite->lock;
+            job->locks[1] = test->lock;
+            if (test->flags & (ZZT_TEST_SERIAL | ZZT_TEST_BENCH)) {
+                serial[serialCount++] = job;
+            } else if (suite->lock != NULL || test->lock != NULL) {
+                g_jobsLocked[lockedCount++] = job;
+            } else {
+                order[count++] = job;
+            }
+        }
+    }
+    g_jobsLockedCount = lockedCount;
+    g_jobsHeldCount = 0;
 
-    switch (cmp) {
-    case ZZT_CMP_EQ: isEqual = 0 == strcmp(l, r); break;
-    case ZZT_CMP_NE: isEqual = 0 != strcmp(l, r); break;
+    /* Deal longest first, so every worker starts on a long test. */
+    qsort(order, count, sizeof(*order), zzt_jobs_cmp);
+    if (workersCount > count + lockedCount) {
+        workersCount = count + lockedCount != 0 ? count + lockedCount : 1;
+    }
+    for (i = 0; i < workersCount; i++) {
+        struct zzt_worker_s *worker = &g_workers[i];
+        unsigned long share = count / workersCount;
+        unsigned long extra = count % workersCount;
+        ZZT_MUTEX_CREATE_(&worker->lock);
+        worker->jobs = dealt + i * share + (i < extra ? i : extra);
+        worker->tail = share + (i < extra);
+        worker->self = i;
+        worker->cpu = -1;
+        worker->node = -1;
+    }
+    for (i = 0; i < count; i++) {
+        g_workers[i % workersCount].jobs[i / workersCount] = order[i];
+    }
+    g_workersCount = workersCount;
+    g_jobsTotals = totals;
+    count += lockedCount + serialCount;
+    if (g_options.pin != ZZT_PIN_NONE) {
+#if defined(ZZT_HAS_PIN)
+        zzt_topology_read();
+#endif
+        if (g_topology.cpusCount == 0) {
+            ZZT_PRINTF("warning: Can't list processors, not pinning\n");
+        }
     }
 
-    if (isEqual) {
-        state->passed += 1;
-        return ZZT_TRUE;
+    ZZT_PRINTF(ZZTLOG_H2 " %lu tests on %lu workers\n", count, workersCount);
+    startMs = zzt_ms();
+    for (i = 1; i < workersCount; i++) {
+        struct zzt_worker_s *worker = &g_workers[i];
+#if defined(_WIN32)
+        worker->thread =
+            CreateThread(NULL, 0, zzt_jobs_worker, worker, 0, NULL);
+        worker->started = worker->thread != NULL;
+#else
+        worker->started = pthread_create(&worker->thread, NULL,
+                              zzt_jobs_worker, worker) == 0;
+#endif
+    }
+    zzt_jobs_worker(&g_workers[0]);
+    for (i = 1; i < workersCount; i++) {
+        struct zzt_worker_s *worker = &g_workers[i];
+        if (!worker->started) {
+            continue;
+        }
+#if defined(_WIN32)
+        WaitForSingleObject(worker->thread, INFINITE);
+        CloseHandle(worker->thread);
+#else
+        pthread_join(worker->thread, NULL);
+#endif
+    }
+    /* Serial tests run once every worker is done. */
+    for (i = 0; i < serialCount; i++) {
+        g_workers[0].busyMs += zzt_jobs_test(serial[i]);
+        g_workers[0].tests += 1;
+    }
+    ms = zzt_ms() - startMs;
+#if defined(ZZT_HAS_PIN)
+    if (g_workers[0].cpu >= 0 || g_workers[0].node >= 0) {
+        zzt_topology_pin(g_topology.cpus, g_topology.cpusCount);
+    }
+#endif
+    zzt_jobs_report(ms);
+    if (ms) {
+        ZZT_PRINTF(ZZTLOG_H2 " %lu tests on %lu workers (%lu ms total)\n\n",
+            count, workersCount, ms);
+    } else {
+        ZZT_PRINTF(
+            ZZTLOG_H2 " %lu tests on %lu workers\n\n", count, workersCount);
     }
 
-    state->failed += 1;
-    zzt_printerr(fmt, cmp, l, r, ls, rs, file, line);
-    return ZZT_FALSE;
+    for (i = 0; i < workersCount; i++) {
+        ZZT_MUTEX_DESTROY_(&g_workers[i].lock);
+    }
+    free(jobs);
+    free(order);
+    free(dealt);
+    free(serial);
+    free(g_jobsLocked);
+    free(g_jobsHeld);
+    free(g_workers);
+    g_jobsLocked = NULL;
+    g_jobsHeld = NULL;
+    g_workers = NULL;
+    g_workersCount = 0;
+    return ZZT_TRUE;
 }
 
-/******************************************************************************/
+#endif /* defined(ZZTEST_CONFIG_THREADS) */
 
-void
-zzt_scoped_trace(const char *fmt, ...)
-{
-    va_list va;
-    va_start(va, fmt);
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
 
-    zzt_vsprintf(g_scopedTrace, sizeof(g_scopedTrace), fmt, va);
+/* Time a suite spent in tests, see zzt_print_slowest. */
+struct zzt_suite_time_s {
+    const char *name;
+    unsigned long ms;
+};
 
-    va_end(va);
+/**
+ * @brief Print one line of the slowest tests or suites, with its share of
+ *        totalMs to a tenth of a percent.
+ */
+static void
+zzt_print_share(const char *name, unsigned long ms, unsigned long totalMs)
+{
+    unsigned long share = (unsigned long)((double)ms * 1000 / totalMs + 0.5);
+    ZZT_PRINTF(ZZTLOG_SLOW " %8lu ms %3lu.%lu%%  %s\n", ms, share / 10,
+        share % 10, name);
 }
 
-/******************************************************************************/
-
-void
-zzt_add_test_suite(struct zzt_test_suite_s *suite)
+/**
+ * @brief Print the count slowest tests of the run, and how the time spent
+ *        in tests splits between suites, slowest first.
+ */
+static void
+zzt_print_slowest(unsigned long count)
 {
-    if (g_suitesHead == NULL) {
-        g_testsCount = suite->tests_count;
-        g_suitesHead = suite;
-        g_suitesTail = g_suitesHead;
-        g_suitesCount = 1;
-    } else {
-        g_testsCount += suite->tests_count;
-        g_suitesTail->next = suite;
-        g_suitesTail = g_suitesTail->next;
-        g_suitesCount += 1;
+    struct zzt_test_suite_s *suite = NULL;
+    struct zzt_test_s *test = NULL, **slowest = NULL;
+    struct zzt_suite_time_s *suites = NULL, time;
+    unsigned long i = 0, found = 0, suitesCount = 0, totalMs = 0;
+
+    for (suite = g_suitesHead; suite; suite = suite->next) {
+        suitesCount += 1;
+        for (test = suite->head; test; test = test->next) {
+            totalMs += test->ms;
+        }
+    }
+    if (totalMs == 0) {
+        return;
+    }
+    if (count > g_testsCount) {
+        /* A huge --slowest would only overflow the allocation. */
+        count = g_testsCount;
+    }
+
+    slowest = (struct zzt_test_s **)malloc(count * sizeof(*slowest));
+    suites = (struct zzt_suite_time_s *)malloc(suitesCount * sizeof(*suites));
+    if (slowest == NULL || suites == NULL) {
+        free(slowest);
+        free(suites);
+        return;
+    }
+
+    /* Insertion into the sorted top, so ties keep the order tests ran in. */
+    for (suite = g_suitesHead; suite; suite = suite->next) {
+        for (test = suite->head; test; test = test->next) {
+            if (test->ms == 0 ||
+                (found == count && slowest[count - 1]->ms >= test->ms)) {
+                continue;
+            }
+            i = found < count ? found++ : count - 1;
+            for (; i > 0 && slowest[i - 1]->ms < test->ms; i--) {
+                slowest[i] = slowest[i - 1];
+            }
+            slowest[i] = test;
+        }
+    }
+
+    ZZT_PRINTF(ZZTLOG_SLOW " %lu slowest tests, of %lu ms in all tests:\n",
+        found, totalMs);
+    for (i = 0; i < found; i++) {
+        zzt_print_share(slowest[i]->test_name, slowest[i]->ms, totalMs);
+    }
+
+    suitesCount = 0;
+    for (suite = g_suitesHead; suite; suite = suite->next) {
+        time.name = suite->suite_name;
+        time.ms = 0;
+        for (test = suite->head; test; test = test->next) {
+            time.ms += test->ms;
+        }
+        if (time.ms == 0) {
+            continue;
+        }
+        i = suitesCount++;
+        for (; i > 0 && suites[i - 1].ms < time.ms; i--) {
+            suites[i] = suites[i - 1];
+        }
+        suites[i] = time;
+    }
+
+    ZZT_PRINTF(ZZTLOG_SLOW " Time by suite:\n");
+    for (i = 0; i < suitesCount; i++) {
+        zzt_print_share(suites[i].name, suites[i].ms, totalMs);
     }
+
+    free(slowest);
+    free(suites);
 }
 
+#endif /* !defined(ZZTEST_CONFIG_NO_TIMING) */
+
 /******************************************************************************/
 
 int
 zzt_run_all(void)
 {
-    unsigned long passed = 0, failed = 0, skipped = 0;
+    struct zzt_totals_s totals = {0, 0, 0, 0, 0};
     unsigned long startAllMs = 0, allMs = 0;
+    unsigned long testsCount = 0, suitesCount = 0;
+    unsigned long testIndex = 0, logSlot = 0;
     struct zzt_test_suite_s *suite = g_suitesHead;
     struct zzt_test_s *test = NULL;
+    struct zzt_log_record_s record;
+#if defined(ZZT_PERF_)
+    ZZT_BOOL perfEnabled = ZZT_FALSE;
+    ZZT_UINTMAX perfValues[ZZT_PERF_MAX];
+    ZZT_UINTMAX perfSuite[ZZT_PERF_MAX];
+#endif
 
-#if defined(_WIN32)
+#if defined(_WIN32) && !defined(ZZTEST_CONFIG_NO_TIMING)
     /* Set timer resolution to 1ms. */
     timeBeginPeriod(1);
 #endif
 
+#if defined(ZZTEST_CONFIG_THREADS)
+    if (!g_threadKeyValid) {
+#if defined(_WIN32)
+        g_threadKey = FlsAlloc(zzt_thread_exit);
+        g_threadKeyValid = g_threadKey != FLS_OUT_OF_INDEXES;
+#else
+        g_threadKeyValid =
+            pthread_key_create(&g_threadKey, zzt_thread_exit) == 0;
+#endif
+    }
+#endif
+
+#if defined(ZZT_PERF_)
+    perfEnabled = zzt_perf_open() != 0;
+    if (!perfEnabled) {
+        ZZT_PRINTF(ZZTLOG_PERF " Hardware counters are unavailable.\n");
+    }
+#endif
+
+#if defined(ZZTEST_CONFIG_SELECT)
+    if (g_options.map != NULL) {
+        zzt_map_load(g_options.map);
+    }
+    if (g_options.changed != NULL && !zzt_map_changed(g_options.changed)) {
+        ZZT_PRINTF("%s: error: Could not read changed symbols\n",
+            g_options.changed);
+        zzt_map_close();
+        return 1;
+    }
+#endif
+
+    if (g_options.cache != NULL) {
+        zzt_cache_load(g_options.cache);
+    }
+#if defined(ZZTEST_CONFIG_BENCH)
+    if (g_options.benchOut != NULL) {
+        zzt_bench_out_open(g_options.benchOut);
+    }
+#endif
+
+    for (; suite; suite = suite->next) {
+        unsigned long count = zzt_suite_wanted(suite);
+        testsCount += count;
+        suitesCount += count != 0;
+    }
+
+#if defined(ZZTEST_CONFIG_SELECT)
+    if (g_mapChanged != NULL) {
+        ZZT_PRINTF(ZZTLOG_H1 " Selected %lu of %lu tests affected by "
+                             "changes.\n",
+            testsCount, g_testsCount);
+    }
+#endif
+
+    if (g_options.log != NULL) {
+        if (g_options.resume) {
+            zzt_resume_load(g_options.log);
+        }
+#if defined(ZZTEST_CONFIG_THREADS)
+        if (g_options.jobs > 1) {
+            zzt_jobs_history(g_options.log);
+        }
+#endif
+        zzt_log_open(g_options.log, testsCount);
+    }
+
     ZZT_PRINTF(ZZTLOG_H1 " Running %lu tests from %lu test suites.\n",
-        g_testsCount, g_suitesCount);
+        testsCount, suitesCount);
     startAllMs = zzt_ms();
 
+    suite = g_suitesHead;
+#if defined(ZZTEST_CONFIG_THREADS)
+    if (g_options.jobs > 1 && zzt_jobs_run(&totals, testsCount)) {
+        suite = NULL; /* Already ran, skip the suites. */
+    }
+    free(g_jobsMs);
+    g_jobsMs = NULL;
+#endif
     for (; suite; suite = suite->next) {
         unsigned long startSuiteMs = 0, suiteMs = 0;
+        unsigned long suiteCount = zzt_suite_wanted(suite);
+
+        if (suiteCount == 0) {
+            continue;
+        }
 
-        ZZT_PRINTF(ZZTLOG_H2 " %lu tests from %s\n", suite->tests_count,
+        ZZT_PRINTF(ZZTLOG_H2 " %lu tests from %s\n", suiteCount,
             suite->suite_name);
+#if defined(ZZT_PERF_)
+        memset(perfSuite, 0, sizeof(perfSuite));
+#endif
         startSuiteMs = zzt_ms();
 
         test = suite->head;
         for (; test; test = test->next) {
             const char *result = "";
+            unsigned long index = testIndex++, slot = 0;
             unsigned long startTestMs = 0, testMs = 0;
             struct zzt_test_state_s state;
+#if defined(ZZTEST_CONFIG_ALLOC)
+            unsigned long startAllocs = 0;
+            long startBlocks = 0, startBytes = 0;
+            long leakedBlocks = 0, leakedBytes = 0;
+#endif
+
+            if (!zzt_test_wanted(test)) {
+                continue;
+            }
+
+            if (zzt_test_earlier(&totals, test, index, logSlot)) {
+                logSlot += 1;
+                continue;
+            }
 
-            ZZT_PRINTF(ZZTLOG_RUN " %s\n", test->test_name);
             state.test = test;
             state.passed = 0;
             state.failed = 0;
             state.skipped = 0;
-            g_scopedTrace[0] = '\0';
+            state.fail_file = NULL;
+            state.fail_line = 0;
+
+#if defined(ZZTEST_CONFIG_ASYNC)
+            /* Async tests share the event loop, other tests run alone. */
+            if (test->flags & ZZT_TEST_ASYNC) {
+                zzt_async_drain(&totals, ZZTEST_CONFIG_ASYNC_SLOTS - 1);
+            } else {
+                zzt_async_drain(&totals, 0);
+            }
+#endif
+
+            ZZT_PRINTF(ZZTLOG_RUN " %s\n", test->test_name);
+            slot = logSlot++;
+            zzt_log_record(&record, index, ZZT_STATUS_RUNNING, 0, &state);
+            zzt_log_write(slot, &record);
+            zzt_trace_reset();
+#if defined(ZZTEST_CONFIG_ASYNC)
+            if (test->flags & ZZT_TEST_ASYNC) {
+                zzt_async_prepare(index, slot);
+            }
+#endif
+
+#if defined(ZZTEST_CONFIG_ALLOC)
+            startAllocs = g_alloc.count;
+            startBlocks = g_alloc.blocks;
+            startBytes = g_alloc.bytes;
+            g_alloc.peak = g_alloc.bytes;
+#endif
 
             startTestMs = zzt_ms();
+#if defined(ZZT_PERF_)
+            if (perfEnabled) {
+                zzt_perf_start();
+            }
+#endif
+#if defined(ZZTEST_CONFIG_SELECT)
+            if (g_options.record) {
+                zzt_map_start();
+            }
+#endif
             test->func(&state);
+#if defined(ZZTEST_CONFIG_SELECT)
+            zzt_map_stop();
+#endif
+#if defined(ZZT_HAS_DEATH_TEST)
+            if (g_deathChildFd >= 0) {
+                /* The death test statement returned from the test. */
+                struct zzt_death_s death;
+                death.statusfd = g_deathChildFd;
+                zzt_death_returned(&death);
+            }
+#endif
+#if defined(ZZT_PERF_)
+            if (perfEnabled) {
+                zzt_perf_stop(perfValues, perfSuite);
+            }
+#endif
+#if defined(ZZTEST_CONFIG_ASYNC)
+            if (g_asyncStarted) {
+                /* Waiting, zzt_async_reap reports it when it's done. */
+                g_asyncStarted = ZZT_FALSE;
+                continue;
+            }
+#endif
+#if defined(ZZTEST_CONFIG_THREADS)
+            zzt_thread_collect(&state);
+#endif
             testMs = zzt_ms() - startTestMs;
 
-            if (state.failed != 0) {
-                result = ZZTLOG_FAILED;
-                zzt_add_fail(test);
-                failed += 1;
-            } else if (state.skipped != 0) {
-                result = ZZTLOG_SKIPPED;
-                zzt_add_skip(test);
-                skipped += 1;
+#if defined(ZZTEST_CONFIG_ALLOC)
+            leakedBlocks = g_alloc.blocks - startBlocks;
+            leakedBytes = g_alloc.bytes - startBytes;
+            if (leakedBytes > 0) {
+                /* Could be a cache libc fills once, see EXPECT_NO_LEAKS. */
+                ZZT_PRINTF(
+                    "%s: warning: Leaked %ld bytes in %ld allocations\n\n",
+                    test->test_name, leakedBytes, leakedBlocks);
             } else {
-                result = ZZTLOG_OK;
-                passed += 1;
+                leakedBytes = 0;
             }
+#endif
 
-            if (testMs) {
-                ZZT_PRINTF("%s %s (%lu ms)\n", result, test->test_name, testMs);
-            } else {
-                ZZT_PRINTF("%s %s\n", result, test->test_name);
+            result = zzt_test_finish(&totals, index, slot, &state, testMs);
+
+#if defined(ZZTEST_CONFIG_ALLOC)
+            ZZT_PRINTF("%s %s (%lu ms, %lu allocs, %ld bytes peak, %ld bytes "
+                       "leaked)\n",
+                result, test->test_name, testMs, g_alloc.count - startAllocs,
+                g_alloc.peak - startBytes, leakedBytes);
+#else
+            zzt_test_print(result, test->test_name, testMs);
+#endif
+
+#if defined(ZZT_PERF_)
+            if (perfEnabled) {
+                zzt_perf_print(test->test_name, perfValues);
             }
+#endif
+#if defined(ZZTEST_CONFIG_SELECT)
+            if (g_options.record) {
+                zzt_map_record(test);
+            }
+#endif
+#if defined(ZZTEST_CONFIG_WIRE)
+            zzt_wire_flush();
+#endif
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+            zzt_transport_poll();
+#endif
         }
 
+#if defined(ZZTEST_CONFIG_ASYNC)
+        zzt_async_drain(&totals, 0);
+#endif
         suiteMs = zzt_ms() - startSuiteMs;
+#if defined(ZZT_PERF_)
+        if (perfEnabled) {
+            zzt_perf_print(suite->suite_name, perfSuite);
+        }
+#endif
         if (suiteMs) {
             ZZT_PRINTF(ZZTLOG_H2 " %lu tests from %s (%lu ms total)\n\n",
-                suite->tests_count, suite->suite_name, suiteMs);
+                suiteCount, suite->suite_name, suiteMs);
         } else {
-            ZZT_PRINTF(ZZTLOG_H2 " %lu tests from %s\n\n", suite->tests_count,
+            ZZT_PRINTF(ZZTLOG_H2 " %lu tests from %s\n\n", suiteCount,
                 suite->suite_name);
         }
     }
@@ -544,25 +7221,48 @@ zzt_run_all(void)
     if (allMs) {
         ZZT_PRINTF(ZZTLOG_H1
             " %lu tests from %lu test suites ran. (%lu ms total)\n",
-            g_testsCount, g_suitesCount, allMs);
+            testsCount, suitesCount, allMs);
     } else {
         ZZT_PRINTF(ZZTLOG_H1 " %lu tests from %lu test suites ran.\n",
-            g_testsCount, g_suitesCount);
+            testsCount, suitesCount);
     }
 
-    ZZT_PRINTF(ZZTLOG_PASSED " %lu tests.\n", passed);
+#if defined(ZZT_PERF_)
+    zzt_perf_close();
+#endif
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
+    if (g_options.slowest != 0) {
+        zzt_print_slowest(g_options.slowest);
+    }
+#endif
+
+    ZZT_PRINTF(ZZTLOG_PASSED " %lu tests.\n", totals.passed);
+    if (totals.resumed != 0) {
+        ZZT_PRINTF(ZZTLOG_H1 " %lu tests finished in an earlier run.\n",
+            totals.resumed);
+    }
+    if (totals.cached != 0) {
+        ZZT_PRINTF(ZZTLOG_CACHED " %lu tests passed in an earlier run.\n",
+            totals.cached);
+    }
 
-    if (skipped != 0) {
-        ZZT_PRINTF(ZZTLOG_SKIPPED " %lu tests, listed below:\n", skipped);
+    if (totals.skipped != 0) {
+#if defined(ZZTEST_CONFIG_NO_SKIP_LIST)
+        ZZT_PRINTF(ZZTLOG_SKIPPED " %lu tests.\n", totals.skipped);
+#else
+        ZZT_PRINTF(
+            ZZTLOG_SKIPPED " %lu tests, listed below:\n", totals.skipped);
 
         test = g_testSkipHead;
         for (; test; test = test->next_skip) {
             ZZT_PRINTF(ZZTLOG_SKIPPED " %s\n", test->test_name);
         }
+#endif
     }
 
-    if (failed != 0) {
-        ZZT_PRINTF(ZZTLOG_FAILED " %lu tests, listed below:\n", failed);
+    if (totals.failed != 0) {
+        ZZT_PRINTF(
+            ZZTLOG_FAILED " %lu tests, listed below:\n", totals.failed);
 
         test = g_testFailHead;
         for (; test; test = test->next_fail) {
@@ -570,5 +7270,190 @@ zzt_run_all(void)
         }
     }
 
-    return failed != 0;
+    if (g_options.cache != NULL) {
+        zzt_cache_save(g_options.cache);
+    }
+    zzt_cache_close();
+    zzt_log_close();
+#if defined(ZZTEST_CONFIG_BENCH)
+    zzt_bench_out_close();
+#endif
+
+#if defined(ZZTEST_CONFIG_SELECT)
+    if (g_options.record && g_options.map != NULL) {
+        zzt_map_save(g_options.map);
+    }
+    zzt_map_close();
+#endif
+#if defined(ZZTEST_CONFIG_WIRE)
+    zzt_wire_flush();
+#endif
+#if defined(ZZTEST_CONFIG_TRANSPORT)
+    zzt_transport_flush();
+#endif
+
+    return totals.failed != 0;
+}
+
+/******************************************************************************/
+
+/**
+ * @brief Match an option of the form --name=value.
+ *
+ * @return Pointer to value, or NULL if arg is a different option.
+ */
+static const char *
+zzt_option(const char *arg, const char *name)
+{
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+        return NULL;
+    }
+    return arg + len + 1;
+}
+
+/**
+ * @brief Print command line help.
+ */
+static void
+zzt_usage(const char *argv0)
+{
+    ZZT_PRINTF("Usage: %s [options]\n", argv0 ? argv0 : "test");
+    ZZT_PRINTF("  --help          Print this help.\n");
+    ZZT_PRINTF("  --cache[=FILE]  Skip tests that passed in an earlier run of "
+               "this binary.\n");
+    ZZT_PRINTF("  --log[=FILE]    Record results in a binary log as tests "
+               "finish.\n");
+    ZZT_PRINTF("  --resume        Skip tests finished in the log of a run "
+               "that crashed.\n");
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
+    ZZT_PRINTF("  --slowest[=N]   List the N slowest tests and the time of "
+               "each suite, 10 by default.\n");
+    ZZT_PRINTF("  --warn-ms=N     Warn about tests that take longer than N "
+               "ms.\n");
+    ZZT_PRINTF("  --fail-ms=N     Fail tests that take longer than N ms.\n");
+    ZZT_PRINTF("  --time-scale=X  Multiply time budgets by X, for slow "
+               "machines.\n");
+#endif
+#if defined(ZZTEST_CONFIG_BENCH)
+    ZZT_PRINTF("  --bench-out[=FILE] Write benchmark results as JSON to "
+               "<program>.bench.json.\n");
+#endif
+#if defined(ZZTEST_CONFIG_THREADS)
+    ZZT_PRINTF("  --jobs[=N]      Run tests on N threads, one per processor "
+               "by default.\n");
+    ZZT_PRINTF("  --pin-cpus[=numa] Keep each --jobs thread on one "
+               "processor, or one NUMA node.\n");
+#endif
+#if defined(ZZTEST_CONFIG_SELECT)
+    ZZT_PRINTF("  --record        Record the functions each test enters.\n");
+    ZZT_PRINTF("  --changed=FILE  Only run tests that entered a symbol "
+               "listed in FILE.\n");
+    ZZT_PRINTF("  --map=FILE      Test map to use, instead of "
+               "<program>.zztmap.\n");
+#endif
+}
+
+/******************************************************************************/
+
+int
+zzt_run_args(int argc, char **argv)
+{
+    static char cachePath[1024];
+    static char logPath[1024];
+    const char *value = NULL;
+    ZZT_BOOL wantLog = ZZT_FALSE;
+    int i = 0;
+#if defined(ZZTEST_CONFIG_SELECT)
+    static char mapPath[1024];
+#endif
+#if defined(ZZTEST_CONFIG_BENCH)
+    static char benchPath[1024];
+#endif
+
+    g_options.argv0 = argc > 0 ? argv[0] : NULL;
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--help")) {
+            zzt_usage(g_options.argv0);
+            return 0;
+        } else if (!strcmp(argv[i], "--cache")) {
+            if (g_options.argv0 != NULL) {
+                zzt_sprintf(cachePath, sizeof(cachePath), "%s.zztcache",
+                    g_options.argv0);
+                g_options.cache = cachePath;
+            }
+        } else if ((value = zzt_option(argv[i], "--cache")) != NULL) {
+            g_options.cache = value;
+        } else if (!strcmp(argv[i], "--log")) {
+            wantLog = ZZT_TRUE;
+        } else if ((value = zzt_option(argv[i], "--log")) != NULL) {
+            g_options.log = value;
+        } else if (!strcmp(argv[i], "--resume")) {
+            g_options.resume = ZZT_TRUE;
+#if !defined(ZZTEST_CONFIG_NO_TIMING)
+        } else if (!strcmp(argv[i], "--slowest")) {
+            g_options.slowest = 10;
+        } else if ((value = zzt_option(argv[i], "--slowest")) != NULL) {
+            g_options.slowest = strtoul(value, NULL, 10);
+        } else if ((value = zzt_option(argv[i], "--warn-ms")) != NULL) {
+            g_options.warnMs = strtoul(value, NULL, 10);
+        } else if ((value = zzt_option(argv[i], "--fail-ms")) != NULL) {
+            g_options.failMs = strtoul(value, NULL, 10);
+        } else if ((value = zzt_option(argv[i], "--time-scale")) != NULL) {
+            g_options.timeScale = zzt_scale_parse(value);
+            if (g_options.timeScale == 0) {
+                ZZT_PRINTF("error: Bad time scale %s\n", value);
+                return 1;
+            }
+#endif
+#if defined(ZZTEST_CONFIG_BENCH)
+        } else if (!strcmp(argv[i], "--bench-out")) {
+            if (g_options.argv0 != NULL) {
+                zzt_sprintf(benchPath, sizeof(benchPath), "%s.bench.json",
+                    g_options.argv0);
+                g_options.benchOut = benchPath;
+            }
+        } else if ((value = zzt_option(argv[i], "--bench-out")) != NULL) {
+            g_options.benchOut = value;
+#endif
+#if defined(ZZTEST_CONFIG_THREADS)
+        } else if (!strcmp(argv[i], "--jobs")) {
+            g_options.jobs = zzt_cpu_count();
+        } else if ((value = zzt_option(argv[i], "--jobs")) != NULL) {
+            g_options.jobs = strtoul(value, NULL, 10);
+        } else if (!strcmp(argv[i], "--pin-cpus")) {
+            g_options.pin = ZZT_PIN_CPU;
+        } else if (!strcmp(argv[i], "--pin-cpus=numa")) {
+            g_options.pin = ZZT_PIN_NODE;
+#endif
+#if defined(ZZTEST_CONFIG_SELECT)
+        } else if (!strcmp(argv[i], "--record")) {
+            g_options.record = ZZT_TRUE;
+        } else if ((value = zzt_option(argv[i], "--changed")) != NULL) {
+            g_options.changed = value;
+        } else if ((value = zzt_option(argv[i], "--map")) != NULL) {
+            g_options.map = value;
+#endif
+        } else {
+            ZZT_PRINTF("error: Unknown option %s\n", argv[i]);
+            zzt_usage(g_options.argv0);
+            return 1;
+        }
+    }
+
+    /* Resuming reads the log of the run being resumed, and writes anew. */
+    if ((wantLog || g_options.resume) && g_options.log == NULL &&
+        g_options.argv0 != NULL) {
+        zzt_sprintf(logPath, sizeof(logPath), "%s.zztlog", g_options.argv0);
+        g_options.log = logPath;
+    }
+
+#if defined(ZZTEST_CONFIG_SELECT)
+    if (g_options.map == NULL && g_options.argv0 != NULL) {
+        zzt_sprintf(mapPath, sizeof(mapPath), "%s.zztmap", g_options.argv0);
+        g_options.map = mapPath;
+    }
+#endif
+
+    return zzt_run_all();
 }
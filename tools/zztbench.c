@@ -0,0 +1,321 @@
+/*
+ * zztest - A test framework for crufty compilers.
+ * Copyright (c) 2024 Lexi Mayfield
+ *
+ * Distributed under the Boost Software License, Version 1.0. (See
+ * accompanying file LICENSE.txt or copy at
+ * http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+/*
+ * Compares two benchmark results files written by --bench-out.  Each
+ * benchmark in both is tested for a change in its mean time with Welch's
+ * t-test, and slowdowns that are significant and large enough are flagged
+ * as regressions.  Reads the one object per line layout the runner writes,
+ * not JSON in general.
+ */
+
+#include "zztest.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* One benchmark of a results file. */
+struct result_s {
+    char name[256]; /* Test name, with the size or threads if any. */
+    double mean;
+    double stddev;
+    double samples;
+    ZZT_BOOL matched;
+};
+
+/* A results file. */
+struct results_s {
+    struct result_s *items;
+    unsigned long count;
+    unsigned long cap;
+};
+
+/**
+ * @brief Find the number after "key": in line.
+ */
+static ZZT_BOOL
+read_field(const char *line, const char *key, double *out)
+{
+    char pattern[64];
+    const char *found = NULL;
+
+    sprintf(pattern, "\"%s\": ", key);
+    if ((found = strstr(line, pattern)) == NULL) {
+        return ZZT_FALSE;
+    }
+    *out = strtod(found + strlen(pattern), NULL);
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Read the benchmarks of a results file.
+ */
+static ZZT_BOOL
+read_results(const char *path, struct results_s *results)
+{
+    char line[4096];
+    const char *name = NULL;
+    double size = 0, threads = 0;
+    struct result_s *result = NULL;
+    FILE *file = fopen(path, "r");
+    size_t len = 0;
+
+    if (file == NULL) {
+        fprintf(stderr, "%s: error: Could not open\n", path);
+        return ZZT_FALSE;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if ((name = strstr(line, "{\"name\": \"")) == NULL) {
+            continue;
+        }
+        name += strlen("{\"name\": \"");
+
+        if (results->count == results->cap) {
+            struct result_s *items = NULL;
+            results->cap = results->cap != 0 ? results->cap * 2 : 64;
+            items = (struct result_s *)realloc(
+                results->items, results->cap * sizeof(*items));
+            if (items == NULL) {
+                fprintf(stderr, "%s: error: Out of memory\n", path);
+                fclose(file);
+                return ZZT_FALSE;
+            }
+            results->items = items;
+        }
+
+        result = &results->items[results->count];
+        memset(result, 0, sizeof(*result));
+        len = strcspn(name, "\"");
+        if (len >= sizeof(result->name) - 32) {
+            len = sizeof(result->name) - 32;
+        }
+        memcpy(result->name, name, len);
+        result->name[len] = '\0';
+        if (read_field(line, "size", &size) && size != 0) {
+            sprintf(result->name + len, "/%.0f", size);
+            len += strlen(result->name + len);
+        }
+        if (read_field(line, "threads", &threads) && threads > 1) {
+            sprintf(result->name + len, "/threads:%.0f", threads);
+        }
+
+        if (!read_field(line, "mean_ns", &result->mean) ||
+            !read_field(line, "stddev_ns", &result->stddev) ||
+            !read_field(line, "samples", &result->samples)) {
+            fprintf(stderr, "%s: warning: Skipping incomplete result %s\n",
+                path, result->name);
+            continue;
+        }
+        results->count += 1;
+    }
+
+    fclose(file);
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Natural logarithm of the gamma function for x >= 0.5, by the
+ *        Lanczos approximation.
+ */
+static double
+log_gamma(double x)
+{
+    static const double coefs[] = {0.99999999999980993, 676.5203681218851,
+        -1259.1392167224028, 771.32342877765313, -176.61502916214059,
+        12.507343278686905, -0.13857109526572012, 9.9843695780195716e-6,
+        1.5056327351493116e-7};
+    double sum = coefs[0], t = 0;
+    int i;
+
+    x -= 1;
+    for (i = 1; i < 9; i++) {
+        sum += coefs[i] / (x + i);
+    }
+    t = x + 7.5;
+    return 0.91893853320467274 + (x + 0.5) * log(t) - t + log(sum);
+}
+
+/**
+ * @brief Continued fraction of the incomplete beta function, by the
+ *        modified Lentz method.
+ */
+static double
+beta_fraction(double a, double b, double x)
+{
+    const double tiny = 1e-300;
+    double c = 1, d = 1 - (a + b) * x / (a + 1), h = 0, step = 0, num = 0;
+    int m;
+
+    d = 1 / (fabs(d) < tiny ? tiny : d);
+    h = d;
+    for (m = 1; m <= 300; m++) {
+        num = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+        d = 1 + num * d;
+        d = 1 / (fabs(d) < tiny ? tiny : d);
+        c = 1 + num / c;
+        c = fabs(c) < tiny ? tiny : c;
+        h *= d * c;
+
+        num = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+        d = 1 + num * d;
+        d = 1 / (fabs(d) < tiny ? tiny : d);
+        c = 1 + num / c;
+        c = fabs(c) < tiny ? tiny : c;
+        step = d * c;
+        h *= step;
+        if (fabs(step - 1) < 1e-12) {
+            break;
+        }
+    }
+    return h;
+}
+
+/**
+ * @brief Regularized incomplete beta function I_x(a, b).
+ */
+static double
+incomplete_beta(double a, double b, double x)
+{
+    double front = 0;
+
+    if (x <= 0) {
+        return 0;
+    } else if (x >= 1) {
+        return 1;
+    }
+
+    front = exp(log_gamma(a + b) - log_gamma(a) - log_gamma(b) +
+                a * log(x) + b * log(1 - x));
+    if (x < (a + 1) / (a + b + 2)) {
+        return front * beta_fraction(a, b, x) / a;
+    }
+    return 1 - front * beta_fraction(b, a, 1 - x) / b;
+}
+
+/**
+ * @brief Two-sided p-value of Welch's t-test that two means are equal.
+ */
+static double
+welch_p(const struct result_s *l, const struct result_s *r)
+{
+    double lv = l->stddev * l->stddev / l->samples;
+    double rv = r->stddev * r->stddev / r->samples;
+    double t = 0, df = 0;
+
+    if (l->samples < 2 || r->samples < 2) {
+        return 1;
+    } else if (lv + rv == 0) {
+        return l->mean == r->mean ? 1 : 0;
+    }
+
+    t = (r->mean - l->mean) / sqrt(lv + rv);
+    df = (lv + rv) * (lv + rv) /
+         (lv * lv / (l->samples - 1) + rv * rv / (r->samples - 1));
+    return incomplete_beta(df / 2, 0.5, df / (df + t * t));
+}
+
+/**
+ * @brief Format a time in nanoseconds with three significant decimals.
+ */
+static void
+format_time(char *buf, double ns)
+{
+    static const char *units[] = {"ns", "us", "ms", "s"};
+    int unit = 0;
+
+    while (unit < 3 && ns >= 1000) {
+        ns /= 1000;
+        unit += 1;
+    }
+    sprintf(buf, "%.3f %s", ns, units[unit]);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct results_s base = {NULL, 0, 0}, head = {NULL, 0, 0};
+    const char *paths[2] = {NULL, NULL};
+    double alpha = 0.05, threshold = 5, p = 0, change = 0;
+    unsigned long i = 0, j = 0, regressions = 0;
+    char before[32], after[32];
+    int count = 0, arg = 0;
+
+    for (arg = 1; arg < argc; arg++) {
+        if (strncmp(argv[arg], "--alpha=", 8) == 0) {
+            alpha = strtod(argv[arg] + 8, NULL);
+        } else if (strncmp(argv[arg], "--threshold=", 12) == 0) {
+            threshold = strtod(argv[arg] + 12, NULL);
+        } else if (count < 2 && argv[arg][0] != '-') {
+            paths[count++] = argv[arg];
+        } else {
+            count = 3;
+            break;
+        }
+    }
+    if (count != 2) {
+        fprintf(stderr,
+            "Usage: %s [--alpha=P] [--threshold=PCT] <before>.json "
+            "<after>.json\n",
+            argv[0]);
+        return 2;
+    }
+
+    if (!read_results(paths[0], &base) || !read_results(paths[1], &head)) {
+        free(base.items);
+        free(head.items);
+        return 2;
+    }
+
+    printf("%-40s %14s %14s %9s %8s\n", "BENCHMARK", "BEFORE", "AFTER",
+        "CHANGE", "P");
+    for (i = 0; i < head.count; i++) {
+        struct result_s *r = &head.items[i], *l = NULL;
+
+        for (j = 0; j < base.count && l == NULL; j++) {
+            if (!base.items[j].matched &&
+                strcmp(base.items[j].name, r->name) == 0) {
+                l = &base.items[j];
+                l->matched = ZZT_TRUE;
+            }
+        }
+        format_time(after, r->mean);
+        if (l == NULL) {
+            printf("%-40s %14s %14s\n", r->name, "-", after);
+            continue;
+        }
+
+        format_time(before, l->mean);
+        p = welch_p(l, r);
+        change = l->mean != 0 ? (r->mean - l->mean) * 100 / l->mean : 0;
+        printf("%-40s %14s %14s %+8.1f%% %8.4f", r->name, before, after,
+            change, p);
+        if (p < alpha && change > threshold) {
+            printf("  REGRESSION");
+            regressions += 1;
+        } else if (p < alpha && change < -threshold) {
+            printf("  improved");
+        }
+        putchar('\n');
+    }
+    for (j = 0; j < base.count; j++) {
+        if (!base.items[j].matched) {
+            format_time(before, base.items[j].mean);
+            printf("%-40s %14s %14s\n", base.items[j].name, before, "-");
+        }
+    }
+
+    printf("\n%lu regressions at p < %g and over %g%% slower.\n",
+        regressions, alpha, threshold);
+    free(base.items);
+    free(head.items);
+    return regressions != 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * zztest - A test framework for crufty compilers.
+ * Copyright (c) 2024 Lexi Mayfield
+ *
+ * Distributed under the Boost Software License, Version 1.0. (See
+ * accompanying file LICENSE.txt or copy at
+ * http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+/*
+ * Decoder for output framed by ZZTEST_CONFIG_TRANSPORT.  Reads a capture or
+ * a live stream, such as a pipe or a serial port, and prints the payload of
+ * each frame as it arrives.  Frames dropped on the target are reported on
+ * stderr where they were lost, and anything that isn't a valid frame is
+ * skipped.
+ */
+
+#include "zztest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define FRAME_MAX (ZZT_FRAME_OVERHEAD + ZZT_FRAME_PAYLOAD_MAX)
+
+static unsigned char g_frame[FRAME_MAX];
+static unsigned long g_have;
+static int g_seq = -1;
+static unsigned long g_lost;
+static unsigned long g_skipped;
+
+/**
+ * @brief Drop bytes from the front of the frame buffer.
+ */
+static void
+consume(unsigned long count)
+{
+    memmove(g_frame, g_frame + count, g_have - count);
+    g_have -= count;
+}
+
+/**
+ * @brief CRC of a frame, less its sync byte and its CRC.
+ */
+static unsigned
+crc16(const unsigned char *data, unsigned long len)
+{
+    unsigned crc = ZZT_FRAME_CRC_INIT;
+    unsigned long i = 0;
+    int bit = 0;
+
+    for (i = 0; i < len; i++) {
+        crc ^= (unsigned)data[i] << 8;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000U) ? (crc << 1) ^ ZZT_FRAME_CRC_POLY : crc << 1;
+        }
+        crc &= 0xFFFFU;
+    }
+    return crc;
+}
+
+/**
+ * @brief Print every complete frame in the buffer, skipping bytes until
+ *        the next sync byte when the buffer doesn't start with a frame.
+ */
+static void
+decode(void)
+{
+    while (g_have > 0) {
+        unsigned long len = 0;
+        ZZT_BOOL valid = ZZT_FALSE;
+
+        if (g_frame[0] != ZZT_FRAME_SYNC) {
+            g_skipped += 1;
+            consume(1);
+            continue;
+        } else if (g_have < 4) {
+            return;
+        }
+
+        len = g_frame[1] | ((unsigned long)g_frame[2] << 8);
+        if (len <= ZZT_FRAME_PAYLOAD_MAX) {
+            if (g_have < len + ZZT_FRAME_OVERHEAD) {
+                return;
+            }
+            valid = crc16(g_frame + 1, len + 3) ==
+                    (g_frame[len + 4] | ((unsigned)g_frame[len + 5] << 8));
+        }
+
+        if (!valid) {
+            /* Not a frame after all, resync on the next sync byte. */
+            g_skipped += 1;
+            consume(1);
+            continue;
+        }
+
+        if (g_seq >= 0 && ((g_seq + 1) & 0xFF) != g_frame[3]) {
+            unsigned long lost = (g_frame[3] - g_seq - 1) & 0xFF;
+            fprintf(
+                stderr, "zztdecode: %lu lines of output lost here\n", lost);
+            g_lost += lost;
+        }
+
+        g_seq = g_frame[3];
+        fwrite(g_frame + 4, 1, len, stdout);
+        fflush(stdout);
+        consume(len + ZZT_FRAME_OVERHEAD);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    FILE *file = stdin;
+    int ch = 0;
+
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [capture]\n", argv[0]);
+        return 2;
+    } else if (argc == 2) {
+        file = fopen(argv[1], "rb");
+        if (file == NULL) {
+            fprintf(stderr, "%s: error: Could not open\n", argv[1]);
+            return 2;
+        }
+    }
+
+    while ((ch = getc(file)) != EOF) {
+        g_frame[g_have++] = (unsigned char)ch;
+        decode();
+    }
+
+    /* A damaged length can hide frames behind it until the stream ends. */
+    while (g_have > 0) {
+        g_skipped += 1;
+        consume(1);
+        decode();
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    if (g_lost != 0 || g_skipped != 0) {
+        fprintf(stderr,
+            "zztdecode: %lu lines of output lost, %lu bytes skipped\n",
+            g_lost, g_skipped);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ * zztest - A test framework for crufty compilers.
+ * Copyright (c) 2024 Lexi Mayfield
+ *
+ * Distributed under the Boost Software License, Version 1.0. (See
+ * accompanying file LICENSE.txt or copy at
+ * http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+/*
+ * Expander for output sent with ZZTEST_CONFIG_WIRE.  Reads the events from a
+ * capture or a live stream and prints the text the runner would have
+ * printed.  When the events were sent with ZZTEST_CONFIG_TRANSPORT, pipe
+ * zztdecode into it.
+ */
+
+#include "zztest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static FILE *g_in;
+static char **g_strings;
+static unsigned long g_count;
+static unsigned long g_cap;
+
+/**
+ * @brief Read a number, LEB128.
+ */
+static ZZT_BOOL
+read_number(ZZT_UINTMAX *out)
+{
+    ZZT_UINTMAX u = 0;
+    unsigned shift = 0;
+    int ch = 0;
+
+    do {
+        ch = getc(g_in);
+        if (ch == EOF) {
+            return ZZT_FALSE;
+        } else if (shift < sizeof(u) * CHAR_BIT) {
+            u |= (ZZT_UINTMAX)(ch & 0x7F) << shift;
+        }
+        shift += 7;
+    } while ((ch & 0x80) != 0);
+
+    *out = u;
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Read a zigzag encoded signed number.
+ */
+static ZZT_BOOL
+read_signed(ZZT_INTMAX *out)
+{
+    ZZT_UINTMAX u = 0;
+
+    if (!read_number(&u)) {
+        return ZZT_FALSE;
+    }
+    *out = (u & 1) != 0 ? -(ZZT_INTMAX)(u >> 1) - 1 : (ZZT_INTMAX)(u >> 1);
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Read text into a new NUL-terminated buffer.
+ */
+static char *
+read_text(void)
+{
+    ZZT_UINTMAX len = 0;
+    char *text = NULL;
+
+    if (!read_number(&len) || len > 0xFFFF) {
+        return NULL;
+    }
+
+    text = (char *)malloc((size_t)len + 1);
+    if (text == NULL || fread(text, 1, (size_t)len, g_in) != (size_t)len) {
+        free(text);
+        return NULL;
+    }
+    text[len] = '\0';
+    return text;
+}
+
+/**
+ * @brief Look up a string by ID.
+ */
+static const char *
+string(ZZT_UINTMAX id)
+{
+    static char unknown[32];
+
+    if (id < g_count) {
+        return g_strings[id];
+    }
+    sprintf(unknown, "<string %lu>", (unsigned long)id);
+    return unknown;
+}
+
+/**
+ * @brief Copy a width or precision into spec, reading it from the stream if
+ *        it's a '*'.
+ */
+static ZZT_BOOL
+expand_width(const char **fmt, char **w)
+{
+    ZZT_INTMAX value = 0;
+    int digits = 0;
+
+    if (**fmt == '*') {
+        *fmt += 1;
+        if (!read_signed(&value)) {
+            return ZZT_FALSE;
+        }
+        *w += sprintf(*w, "%d", (int)value);
+        return ZZT_TRUE;
+    }
+
+    /* Widths too long to mean anything are cut, to fit in the spec. */
+    for (; **fmt >= '0' && **fmt <= '9'; *fmt += 1) {
+        if (digits++ < 12) {
+            *(*w)++ = **fmt;
+        }
+    }
+    return ZZT_TRUE;
+}
+
+/**
+ * @brief Print a format string, reading the argument of each conversion
+ *        from the stream.  Arguments are printed at the host's widest
+ *        integer type, so the target's length modifiers are dropped.
+ */
+static ZZT_BOOL
+expand(const char *fmt)
+{
+    while (*fmt != '\0') {
+        char spec[64];
+        char *w = spec;
+        ZZT_UINTMAX u = 0;
+        ZZT_INTMAX v = 0;
+        char conv = 0;
+
+        if (*fmt != '%') {
+            putchar(*fmt++);
+            continue;
+        }
+
+        *w++ = *fmt++;
+        while (*fmt != '\0' && strchr("-+ #0'", *fmt) != NULL &&
+               w < spec + 8) {
+            *w++ = *fmt++;
+        }
+        if (!expand_width(&fmt, &w)) {
+            return ZZT_FALSE;
+        }
+        if (*fmt == '.') {
+            *w++ = *fmt++;
+            if (!expand_width(&fmt, &w)) {
+                return ZZT_FALSE;
+            }
+        }
+
+        if (fmt[0] == 'I' && fmt[1] == '6' && fmt[2] == '4') {
+            fmt += 3;
+        }
+        while (*fmt != '\0' && strchr("hljqztL", *fmt) != NULL) {
+            fmt += 1;
+        }
+
+        conv = *fmt;
+        if (conv != '\0') {
+            fmt += 1;
+        }
+
+        switch (conv) {
+        case '%': putchar('%'); break;
+        case 'c':
+            u = (ZZT_UINTMAX)getc(g_in);
+            strcpy(w, "c");
+            printf(spec, (int)u);
+            break;
+        case 'd':
+        case 'i':
+            if (!read_signed(&v)) {
+                return ZZT_FALSE;
+            }
+            strcpy(w, ZZT_PRIiMAX);
+            printf(spec, v);
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            if (!read_number(&u)) {
+                return ZZT_FALSE;
+            }
+            strcpy(w, ZZT_PRIuMAX);
+            w[strlen(w) - 1] = conv;
+            printf(spec, u);
+            break;
+        case 'p':
+            if (!read_number(&u)) {
+                return ZZT_FALSE;
+            }
+            printf("0x%" ZZT_PRIxMAX, u);
+            break;
+        case 's':
+            if (!read_number(&u)) {
+                return ZZT_FALSE;
+            }
+            strcpy(w, "s");
+            printf(spec, string(u));
+            break;
+        default: {
+            /* Floating point, formatted on the target. */
+            char *text = read_text();
+            if (text == NULL) {
+                return ZZT_FALSE;
+            }
+            fputs(text, stdout);
+            free(text);
+            break;
+        }
+        }
+    }
+
+    return ZZT_TRUE;
+}
+
+int
+main(int argc, char **argv)
+{
+    char magic[sizeof(ZZT_WIRE_MAGIC) - 1];
+    ZZT_BOOL ok = ZZT_TRUE;
+    int event = 0;
+
+    g_in = stdin;
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [capture]\n", argv[0]);
+        return 2;
+    } else if (argc == 2) {
+        g_in = fopen(argv[1], "rb");
+        if (g_in == NULL) {
+            fprintf(stderr, "%s: error: Could not open\n", argv[1]);
+            return 2;
+        }
+    }
+
+    if (fread(magic, 1, sizeof(magic), g_in) != sizeof(magic) ||
+        memcmp(magic, ZZT_WIRE_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "zztexpand: error: Not a zztest event stream\n");
+        return 2;
+    }
+
+    while (ok && (event = getc(g_in)) != EOF) {
+        ZZT_UINTMAX id = 0;
+        char *text = NULL;
+
+        switch (event) {
+        case ZZT_WIRE_STRING:
+            text = read_text();
+            if (text == NULL) {
+                ok = ZZT_FALSE;
+                break;
+            }
+            if (g_count == g_cap) {
+                g_cap = g_cap ? g_cap * 2 : 256;
+                g_strings = (char **)realloc(
+                    (void *)g_strings, g_cap * sizeof(*g_strings));
+                if (g_strings == NULL) {
+                    fprintf(stderr, "zztexpand: error: Out of memory\n");
+                    return 2;
+                }
+            }
+            g_strings[g_count++] = text;
+            break;
+        case ZZT_WIRE_TEXT:
+            text = read_text();
+            ok = text != NULL;
+            if (ok) {
+                fputs(text, stdout);
+                free(text);
+            }
+            break;
+        case ZZT_WIRE_PRINT:
+            ok = read_number(&id) && expand(string(id));
+            break;
+        default:
+            fprintf(stderr, "zztexpand: error: Unknown event 0x%02x\n", event);
+            return 2;
+        }
+        fflush(stdout);
+    }
+
+    if (!ok) {
+        fprintf(stderr, "zztexpand: error: Stream ends in the middle of an "
+                        "event\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * zztest - A test framework for crufty compilers.
+ * Copyright (c) 2024 Lexi Mayfield
+ *
+ * Distributed under the Boost Software License, Version 1.0. (See
+ * accompanying file LICENSE.txt or copy at
+ * http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+/*
+ * Post-mortem reader for the results log written by --log.  Must be built
+ * for the same platform as the test binary, as the log is in native layout.
+ */
+
+#include "zztest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *g_statusNames[] = {
+    "?", "RUNNING", "PASSED", "FAILED", "SKIPPED", "CACHED"};
+
+int
+main(int argc, char **argv)
+{
+    struct zzt_log_header_s header;
+    struct zzt_log_record_s record;
+    unsigned long i = 0, counts[ZZT_STATUS_CACHED + 1] = {0}, ms = 0;
+    FILE *file = NULL;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <program>.zztlog\n", argv[0]);
+        return 2;
+    }
+
+    file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        fprintf(stderr, "%s: error: Could not open\n", argv[1]);
+        return 2;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, ZZT_LOG_MAGIC, sizeof(ZZT_LOG_MAGIC)) != 0 ||
+        header.record_size != sizeof(record)) {
+        fprintf(stderr, "%s: error: Not a results log from this platform\n",
+            argv[1]);
+        fclose(file);
+        return 2;
+    }
+
+    printf("%-8s %6s %8s %6s %6s  %s\n", "STATUS", "INDEX", "MS", "PASS",
+        "FAIL", "TEST");
+    for (i = 0; i < header.count; i++) {
+        if (fread(&record, sizeof(record), 1, file) != 1) {
+            fprintf(stderr, "%s: warning: Truncated after %lu records\n",
+                argv[1], i);
+            break;
+        }
+
+        record.name[sizeof(record.name) - 1] = '\0';
+        record.fail_file[sizeof(record.fail_file) - 1] = '\0';
+        if (record.status > ZZT_STATUS_CACHED) {
+            record.status = 0;
+        }
+
+        counts[record.status] += 1;
+        ms += record.ms;
+        printf("%-8s %6lu %8lu %6lu %6lu  %s\n", g_statusNames[record.status],
+            record.index, record.ms, record.passed, record.failed,
+            record.name);
+        if (record.fail_file[0] != '\0') {
+            printf("%39s%s(%lu)\n", "first failure at ", record.fail_file,
+                record.fail_line);
+        }
+    }
+    fclose(file);
+
+    printf("\n%lu of %lu tests recorded in %lu ms: %lu passed, %lu failed, "
+           "%lu skipped, %lu cached.\n",
+        header.count, header.capacity, ms, counts[ZZT_STATUS_PASSED],
+        counts[ZZT_STATUS_FAILED], counts[ZZT_STATUS_SKIPPED],
+        counts[ZZT_STATUS_CACHED]);
+    if (counts[ZZT_STATUS_RUNNING] != 0) {
+        printf("The runner died during %lu tests marked RUNNING.\n",
+            counts[ZZT_STATUS_RUNNING]);
+    }
+
+    return counts[ZZT_STATUS_FAILED] != 0 || counts[ZZT_STATUS_RUNNING] != 0;
+}